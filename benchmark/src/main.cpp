@@ -0,0 +1,713 @@
+#include <stdarg.h> // va_list
+#include <stdio.h>  // printf, fprintf, vsnprintf
+#include <string.h> // strcmp, strlen
+#include <chrono>   // steady_clock
+#include <vector>
+
+#include "glsl-parser/builtins.h"
+#include "glsl-parser/compact.h"
+#include "glsl-parser/converter.h"
+#include "glsl-parser/lexer.h"
+#include "glsl-parser/parser.h"
+
+using namespace glsl;
+
+// Small deterministic generator so every run lexes the same source
+struct generator {
+    generator() : m_state(0x2545F491u) { }
+    unsigned next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+    unsigned next(unsigned bound) {
+        return next() % bound;
+    }
+private:
+    unsigned m_state;
+};
+
+struct source {
+    void append(const char *string) {
+        size_t length = strlen(string);
+        m_data.insert(m_data.end(), string, string + length);
+    }
+    void appendf(const char *fmt, ...) {
+        char buffer[1024];
+        va_list va;
+        va_start(va, fmt);
+        int length = vsnprintf(buffer, sizeof buffer, fmt, va);
+        va_end(va);
+        if (length > 0)
+            m_data.insert(m_data.end(), buffer, buffer + length);
+    }
+    const char *finish() {
+        m_data.push_back('\0');
+        return &m_data[0];
+    }
+    size_t size() const {
+        return m_data.size();
+    }
+    const char *data() const {
+        return &m_data[0];
+    }
+private:
+    std::vector<char> m_data;
+};
+
+static double now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Lexes the whole source and returns the number of tokens produced
+static size_t lexAll(const char *data) {
+    lexer lex(data);
+    size_t count = 0;
+    for (;;) {
+        token next = lex.read();
+        if (lex.error()) {
+            fprintf(stderr, "lexer error: %s\n", lex.error());
+            return 0;
+        }
+        if (next.type() == kType_eof)
+            break;
+        count++;
+    }
+    return count;
+}
+
+static void report(const char *name, size_t bytes, size_t tokens, double seconds) {
+    printf("%-24s %8.2f MB/s %8.2f Mtokens/s  (%zu bytes, %zu tokens, %.3f ms)\n",
+        name,
+        bytes / seconds / (1024.0 * 1024.0),
+        tokens / seconds / 1e6,
+        bytes,
+        tokens,
+        seconds * 1e3);
+}
+
+// Runs the lexer over data a number of times and reports the best run
+static void benchmarkLexer(const char *name, const char *data, size_t bytes) {
+    double best = 1e30;
+    size_t tokens = 0;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        tokens = lexAll(data);
+        double elapsed = now() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    report(name, bytes, tokens, best);
+}
+
+static const char *kIdentifierWords[] = {
+    "position", "normal", "texcoord", "worldMatrix", "viewProjection", "albedo",
+    "roughness", "metallic", "lightDirection", "shadowCoord", "cascadeIndex", "result"
+};
+
+static const char *kKeywordWords[] = {
+    "vec2", "vec3", "vec4", "mat4", "float", "int", "uniform", "in", "out", "const",
+    "highp", "sampler2D", "return", "if", "else", "for", "layout", "struct", "dmat4x3"
+};
+
+// Declarations and expressions made almost entirely of identifiers and keywords
+static void lexIdentifiers() {
+    generator rng;
+    source src;
+    while (src.size() < (8u << 20)) {
+        for (int i = 0; i < 8; i++) {
+            const char *keyword = kKeywordWords[rng.next(sizeof kKeywordWords / sizeof *kKeywordWords)];
+            const char *identifier = kIdentifierWords[rng.next(sizeof kIdentifierWords / sizeof *kIdentifierWords)];
+            src.appendf("%s %s_%u ", keyword, identifier, rng.next(64));
+        }
+        src.append("\n");
+    }
+    const size_t bytes = src.size();
+    benchmarkLexer("lex-identifiers", src.finish(), bytes);
+}
+
+static const char *kLicenseLines[] = {
+    "Copyright (c) the authors. All rights reserved.",
+    "Permission is hereby granted, free of charge, to any person obtaining a copy",
+    "of this software and associated documentation files (the \"Software\"), to deal",
+    "THE SOFTWARE IS PROVIDED \"AS IS\", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR",
+    "IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,"
+};
+
+// Generated shader style: big license blocks, line comments and deep indentation
+static void lexWhitespace() {
+    generator rng;
+    source src;
+    while (src.size() < (8u << 20)) {
+        src.append("/*\n");
+        for (int i = 0; i < 24; i++)
+            src.appendf(" * %s\n", kLicenseLines[rng.next(sizeof kLicenseLines / sizeof *kLicenseLines)]);
+        src.append(" */\n");
+        for (int i = 0; i < 16; i++) {
+            const int depth = 1 + rng.next(6);
+            for (int j = 0; j < depth; j++)
+                src.append(rng.next(4) ? "    " : "\t");
+            if (rng.next(3) == 0)
+                src.appendf("// %s\n", kLicenseLines[rng.next(sizeof kLicenseLines / sizeof *kLicenseLines)]);
+            else
+                src.appendf("%s = %s;        \n", kIdentifierWords[rng.next(12)], kIdentifierWords[rng.next(12)]);
+        }
+    }
+    const size_t bytes = src.size();
+    benchmarkLexer("lex-whitespace", src.finish(), bytes);
+}
+
+// Lookup tables and unrolled kernels: mostly numeric literals
+static void lexLiterals() {
+    generator rng;
+    source src;
+    while (src.size() < (8u << 20)) {
+        src.append("const float kTable[64] = float[](");
+        for (int i = 0; i < 64; i++)
+            src.appendf("%s%u.%04u", i ? ", " : "", rng.next(10), rng.next(10000));
+        src.append(");\n");
+        for (int i = 0; i < 8; i++)
+            src.appendf("acc += texelFetch(s, ivec2(%u, %u), 0) * %u.%ue-%u + %uu;\n",
+                rng.next(256), rng.next(256), rng.next(10), rng.next(1000), 1 + rng.next(9), rng.next(100000));
+    }
+    const size_t bytes = src.size();
+    benchmarkLexer("lex-literals", src.finish(), bytes);
+}
+
+static const char *kOperatorWords[] = {
+    "+", "-", "*", "/", "%", "<<", ">>", "<", ">", "<=", ">=", "==", "!=",
+    "&", "^", "|", "&&", "^^", "||", "+=", "-=", "*=", "/=", "<<=", ">>=", "|="
+};
+
+// Expression heavy code where nearly every other token is an operator
+static void lexOperators() {
+    generator rng;
+    source src;
+    while (src.size() < (8u << 20)) {
+        src.append("r");
+        for (int i = 0; i < 12; i++) {
+            const char *op = kOperatorWords[rng.next(sizeof kOperatorWords / sizeof *kOperatorWords)];
+            src.appendf("%s%s(a[%u]++)", op, rng.next(2) ? "-" : "~", rng.next(8));
+        }
+        src.append(";\n");
+    }
+    const size_t bytes = src.size();
+    benchmarkLexer("lex-operators", src.finish(), bytes);
+}
+
+// Keys typed into a large file, relexed incrementally
+static void relexEdits() {
+    generator rng;
+    source src;
+    while (src.size() < (8u << 20)) {
+        src.append("/* scale\n * and bias */\n");
+        for (int i = 0; i < 8; i++) {
+            const char *identifier = kIdentifierWords[rng.next(sizeof kIdentifierWords / sizeof *kIdentifierWords)];
+            src.appendf("    %s = %s * %u.%u + %s; // update\n", identifier, identifier, rng.next(10), rng.next(100), identifier);
+        }
+    }
+    src.finish();
+    std::vector<char> edited;
+    edited.reserve(src.size() + 1);
+    edited.insert(edited.end(), src.data(), src.data() + src.size() - 1);
+
+    lexer lex(&edited[0], edited.size());
+    double start = now();
+    lex.tokenize();
+    const double full = now() - start;
+
+    // Type a statement at the start of a line somewhere and take it out
+    // again a key at a time, only relexing is timed. Moving to the next
+    // place is an edit of its own. Typing into the middle of a token can
+    // leave a lexer error, after which there are no tokens to pick up again
+    // and the rest of the file is lexed.
+    const int places = 100;
+    const char word[] = "x1 = y;";
+    const size_t keys = sizeof word - 1;
+    double spent = 0.0;
+    double moving = 0.0;
+    for (int i = 0; i < places; i++) {
+        size_t offset = rng.next(unsigned(edited.size()));
+        while (offset && edited[offset - 1] != '\n')
+            offset--;
+        start = now();
+        lex.relex(&edited[0], edited.size(), offset, 0, 0);
+        moving += now() - start;
+        for (size_t key = 0; key < keys; key++) {
+            edited.insert(edited.begin() + offset + key, word[key]);
+            start = now();
+            lex.relex(&edited[0], edited.size(), offset + key, 0, 1);
+            spent += now() - start;
+        }
+        for (size_t key = keys; key > 0; key--) {
+            edited.erase(edited.begin() + offset + key - 1);
+            start = now();
+            lex.relex(&edited[0], edited.size(), offset + key - 1, 1, 0);
+            spent += now() - start;
+        }
+    }
+    start = now();
+    const size_t tokens = lex.tokens().size();
+    const double settle = now() - start;
+    const double each = spent / double(places * keys * 2);
+    printf("%-24s %8.3f ms per key, %.3f ms per move, %.3f ms to read the tokens after, %.3f ms to lex everything (%zu bytes, %zu tokens)\n",
+        "relex-edits", each * 1e3, moving / places * 1e3, settle * 1e3, full * 1e3, edited.size(), tokens);
+}
+
+// Reading tokens back from a cache against lexing the source again
+static void loadTokens() {
+    generator rng;
+    source src;
+    while (src.size() < (8u << 20)) {
+        src.append("// per light\n");
+        for (int i = 0; i < 8; i++) {
+            const char *keyword = kKeywordWords[rng.next(sizeof kKeywordWords / sizeof *kKeywordWords)];
+            const char *identifier = kIdentifierWords[rng.next(sizeof kIdentifierWords / sizeof *kIdentifierWords)];
+            const char *op = kOperatorWords[rng.next(sizeof kOperatorWords / sizeof *kOperatorWords)];
+            src.appendf("%s %s_%u = %s %s %u.%u;\n", keyword, identifier, rng.next(64), identifier, op, rng.next(10), rng.next(100));
+        }
+    }
+    const size_t bytes = src.size();
+    const char *data = src.finish();
+
+    double fresh = 1e30;
+    vector<unsigned char> cache;
+    for (int i = 0; i < 5; i++) {
+        lexer lex(data, bytes);
+        double start = now();
+        lex.tokenize();
+        double elapsed = now() - start;
+        if (elapsed < fresh)
+            fresh = elapsed;
+        if (i == 0)
+            lex.saveTokens(cache);
+    }
+
+    double loaded = 1e30;
+    size_t tokens = 0;
+    for (int i = 0; i < 5; i++) {
+        lexer lex(0);
+        double start = now();
+        if (!lex.loadTokens(&cache[0], cache.size())) {
+            fprintf(stderr, "token cache rejected\n");
+            return;
+        }
+        double elapsed = now() - start;
+        if (elapsed < loaded)
+            loaded = elapsed;
+        tokens = lex.tokens().size();
+    }
+    report("lex-fresh", bytes, tokens, fresh);
+    report("load-tokens", bytes, tokens, loaded);
+    printf("%-24s %zu bytes of cache for %zu bytes of source\n", "", cache.size(), bytes);
+}
+
+// Functions full of declarations, expressions and control flow
+static void generateFunctions(source &src) {
+    generator rng;
+    src.append("#version 450 core\nuniform vec4 u_scale;\nuniform float u_bias[4];\n");
+    for (int function = 0; src.size() < (2u << 20); function++) {
+        src.appendf("vec4 shade_%d(vec4 color, float weight) {\n", function);
+        src.append("    vec4 result = color;\n    float amount = weight;\n");
+        for (int i = 0; i < 16; i++) {
+            switch (rng.next(4)) {
+            case 0:
+                src.appendf("    result = result * u_scale + vec4(amount * %u.%u);\n", rng.next(10), rng.next(100));
+                break;
+            case 1:
+                src.appendf("    if (amount > %u.0) { amount -= u_bias[%u]; } else { amount += 1.0; }\n", rng.next(10), rng.next(4));
+                break;
+            case 2:
+                src.appendf("    for (int i = 0; i < %u; i++) { result.x += float(i) * amount; }\n", 1 + rng.next(8));
+                break;
+            default:
+                src.appendf("    amount = clamp(amount * %u.5 - result.y, 0.0, 1.0);\n", rng.next(10));
+                break;
+            }
+        }
+        src.append("    return result;\n}\n");
+    }
+}
+
+static void parseFunctions() {
+    source src;
+    generateFunctions(src);
+    const size_t bytes = src.size();
+    const char *data = src.finish();
+
+    double best = 1e30;
+    size_t nodes = 0;
+    size_t chunks = 0;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        parser parse(data, bytes, "bench.frag");
+        astTU *tu = parse.parse(astTU::kFragment);
+        double elapsed = now() - start;
+        if (!tu) {
+            fprintf(stderr, "parser error: %s\n", parse.error());
+            return;
+        }
+        if (elapsed < best)
+            best = elapsed;
+        nodes = parse.memory().allocations();
+        chunks = parse.memory().chunks();
+    }
+    printf("%-24s %8.2f MB/s %8.2f Mplaced/s  (%zu bytes, %zu nodes and child lists in %zu allocations, %.3f ms)\n",
+        "parse-functions",
+        bytes / best / (1024.0 * 1024.0),
+        nodes / best / 1e6,
+        bytes,
+        nodes,
+        chunks,
+        best * 1e3);
+}
+
+// The same functions as a compact AST, how much smaller and how long it
+// takes to build and print compared to the AST it is built from
+static void compactAst() {
+    source src;
+    generateFunctions(src);
+    const size_t bytes = src.size();
+    const char *data = src.finish();
+
+    parser parse(data, bytes, "bench.frag");
+    astTU *tu = parse.parse(astTU::kFragment);
+    if (!tu) {
+        fprintf(stderr, "parser error: %s\n", parse.error());
+        return;
+    }
+
+    compactTU compact;
+    double build = 1e30;
+    double printAst = 1e30;
+    double printCompact = 1e30;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        compact.build(tu);
+        double elapsed = now() - start;
+        if (elapsed < build)
+            build = elapsed;
+
+        converter fromAst;
+        start = now();
+        fromAst.convertTU(tu);
+        elapsed = now() - start;
+        if (elapsed < printAst)
+            printAst = elapsed;
+
+        converter fromCompact;
+        start = now();
+        fromCompact.convertTU(&compact);
+        elapsed = now() - start;
+        if (elapsed < printCompact)
+            printCompact = elapsed;
+    }
+    printf("%-24s %8zu KiB of arena, %zu KiB compact (%zu expressions, %zu statements, %.3f ms to build)\n",
+        "compact-ast", parse.memory().bytes() >> 10, compact.bytes() >> 10,
+        compact.expressions.size(), compact.statements.size(), build * 1e3);
+    printf("%-24s %8.3f ms from the AST, %.3f ms from the compact AST\n", "compact-print", printAst * 1e3, printCompact * 1e3);
+}
+
+// The same functions saved as an image and read back in place, against
+// parsing them again, as a process mapping the image would
+static void loadImage() {
+    source src;
+    generateFunctions(src);
+    const size_t bytes = src.size();
+    const char *data = src.finish();
+
+    vector<unsigned char> image;
+    {
+        parser parse(data, bytes, "bench.frag");
+        astTU *tu = parse.parse(astTU::kFragment);
+        if (!tu) {
+            fprintf(stderr, "parser error: %s\n", parse.error());
+            return;
+        }
+        compactTU compact;
+        compact.build(tu);
+        if (!compact.save(image)) {
+            fprintf(stderr, "failed to save image\n");
+            return;
+        }
+    }
+
+    double reparse = 1e30;
+    double loaded = 1e30;
+    size_t functions = 0;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        parser parse(data, bytes, "bench.frag");
+        astTU *tu = parse.parse(astTU::kFragment);
+        double elapsed = now() - start;
+        if (!tu) {
+            fprintf(stderr, "parser error: %s\n", parse.error());
+            return;
+        }
+        if (elapsed < reparse)
+            reparse = elapsed;
+
+        start = now();
+        compactTU compact;
+        if (!compact.load(image.begin(), image.size())) {
+            fprintf(stderr, "failed to load image\n");
+            return;
+        }
+        functions = compact.functions.count;
+        elapsed = now() - start;
+        if (elapsed < loaded)
+            loaded = elapsed;
+    }
+    printf("%-24s %8.3f ms to parse, %.6f ms to load the image  (%zu bytes of image, %zu functions)\n",
+        "load-image", reparse * 1e3, loaded * 1e3, image.size(), functions);
+}
+
+// The same functions parsed with expressions shared and without
+static void parseShared() {
+    source src;
+    generateFunctions(src);
+    const size_t bytes = src.size();
+    const char *data = src.finish();
+
+    double best[2] = { 1e30, 1e30 };
+    size_t arena[2] = { 0, 0 };
+    for (int i = 0; i < 5; i++) {
+        for (int share = 0; share < 2; share++) {
+            double start = now();
+            parser parse(data, bytes, "bench.frag");
+            parse.shareExpressions(share != 0);
+            astTU *tu = parse.parse(astTU::kFragment);
+            double elapsed = now() - start;
+            if (!tu) {
+                fprintf(stderr, "parser error: %s\n", parse.error());
+                return;
+            }
+            if (elapsed < best[share])
+                best[share] = elapsed;
+            arena[share] = parse.memory().bytes();
+        }
+    }
+    printf("%-24s %8.2f MB/s %8zu KiB of arena  (%.3f ms)\n",
+        "parse-unshared", bytes / best[0] / (1024.0 * 1024.0), arena[0] >> 10, best[0] * 1e3);
+    printf("%-24s %8.2f MB/s %8zu KiB of arena  (%.3f ms)\n",
+        "parse-shared", bytes / best[1] / (1024.0 * 1024.0), arena[1] >> 10, best[1] * 1e3);
+}
+
+// Thousands of uniforms, each used, as generated material shaders have
+static void parseGlobals() {
+    generator rng;
+    source src;
+    const unsigned count = 10000;
+    src.append("#version 450 core\nout vec4 o_color;\n");
+    for (unsigned i = 0; i < count; i++)
+        src.appendf("uniform vec4 u_param_%u;\n", i);
+    src.append("vec4 gather(vec4 base) {\n    vec4 sum = base;\n");
+    for (unsigned i = 0; i < count; i++)
+        src.appendf("    sum += u_param_%u * u_param_%u.x;\n", i, rng.next(count));
+    src.append("    return sum;\n}\nvoid main() {\n    o_color = gather(vec4(0.0));\n}\n");
+    const size_t bytes = src.size();
+    const char *data = src.finish();
+
+    double best = 1e30;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        parser parse(data, bytes, "bench.frag");
+        astTU *tu = parse.parse(astTU::kFragment);
+        double elapsed = now() - start;
+        if (!tu) {
+            fprintf(stderr, "parser error: %s\n", parse.error());
+            return;
+        }
+        if (elapsed < best)
+            best = elapsed;
+    }
+    printf("%-24s %8.2f MB/s  (%u globals, %zu bytes, %.3f ms)\n",
+        "parse-globals", bytes / best / (1024.0 * 1024.0), count, bytes, best * 1e3);
+}
+
+// Hundreds of structures, and statements which begin with an identifier
+// that is either one of them or a variable
+static void parseStructs() {
+    generator rng;
+    source src;
+    const unsigned count = 500;
+    src.append("#version 450 core\nout vec4 o_color;\n");
+    for (unsigned i = 0; i < count; i++)
+        src.appendf("struct Material_%u { vec4 albedo; float roughness; };\n", i);
+    src.append("void main() {\n    float total = 0.0;\n");
+    for (unsigned i = 0; i < 20000; i++) {
+        if (rng.next(2))
+            src.appendf("    Material_%u m_%u;\n    m_%u.roughness = total;\n", rng.next(count), i, i);
+        else
+            src.appendf("    total = total * %u.5 + 1.0;\n", rng.next(10));
+    }
+    src.append("    o_color = vec4(total);\n}\n");
+    const size_t bytes = src.size();
+    const char *data = src.finish();
+
+    double best = 1e30;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        parser parse(data, bytes, "bench.frag");
+        astTU *tu = parse.parse(astTU::kFragment);
+        double elapsed = now() - start;
+        if (!tu) {
+            fprintf(stderr, "parser error: %s\n", parse.error());
+            return;
+        }
+        if (elapsed < best)
+            best = elapsed;
+    }
+    printf("%-24s %8.2f MB/s  (%u structures, %zu bytes, %.3f ms)\n",
+        "parse-structs", bytes / best / (1024.0 * 1024.0), count, bytes, best * 1e3);
+}
+
+// Many small shaders, each with a parser of its own or all with one reset
+static void parseReset() {
+    generator rng;
+    std::vector<source> shaders(2000);
+    size_t bytes = 0;
+    for (size_t i = 0; i < shaders.size(); i++) {
+        source &src = shaders[i];
+        src.append("#version 450 core\nuniform vec4 u_tint;\nin vec2 v_uv;\nout vec4 o_color;\n");
+        const unsigned count = 2 + rng.next(6);
+        for (unsigned j = 0; j < count; j++)
+            src.appendf("float weight_%u(float x) { return x * %u.%u + u_tint.x; }\n", j, rng.next(10), rng.next(100));
+        src.append("void main() {\n    vec4 color = u_tint;\n");
+        for (unsigned j = 0; j < count; j++)
+            src.appendf("    color.y += weight_%u(v_uv.x);\n", j);
+        src.append("    o_color = color;\n}\n");
+        bytes += src.size();
+        src.finish();
+    }
+
+    double fresh = 1e30;
+    double reused = 1e30;
+    size_t chunks = 0;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        for (size_t j = 0; j < shaders.size(); j++) {
+            parser parse(shaders[j].data(), shaders[j].size() - 1, "bench.frag");
+            if (!parse.parse(astTU::kFragment)) {
+                fprintf(stderr, "parser error: %s\n", parse.error());
+                return;
+            }
+        }
+        double elapsed = now() - start;
+        if (elapsed < fresh)
+            fresh = elapsed;
+
+        parser parse(0, 0, "bench.frag");
+        start = now();
+        for (size_t j = 0; j < shaders.size(); j++) {
+            parse.reset(shaders[j].data(), shaders[j].size() - 1, "bench.frag");
+            if (!parse.parse(astTU::kFragment)) {
+                fprintf(stderr, "parser error: %s\n", parse.error());
+                return;
+            }
+        }
+        elapsed = now() - start;
+        if (elapsed < reused)
+            reused = elapsed;
+        chunks = parse.memory().chunks();
+    }
+    printf("%-24s %8.2f MB/s %8.0f shaders/s  (%zu shaders, %.3f ms)\n",
+        "parse-fresh", bytes / fresh / (1024.0 * 1024.0), shaders.size() / fresh, shaders.size(), fresh * 1e3);
+    printf("%-24s %8.2f MB/s %8.0f shaders/s  (%zu shaders, %.3f ms, %zu arena allocations for the last)\n",
+        "parse-reset", bytes / reused / (1024.0 * 1024.0), shaders.size() / reused, shaders.size(), reused * 1e3, chunks);
+}
+
+// Made by the first parser of the process, timed by main before any
+static double builtinSeconds;
+
+// Many small shaders calling builtins and reading builtin variables
+static void parseBuiltins() {
+    static const char *const kCalls[] = {
+        "texture(u_albedo, v_uv)", "vec4(max(v_uv.x, %u.5))", "vec4(dot(v_normal, vec3(0.%u)))",
+        "vec4(clamp(gl_FragCoord.x, 0.0, %u.0))", "vec4(normalize(v_normal), 1.0)", "vec4(mix(0.%u, 1.0, 0.5))"
+    };
+    generator rng;
+    std::vector<source> shaders(2000);
+    size_t bytes = 0;
+    for (size_t i = 0; i < shaders.size(); i++) {
+        source &src = shaders[i];
+        src.append("#version 450 core\nuniform sampler2D u_albedo;\nin vec2 v_uv;\nin vec3 v_normal;\nout vec4 o_color;\n");
+        src.append("void main() {\n    vec4 color = vec4(0.0);\n");
+        const unsigned count = 4 + rng.next(8);
+        for (unsigned j = 0; j < count; j++) {
+            src.append("    color += ");
+            src.appendf(kCalls[rng.next(sizeof kCalls / sizeof *kCalls)], rng.next(10));
+            src.append(";\n");
+        }
+        src.append("    o_color = color;\n}\n");
+        bytes += src.size();
+        src.finish();
+    }
+
+    double best = 1e30;
+    for (int i = 0; i < 5; i++) {
+        double start = now();
+        for (size_t j = 0; j < shaders.size(); j++) {
+            parser parse(shaders[j].data(), shaders[j].size() - 1, "bench.frag");
+            if (!parse.parse(astTU::kFragment)) {
+                fprintf(stderr, "parser error: %s\n", parse.error());
+                return;
+            }
+        }
+        double elapsed = now() - start;
+        if (elapsed < best)
+            best = elapsed;
+    }
+    printf("%-24s %8.2f MB/s %8.0f shaders/s  (%zu shaders, %.3f ms, %.3f ms once for the builtins)\n",
+        "parse-builtins", bytes / best / (1024.0 * 1024.0), shaders.size() / best, shaders.size(), best * 1e3, builtinSeconds * 1e3);
+}
+
+struct benchmark {
+    const char *name;
+    void (*run)();
+};
+
+static const benchmark kBenchmarks[] = {
+    { "lex-identifiers", lexIdentifiers },
+    { "lex-whitespace", lexWhitespace },
+    { "lex-literals", lexLiterals },
+    { "lex-operators", lexOperators },
+    { "relex-edits", relexEdits },
+    { "load-tokens", loadTokens },
+    { "parse-functions", parseFunctions },
+    { "compact-ast", compactAst },
+    { "load-image", loadImage },
+    { "parse-shared", parseShared },
+    { "parse-globals", parseGlobals },
+    { "parse-structs", parseStructs },
+    { "parse-reset", parseReset },
+    { "parse-builtins", parseBuiltins }
+};
+
+int main(int argc, char **argv) {
+    const double start = now();
+    builtinTable::instance();
+    builtinSeconds = now() - start;
+
+    const size_t count = sizeof kBenchmarks / sizeof *kBenchmarks;
+    if (argc == 1) {
+        for (size_t i = 0; i < count; i++)
+            kBenchmarks[i].run();
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        size_t j = 0;
+        for (; j < count; j++) {
+            if (!strcmp(argv[i], kBenchmarks[j].name))
+                break;
+        }
+        if (j == count) {
+            fprintf(stderr, "unknown benchmark: `%s'\n", argv[i]);
+            return 1;
+        }
+        kBenchmarks[j].run();
+    }
+    return 0;
+}
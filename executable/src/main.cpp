@@ -12,8 +12,38 @@ struct sourceFile {
     int shaderType;
 };
 
+static void printKind(const char *name, const astStats::kind &kind) {
+    if (kind.count)
+        fprintf(stderr, "  %-24s %8zu %10zu bytes\n", name, kind.count, kind.bytes);
+}
+
+// Where the memory of a parse went, on stderr so the output stays the shader
+static void printStats(const char *fileName, const astStats &stats) {
+    fprintf(stderr, "%s:\n", fileName);
+    for (size_t i = 0; i < sizeof stats.expressions / sizeof *stats.expressions; i++)
+        printKind(astStats::expressionName(i), stats.expressions[i]);
+    for (size_t i = 0; i < sizeof stats.statements / sizeof *stats.statements; i++)
+        printKind(astStats::statementName(i), stats.statements[i]);
+    for (size_t i = 0; i < sizeof stats.variables / sizeof *stats.variables; i++)
+        printKind(astStats::variableName(i), stats.variables[i]);
+    printKind("type", stats.types);
+    printKind("function", stats.functions);
+    printKind("layout qualifier", stats.layoutQualifiers);
+    printKind("directive", stats.directives);
+    printKind("child list", stats.lists);
+    fprintf(stderr, "  %-24s %19zu bytes\n", "child list slack", stats.listSlack);
+    fprintf(stderr, "  %-24s %19zu bytes\n", "nodes", stats.nodeBytes);
+    fprintf(stderr, "  %-24s %19zu bytes (%zu peak, %zu reserved)\n", "arena", stats.arenaBytes, stats.arenaPeak, stats.arenaReserved);
+    fprintf(stderr, "  %-24s %19zu bytes (%zu reserved)\n", "names", stats.nameBytes, stats.nameReserved);
+    fprintf(stderr, "  %-24s %19zu bytes\n", "errors", stats.errorBytes);
+    fprintf(stderr, "  %-24s %8zu %10zu bytes\n", "tokens", stats.tokens, stats.lexerBytes);
+    printKind("value type", stats.valueTypes);
+    fprintf(stderr, "  %-24s %19zu bytes\n", "vector slack", stats.vectorSlack);
+}
+
 int main(int argc, char **argv) {
     int shaderType = -1;
+    bool stats = false;
     vector<sourceFile> sources;
     while (argc > 1) {
         ++argv;
@@ -32,6 +62,8 @@ int main(int argc, char **argv) {
                 shaderType = astTU::kGeometry;
             else if (!strcmp(what, "f"))
                 shaderType = astTU::kFragment;
+            else if (!strcmp(what, "stats"))
+                stats = true;
             else {
                 fprintf(stderr, "unknown option: `%s'\n", argv[0]);
                 return 1;
@@ -78,9 +110,10 @@ int main(int argc, char **argv) {
                 contents.insert(contents.end(), buffer, buffer + c);
             }
         }
-        contents.push_back('\0');
-        parser p(&contents[0], sources[i].fileName);
+        parser p(contents.empty() ? "" : &contents[0], contents.size(), sources[i].fileName);
         astTU *tu = p.parse(sources[i].shaderType);
+        if (stats)
+            printStats(sources[i].fileName, p.stats());
         if (tu) {
             // printTU(tu);
             printf("%s", converter().convertTU(tu));
@@ -34,7 +34,7 @@ static void printBuiltin(astBuiltin *builtin) {
 }
 
 static void printType(astType *type) {
-    if (type->builtin)
+    if (type->kind == astType::kBuiltin)
         printBuiltin((astBuiltin*)type);
     else
         print("%s", ((astStruct*)type)->name);
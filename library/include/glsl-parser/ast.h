@@ -1,37 +1,151 @@
 #ifndef AST_HDR
 #define AST_HDR
-#include <stdlib.h> // free, malloc, size_t
+#include <stdlib.h> // size_t
 #include "util.h"
 
 namespace glsl {
 
-// Type-erasure
-template <typename T>
-static inline void astDestroy(void *self) {
-    ((T*)self)->~T();
-    free(self);
+// Nodes are placed one after another in chunks of memory which are only
+// ever freed whole, nothing placed in them is destroyed
+struct astArena {
+    astArena(const allocator *memory = 0);
+    ~astArena();
+
+    void *allocate(size_t size); // Never 0, see allocator
+    // Takes back what was placed last, false when data is not that
+    bool release(void *data, size_t size);
+    // Everything placed so far is gone, the chunks are kept to place more
+    void reset();
+
+    size_t allocations() const; // Nodes, child lists and names placed since the last reset
+    size_t chunks() const; // Allocations made to place them
+    size_t bytes() const; // Bytes placed since the last reset, padding included
+    size_t peak() const; // Most bytes placed at once
+    size_t reserved() const; // Bytes of the chunks held, spare ones included
+
+    static size_t placed(size_t size); // Bytes placing size takes
+
+    struct chunk {
+        chunk *next;
+        size_t capacity;
+    };
+
+private:
+    astArena(const astArena&);
+    astArena &operator=(const astArena&);
+
+    const allocator *m_memory;
+    chunk *m_chunks;
+    chunk *m_spare; // Chunks kept by reset()
+    unsigned char *m_cursor;
+    unsigned char *m_end;
+    size_t m_chunkSize;
+    size_t m_allocations;
+    size_t m_chunkCount;
+    size_t m_bytes;
+    size_t m_peak; // Before the last reset
+};
+
+inline size_t astArena::allocations() const {
+    return m_allocations;
 }
 
-struct astMemory {
-    astMemory() : data(0), dtor(0) { }
-    template <typename T>
-    astMemory(T *data) : data((void*)data), dtor(&astDestroy<T>) { }
-    void *data;
-    void (*dtor)(void*);
-    void destroy() {
-        dtor(data);
-    }
+inline size_t astArena::chunks() const {
+    return m_chunkCount;
+}
+
+inline size_t astArena::bytes() const {
+    return m_bytes;
+}
+
+inline size_t astArena::peak() const {
+    return m_bytes > m_peak ? m_bytes : m_peak;
+}
+
+// The first N elements of a child list are kept in the node itself
+template <typename T, size_t N>
+struct astInline {
+    T *inlineData() { return m_inline; }
+    T m_inline[N];
 };
 
+template <typename T>
+struct astInline<T, 0> {
+    T *inlineData() { return 0; }
+};
+
+// Child lists of nodes, kept in the arena along with them. Growing leaves
+// the old elements behind in the arena.
+template <typename T, size_t N = 0>
+struct astArray : astInline<T, N> {
+    astArray() : m_data(this->inlineData()), m_size(0), m_capacity(N) { }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const T& operator[](size_t index) const { return m_data[index]; }
+    T& operator[](size_t index) { return m_data[index]; }
+    T* begin() { return m_data; }
+    T* end() { return m_data + m_size; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+    T &front() { return *begin(); }
+    const T &front() const { return *begin(); }
+    T &back() { return *(end() - 1); }
+    const T& back() const { return *(end() - 1); }
+    void pop_back() { m_size--; }
+    size_t capacity() const { return m_capacity; } // More than N once grown into the arena
+    void push_back(astArena *arena, const T &value);
+    void assign(astArena *arena, const T *first, const T *last);
+    // Gives storage grown into the arena back when it was placed last
+    bool release(astArena *arena);
+private:
+    // Would point into the inline elements of another
+    astArray(const astArray&);
+    astArray &operator=(const astArray&);
+    void reserve(astArena *arena, size_t capacity);
+    T *m_data;
+    size_t m_size;
+    size_t m_capacity;
+};
+
+template <typename T, size_t N>
+inline void astArray<T, N>::reserve(astArena *arena, size_t capacity) {
+    if (capacity <= m_capacity)
+        return;
+    T *data = (T*)arena->allocate(capacity * sizeof(T));
+    if (m_size)
+        memcpy(data, m_data, m_size * sizeof(T));
+    m_data = data;
+    m_capacity = capacity;
+}
+
+template <typename T, size_t N>
+inline void astArray<T, N>::push_back(astArena *arena, const T &value) {
+    if (m_size == m_capacity)
+        reserve(arena, m_capacity ? m_capacity * 2 : 4);
+    m_data[m_size++] = value;
+}
+
+template <typename T, size_t N>
+inline bool astArray<T, N>::release(astArena *arena) {
+    return m_capacity <= N || arena->release(m_data, m_capacity * sizeof(T));
+}
+
+template <typename T, size_t N>
+inline void astArray<T, N>::assign(astArena *arena, const T *first, const T *last) {
+    m_size = 0;
+    reserve(arena, size_t(last - first));
+    for (; first != last; ++first)
+        m_data[m_size++] = *first;
+}
+
 // Nodes are to inherit from astNode or astCollector
 template <typename T>
 struct astNode {
-    void *operator new(size_t size, vector<astMemory> *collector) throw() {
-        void *data = malloc(size);
-        if (data)
-            collector->push_back(astMemory((T*)data));
-        return data;
+    void *operator new(size_t size, astArena *arena) throw() {
+        return arena->allocate(size);
     }
+    // Only called when a constructor throws, the arena still owns the memory
+    void operator delete(void *, astArena *) { }
 private:
     void *operator new(size_t);
     void operator delete(void *);
@@ -50,8 +164,35 @@ struct astVersionDirective;
 struct astExtensionDirective;
 struct astVariable;
 
+typedef astExpression astConstantExpression;
+
+// The type of the value of an expression. A builtin type of numbers has the
+// shape of its scalars in columns and rows, a vector being one column. An
+// array has the sizes of the declaration it comes from, the outermost first,
+// less those subscripted away.
+struct astValueType {
+    // The first value types of every translation unit, those of constants
+    enum {
+        kUnknown, // Of what could not be resolved, all of it 0
+        kInt,
+        kUInt,
+        kFloat,
+        kDouble,
+        kBool
+    };
+    astType *type; // mat2 rather than mat2x2, and so on, for square matrices
+    astConstantExpression *const *arraySizes;
+    unsigned arrayDimensions; // 0 when not an array
+    int scalar; // kKeyword_bool, int, uint, float or double, -1 when not a number
+    unsigned char columns; // 1 for scalars and vectors
+    unsigned char rows; // Components of a vector, 1 for scalars
+};
+
+// Names in the AST are interned by the parser which made it, the same name
+// is always the same pointer
 struct astTU {
-    astTU(int type);
+    astTU(int type, const allocator *memory = 0);
+    void clear(int type); // Empty for another parse, keeping the capacity
 
     enum {
         kCompute,
@@ -70,6 +211,7 @@ struct astTU {
     vector<astGlobalVariable*> globals;
     vector<astStruct*> structures;
     vector<astInterfaceBlock*> interfaceBlocks;
+    vector<astValueType> valueTypes; // By astExpression::valueType, each once
 
 private:
     astTU(const astTU&);
@@ -77,8 +219,14 @@ private:
 };
 
 struct astType : astNode<astType> {
-    astType(bool builtin);
-    bool builtin;
+    enum {
+        kBuiltin,
+        kStruct,
+        kInterfaceBlock,
+        kDirective // The version and extension directives, which are not types
+    };
+    astType(int kind);
+    int kind; // What it is, to cast it to
 };
 
 struct astBuiltin : astType {
@@ -88,15 +236,15 @@ struct astBuiltin : astType {
 
 struct astStruct : astType {
     astStruct();
-    char *name;
-    vector<astVariable*> fields;
+    const char *name;
+    astArray<astVariable*> fields;
 };
 
 struct astInterfaceBlock : astType {
     astInterfaceBlock();
-    char *name;
+    const char *name;
     int storage; // one of the storage qualifiers: kIn, kOut, kUniform, kBuffer
-    vector<astVariable*> fields;
+    astArray<astVariable*> fields;
 };
 
 struct astVersionDirective : astType {
@@ -107,12 +255,10 @@ struct astVersionDirective : astType {
 
 struct astExtensionDirective : astType {
     astExtensionDirective();
-    char *name;
+    const char *name;
     int behavior;
 };
 
-typedef astExpression astConstantExpression;
-
 enum {
     kHighp,
     kMediump,
@@ -127,12 +273,12 @@ struct astVariable : astNode<astVariable> {
         kField
     };
     astVariable(int type);
-    char *name;
+    const char *name;
     astType *baseType;
     bool isArray;
     bool isPrecise;
     int type;
-    vector<astConstantExpression *> arraySizes;
+    astArray<astConstantExpression *, 1> arraySizes;
 };
 
 struct astFunctionVariable : astVariable {
@@ -193,22 +339,23 @@ struct astGlobalVariable : astVariable {
     int interpolation;
     bool isInvariant;
     astConstantExpression *initialValue;
-    vector<astLayoutQualifier*> layoutQualifiers;
+    astArray<astLayoutQualifier*, 2> layoutQualifiers;
 };
 
 struct astLayoutQualifier : astNode<astLayoutQualifier> {
     astLayoutQualifier();
-    char *name;
+    const char *name;
     astConstantExpression *initialValue;
 };
 
 struct astFunction : astNode<astFunction> {
     astFunction();
     astType *returnType;
-    char *name;
-    vector<astFunctionParameter*> parameters;
-    vector<astStatement*> statements;
+    const char *name;
+    astArray<astFunctionParameter*> parameters;
+    astArray<astStatement*> statements;
     bool isPrototype;
+    bool isPure; // Known to have no side effects, which only builtins are
 };
 
 struct astDeclaration : astNode<astDeclaration> {
@@ -244,7 +391,7 @@ struct astSimpleStatement : astStatement {
 
 struct astCompoundStatement : astStatement {
     astCompoundStatement();
-    vector<astStatement*> statements;
+    astArray<astStatement*> statements;
 };
 
 struct astEmptyStatement : astSimpleStatement {
@@ -253,7 +400,7 @@ struct astEmptyStatement : astSimpleStatement {
 
 struct astDeclarationStatement : astSimpleStatement {
     astDeclarationStatement();
-    vector<astFunctionVariable*> variables;
+    astArray<astFunctionVariable*> variables;
 };
 
 struct astExpressionStatement : astSimpleStatement {
@@ -271,7 +418,7 @@ struct astIfStatement : astSimpleStatement {
 struct astSwitchStatement : astSimpleStatement {
     astSwitchStatement();
     astExpression *expression;
-    vector<astStatement*> statements;
+    astArray<astStatement*> statements;
 };
 
 struct astCaseLabelStatement : astSimpleStatement {
@@ -353,6 +500,8 @@ struct astExpression : astNode<astExpression> {
         kTernary
     };
     int type;
+    unsigned valueType; // Into astTU::valueTypes, set by the parser as it is made
+    size_t nodeSize() const; // sizeof the node this is
 };
 
 struct astIntConstant : astExpression {
@@ -388,7 +537,7 @@ struct astVariableIdentifier : astExpression {
 struct astFieldOrSwizzle : astExpression {
     astFieldOrSwizzle();
     astExpression *operand;
-    char *name;
+    const char *name;
 };
 
 struct astArraySubscript : astExpression {
@@ -399,14 +548,15 @@ struct astArraySubscript : astExpression {
 
 struct astFunctionCall : astExpression {
     astFunctionCall();
-    char *name;
-    vector<astExpression*> parameters;
+    const char *name;
+    astArray<astExpression*, 4> parameters;
+    astFunction *function; // The overload called, 0 when it can't be told
 };
 
 struct astConstructorCall : astExpression {
     astConstructorCall();
     astType *type;
-    vector<astExpression*> parameters;
+    astArray<astExpression*, 4> parameters;
 };
 
 struct astUnaryExpression : astExpression {
@@ -475,6 +625,47 @@ struct astTernaryExpression : astExpression {
     astExpression *onFalse;
 };
 
+// Where the memory of an AST goes, filled in by parser::stats()
+struct astStats {
+    astStats();
+
+    struct kind {
+        size_t count;
+        size_t bytes;
+    };
+
+    // Counts the nodes reachable from tu. Expressions shared by more than
+    // one declaration, as array sizes on a type are, count for each, as do
+    // those shared by parser::shareExpressions.
+    void add(const astTU *tu);
+
+    static const char *expressionName(size_t type);
+    static const char *statementName(size_t type);
+    static const char *variableName(size_t type);
+
+    kind expressions[astExpression::kTernary + 1]; // By astExpression::type
+    kind statements[astStatement::kDiscard + 1]; // By astStatement::type
+    kind variables[astVariable::kField + 1]; // By astVariable::type
+    kind types; // Builtins, structures and interface blocks
+    kind functions;
+    kind layoutQualifiers;
+    kind directives;
+    kind lists; // Child lists grown out of their nodes into the arena
+    size_t listSlack; // Bytes of those not holding an element
+    size_t nodeBytes; // All of the above
+
+    size_t arenaBytes; // Placed, the part over nodeBytes is no longer in the AST
+    size_t arenaPeak;
+    size_t arenaReserved;
+    size_t nameBytes; // Interned names
+    size_t nameReserved;
+    size_t errorBytes; // Error messages
+    size_t tokens;
+    size_t lexerBytes; // Token arrays and line starts
+    kind valueTypes; // Of the expressions, by astTU::valueTypes
+    size_t vectorSlack; // Bytes of the parser's and lexer's vectors not holding an element
+};
+
 }
 
 #endif
@@ -0,0 +1,70 @@
+#ifndef BUILTINS_HDR
+#define BUILTINS_HDR
+#include "parser.h"
+
+namespace glsl {
+
+// The builtin variables and functions of every version and stage. They are
+// parsed once per process, with malloc, when the first parser is made, and
+// are not changed after that. Parsers on any thread find names in the table
+// and refer to its nodes without copying them.
+struct builtinTable {
+    static const builtinTable &instance();
+
+    struct declaration {
+        astVariable *variable; // One of the two, the other is 0
+        astFunction *function;
+        const declaration *next; // Of the same name
+        unsigned stages; // 1 << astTU::k* for each it is in
+        int version; // The first it is in
+        int removed; // From the core profile, 0 when it never was
+
+        // Of a #version directive, profile being kCore, kCompatibility or kES
+        bool in(int shaderType, int version, int profile) const;
+    };
+
+    const interner &names() const; // Parsers intern on top of these
+    astBuiltin *type(int keyword) const; // The one node of each builtin type
+    astType *namedType(unsigned id) const; // A structure or interface block, by interner::id of the name
+    const declaration *find(unsigned id) const; // By interner::id of the name
+    const char *error() const; // Why there are no builtins, 0 when there are
+
+private:
+    builtinTable();
+    builtinTable(const builtinTable&);
+    builtinTable &operator=(const builtinTable&);
+
+    parser m_parser; // The nodes are in its arena and the names its atoms
+    vector<char> m_source;
+    vector<declaration> m_declarations;
+    vector<const declaration*> m_byName; // By interner::id, the first declared
+    vector<astBuiltin*> m_types; // By kKeyword_*
+    const char *m_error;
+};
+
+inline const interner &builtinTable::names() const {
+    return m_parser.m_names;
+}
+
+inline astBuiltin *builtinTable::type(int keyword) const {
+    return size_t(keyword) < m_types.size() ? m_types[keyword] : 0;
+}
+
+inline astType *builtinTable::namedType(unsigned id) const {
+    if (id >= m_parser.m_typeNames.size())
+        return 0;
+    const parser::typeName &entry = m_parser.m_typeNames[id];
+    return entry.structure ? (astType*)entry.structure : (astType*)entry.interfaceBlock;
+}
+
+inline const builtinTable::declaration *builtinTable::find(unsigned id) const {
+    return id < m_byName.size() ? m_byName[id] : 0;
+}
+
+inline const char *builtinTable::error() const {
+    return m_error;
+}
+
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef COMPACT_HDR
+#define COMPACT_HDR
+#include "ast.h"
+
+namespace glsl {
+
+// A compact copy of an AST. Nodes are kept in a pool for each kind and refer
+// to each other by 32-bit index into those, 0 being no node. Child lists are
+// ranges of one shared children array and names are offsets into one array
+// of characters, so there are no pointers in it.
+
+struct compactRange {
+    unsigned start; // Index into compactTU::children
+    unsigned count;
+};
+
+struct compactType {
+    enum {
+        kBuiltin,
+        kStruct,
+        kInterfaceBlock
+    };
+    int kind;
+    int keyword; // kBuiltin: kKeyword_*
+    unsigned name;
+    int storage; // kInterfaceBlock
+    compactRange fields; // variables
+};
+
+struct compactVariable {
+    int type; // astVariable::k*
+    unsigned name;
+    unsigned baseType; // types
+    unsigned initialValue; // expressions, function variables and globals
+    compactRange arraySizes; // expressions
+    compactRange layoutQualifiers; // globals
+    signed char storage; // parameters and globals
+    signed char auxiliary;
+    signed char precision;
+    signed char interpolation; // globals
+    unsigned char memory;
+    bool isArray;
+    bool isPrecise;
+    bool isConst; // function variables
+    bool isInvariant; // globals
+};
+
+struct compactLayoutQualifier {
+    unsigned name;
+    unsigned initialValue; // expressions
+};
+
+struct compactFunction {
+    unsigned returnType; // types
+    unsigned name;
+    compactRange parameters; // variables
+    compactRange statements;
+    bool isPrototype;
+};
+
+struct compactExtension {
+    unsigned name;
+    int behavior;
+};
+
+// Everything but the type refers to expressions unless noted
+struct compactExpression {
+    int type; // astExpression::k*
+    union {
+        int asInt;
+        unsigned asUInt;
+        float asFloat;
+        unsigned asDouble[2]; // Read with doubleValue()
+        bool asBool;
+        unsigned asVariable; // variables
+        struct {
+            unsigned operand;
+            unsigned name;
+        } asFieldOrSwizzle;
+        struct {
+            unsigned operand;
+            unsigned index;
+        } asArraySubscript;
+        struct {
+            unsigned name;
+            compactRange parameters;
+        } asFunctionCall;
+        struct {
+            unsigned type; // types
+            compactRange parameters;
+        } asConstructorCall;
+        unsigned asUnary; // The operand
+        struct {
+            unsigned operand1;
+            unsigned operand2;
+            int operation; // kOperator_*, also for assignments
+        } asBinary;
+        struct {
+            unsigned condition;
+            unsigned onTrue;
+            unsigned onFalse;
+        } asTernary;
+    };
+    double doubleValue() const;
+};
+
+// Everything refers to statements unless noted
+struct compactStatement {
+    int type; // astStatement::k*
+    union {
+        compactRange asCompound;
+        compactRange asDeclaration; // variables
+        unsigned asExpression; // expressions
+        struct {
+            unsigned condition; // expressions
+            unsigned thenStatement;
+            unsigned elseStatement;
+        } asIf;
+        struct {
+            unsigned expression; // expressions
+            compactRange statements;
+        } asSwitch;
+        struct {
+            unsigned condition; // expressions
+            bool isDefault;
+        } asCaseLabel;
+        struct {
+            unsigned condition; // An expression or declaration statement
+            unsigned body;
+        } asWhile;
+        struct {
+            unsigned body;
+            unsigned condition; // expressions
+        } asDo;
+        struct {
+            unsigned init; // An expression or declaration statement
+            unsigned condition; // expressions
+            unsigned loop; // expressions
+            unsigned body;
+        } asFor;
+        unsigned asReturn; // expressions
+    };
+};
+
+// Nodes of one kind, held by a compactTU or in an image of one
+template <typename T>
+struct compactPool {
+    compactPool() : data(0), count(0) { }
+    const T &operator[](size_t index) const { return data[index]; }
+    size_t size() const { return count; }
+    const T *data;
+    size_t count;
+};
+
+struct compactTU {
+    compactTU(const allocator *memory = 0);
+
+    // Replaces what is held with a copy of tu
+    void build(const astTU *tu);
+
+    // An image of the pools, with nothing in it but indices and offsets, so
+    // it can be written to a file and mapped by another process
+    bool save(vector<unsigned char> &image) const; // After build() or load()
+    // Reads the pools from an image in place instead, so it must outlive this,
+    // e.g. a mapped file. False, leaving this as it was, when the image is
+    // stale or damaged: every node is checked to refer only to what is in it.
+    bool load(const void *image, size_t size);
+
+    size_t bytes() const; // Memory of the pools, the image's when loaded
+
+    const compactType &type(unsigned index) const;
+    const compactVariable &variable(unsigned index) const;
+    const compactLayoutQualifier &layoutQualifier(unsigned index) const;
+    const compactFunction &function(unsigned index) const;
+    const compactExtension &extension(unsigned index) const;
+    const compactExpression &expression(unsigned index) const;
+    const compactStatement &statement(unsigned index) const;
+    unsigned child(const compactRange &range, size_t index) const;
+    const char *name(unsigned offset) const;
+
+    int shaderType; // astTU::k*
+    int version; // -1 without a #version
+    int profile;
+    compactRange extensions;
+    compactRange structures; // types
+    compactRange interfaceBlocks; // types
+    compactRange globals; // variables
+    compactRange functions;
+
+    compactPool<compactType> types;
+    compactPool<compactVariable> variables;
+    compactPool<compactLayoutQualifier> layoutQualifiers;
+    compactPool<compactFunction> functionPool;
+    compactPool<compactExtension> extensionPool;
+    compactPool<compactExpression> expressions;
+    compactPool<compactStatement> statements;
+    compactPool<unsigned> children;
+    compactPool<char> names; // NUL terminated, the first is empty
+
+private:
+    friend struct compactBuilder;
+    compactTU(const compactTU &);
+    compactTU &operator=(const compactTU &);
+    void point(); // The pools at what is held
+
+    vector<compactType> m_types;
+    vector<compactVariable> m_variables;
+    vector<compactLayoutQualifier> m_layoutQualifiers;
+    vector<compactFunction> m_functionPool;
+    vector<compactExtension> m_extensionPool;
+    vector<compactExpression> m_expressions;
+    vector<compactStatement> m_statements;
+    vector<unsigned> m_children;
+    vector<char> m_names;
+};
+
+inline const compactType &compactTU::type(unsigned index) const {
+    return types[index];
+}
+
+inline const compactVariable &compactTU::variable(unsigned index) const {
+    return variables[index];
+}
+
+inline const compactLayoutQualifier &compactTU::layoutQualifier(unsigned index) const {
+    return layoutQualifiers[index];
+}
+
+inline const compactFunction &compactTU::function(unsigned index) const {
+    return functionPool[index];
+}
+
+inline const compactExtension &compactTU::extension(unsigned index) const {
+    return extensionPool[index];
+}
+
+inline const compactExpression &compactTU::expression(unsigned index) const {
+    return expressions[index];
+}
+
+inline const compactStatement &compactTU::statement(unsigned index) const {
+    return statements[index];
+}
+
+inline unsigned compactTU::child(const compactRange &range, size_t index) const {
+    return children[range.start + index];
+}
+
+inline const char *compactTU::name(unsigned offset) const {
+    return &names[offset];
+}
+
+}
+
+#endif
@@ -6,10 +6,13 @@
 
 namespace glsl {
 
+struct compactTU;
+
 struct converter {
-    converter();
+    converter(const allocator *memory = 0); // Where the text goes
 
     const char* convertTU(astTU*);
+    const char* convertTU(const compactTU*); // Prints the same as for the AST it was built from
 
 private:
     indent_aware_stringbuilder stringBuffer;
@@ -19,6 +22,12 @@ private:
     void visitInterfaceBlocks(astTU*);
     void visitGlobalVariables(astTU*);
     void visitFunctions(astTU*);
+
+    void visitPreprocessors(const compactTU*);
+    void visitStructures(const compactTU*);
+    void visitInterfaceBlocks(const compactTU*);
+    void visitGlobalVariables(const compactTU*);
+    void visitFunctions(const compactTU*);
 };
 
 }
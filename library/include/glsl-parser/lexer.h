@@ -56,6 +56,14 @@ struct operatorInfo {
     const char *name;
     const char *string;
     int precedence;
+    size_t length;
+};
+
+// A range of characters in the source. Identifiers refer back into the
+// source this way instead of owning a copy.
+struct span {
+    size_t offset;
+    size_t length;
 };
 
 struct directive {
@@ -72,13 +80,14 @@ struct directive {
             int type; // kCore, kCompatibility, kES
         } asVersion;
         struct {
-            char* name;
+            span name;
             int behavior; // kEnable, kRequire, kWarn, kDisable
         } asExtension;
     };
 };
 
 struct token {
+    int type() const;
     int precedence() const;
 
 private:
@@ -87,7 +96,7 @@ private:
     friend struct parser;
     int m_type;
     union {
-        char *asIdentifier;
+        span asIdentifier;
         directive asDirective;
         int asInt;
         int asKeyword;
@@ -98,63 +107,178 @@ private:
     };
 };
 
+// A whole translation unit lexed up front by lexer::tokenize(), kept as a
+// struct of arrays so walking it touches as little memory as possible.
+// Whitespace and comments are dropped and the last token is kType_eof,
+// unless lexing stopped at an error, which is then raised by the read after
+// the last token.
+struct tokenArray {
+    tokenArray(const allocator *memory = 0);
+
+    union value {
+        int asInt;
+        int asKeyword;
+        int asOperator;
+        unsigned asUnsigned;
+        float asFloat;
+        double asDouble;
+        struct {
+            unsigned length; // Starts at the token's offset in the source
+            unsigned text; // Offset into the strings of a token cache
+        } asIdentifier;
+        unsigned asDirective; // kType_directive, index into directives
+    };
+
+    size_t size() const;
+    void clear(); // Keeps the capacity
+
+    vector<unsigned char> types; // kType_*
+    vector<value> values;
+    vector<unsigned> offsets; // where in the source each token starts
+    vector<directive> directives;
+
+    const char *error; // lexer error following the last token, if any
+    size_t errorOffset;
+};
+
+inline size_t tokenArray::size() const {
+    return types.size();
+}
+
 struct location {
     location();
     size_t column;
     size_t line;
     size_t position;
-private:
-    friend struct lexer;
-    void advanceColumn(size_t count = 1);
-    void advanceLine();
 };
 
 struct lexer {
-    lexer(const char *data);
+    lexer(const char *data, const allocator *memory = 0);
+    // The source need not be NUL terminated
+    lexer(const char *data, size_t length, const allocator *memory = 0);
+
+    // Lex another source, keeping the capacity of the token arrays
+    void reset(const char *data, size_t length);
 
     token read();
     token peek();
 
     const char *error() const;
 
+    // Lex everything at once, after which read, peek, backup and restore
+    // only move an index into the token array. Lexer errors are held back
+    // until reading reaches them.
+    void tokenize();
+    const tokenArray &tokens() const;
+
+    // Bring the token array up to date after an edit which replaced removed
+    // bytes at offset with inserted bytes, giving data and length. Only the
+    // tokens around the edit are lexed again, and only those between it and
+    // the last edit are moved. The rest are brought up to date the next time
+    // the tokens are read.
+    void relex(const char *data, size_t length, size_t offset, size_t removed, size_t inserted);
+
+    // Token caches hold everything reading needs: the token arrays, where
+    // each token ends, the line starts and every identifier once. The source
+    // is not needed to load one. They are only valid with the lexemes.h and
+    // platform they were made with.
+    bool saveTokens(vector<unsigned char> &cache) const; // After tokenize()
+    // Use a cache instead of lexing. Identifiers are read from the cache in
+    // place, so it must outlive the lexer, e.g. a mapped file. False when the
+    // cache is stale or damaged.
+    bool loadTokens(const void *cache, size_t size);
+    bool tokenized() const;
+
     void backup();
     void restore();
 
     size_t line() const;
     size_t column() const;
 
+    // Line and column of a byte offset into the source
+    location locate(size_t position) const;
+
 protected:
     friend struct parser;
 
     size_t position() const;
+    size_t consumed() const; // Grows with every token read
 
     int at(int offset = 0) const;
+    const char *text(const span &what) const;
 
     void read(token &out);
     void read(token &out, bool);
 
     void skipWhitespace(bool allowNewlines = false);
+    bool readOperator(token &out);
+
+    span readWord();
+    bool matches(const span &word, const char *what) const;
+
+    void settle() const; // Closes the gap relex() leaves
+    void closeGap() const;
+    void moveGap(size_t to) const;
+    size_t offsetOf(size_t index) const;
+    size_t findToken(size_t offset) const;
+
+    void load(token &out, size_t index) const;
+    void store(tokenArray &tokens, const token &in, size_t offset);
+    location where() const;
 
-    vector<char> readNumeric(bool isOctal, bool isHex);
+    span readNumeric(bool isHex);
 
 private:
+    const allocator *m_memory;
     const char *m_data;
     size_t m_length;
     const char *m_error;
-    location m_location;
-    location m_backup;
+    size_t m_position;
+    size_t m_backup;
+    mutable vector<size_t> m_lineStarts; // Built on first use by locate()
+    // relex() leaves a gap of unused tokens where it last edited, so typing
+    // in one place moves nothing else. Those after the gap are still to be
+    // shifted by m_shift. Reading the tokens closes it first.
+    mutable tokenArray m_tokens;
+    mutable size_t m_gap;
+    mutable size_t m_gapSize;
+    mutable unsigned m_shift;
+    vector<unsigned> m_directiveTokens; // Index of the token of each directive
+    vector<unsigned> m_ends; // Where each token ends, only for token caches
+    size_t m_cursor; // next token to read from m_tokens
+    size_t m_backupCursor;
+    bool m_tokenized;
+    bool m_cached; // Tokens and m_data come from a token cache
 };
 
+inline int token::type() const {
+    return m_type;
+}
+
+inline const char *lexer::text(const span &what) const {
+    return m_data + what.offset;
+}
+
 inline size_t lexer::position() const {
-    return m_location.position;
+    return m_position;
+}
+
+inline size_t lexer::consumed() const {
+    return m_tokenized ? m_cursor : m_position;
+}
+
+inline void lexer::settle() const {
+    if (m_gapSize || m_shift)
+        closeGap();
 }
 
-inline size_t lexer::line() const {
-    return m_location.line;
+inline const tokenArray &lexer::tokens() const {
+    settle();
+    return m_tokens;
 }
 
-inline size_t lexer::column() const {
-    return m_location.column;
+inline bool lexer::tokenized() const {
+    return m_tokenized;
 }
 
 }
@@ -14,7 +14,7 @@ namespace glsl {
 #endif
 
 struct topLevel {
-    topLevel()
+    explicit topLevel(const allocator *allocations = 0)
         : storage(-1)
         , auxiliary(-1)
         , memory(0)
@@ -22,10 +22,13 @@ struct topLevel {
         , interpolation(-1)
         , type(0)
         , initialValue(0)
+        , arraySizes(allocations)
         , arrayOnTypeOffset(0)
+        , layoutQualifiers(allocations)
         , isInvariant(false)
         , isPrecise(false)
         , isArray(false)
+        , name(0)
     {
     }
 
@@ -42,18 +45,41 @@ struct topLevel {
     bool isInvariant;
     bool isPrecise;
     bool isArray;
-    char *name;
+    const char *name;
 };
 
+struct builtinTable;
+
 struct parser {
     ~parser();
-    parser(const char *source, const char *fileName);
+    // Everything the parser allocates comes from memory when given one
+    parser(const char *source, const char *fileName, const allocator *memory = 0);
+    parser(const char *source, size_t length, const char *fileName, const allocator *memory = 0);
     CHECK_RETURN astTU *parse(int type);
 
+    // Parse another source with this parser. The previous AST is gone but
+    // the memory it was in is kept to parse the next one.
+    void reset(const char *source, size_t length, const char *fileName);
+
+    // Parse from tokens saved by lexer::saveTokens instead of the source
+    CHECK_RETURN bool loadTokens(const void *cache, size_t size);
+
+    // Expressions which are the same are made one node, shared by all the
+    // places they appear, so they compare equal by pointer. Those with side
+    // effects are never shared: assignments, increments, decrements and calls
+    // of anything but pure builtins. Off by default, set it before parse().
+    void shareExpressions(bool enable);
+
     const char *error() const;
+    const astArena &memory() const;
+
+    // Where the memory of the last parse went. Walks the AST, nothing is
+    // counted while parsing.
+    astStats stats() const;
 
 protected:
     void cleanup();
+    void prepare();
 
     enum {
         kEndConditionSemicolon = 1 << 0,
@@ -102,6 +128,7 @@ protected:
     // Call parsers
     CHECK_RETURN astConstructorCall *parseConstructorCall();
     CHECK_RETURN astFunctionCall *parseFunctionCall();
+    CHECK_RETURN bool parseCallParameters(); // Onto m_operands
 
     // Expression parsers
     CHECK_RETURN astExpression *parseExpression(endCondition end);
@@ -127,31 +154,98 @@ protected:
     CHECK_RETURN astDoStatement *parseDoStatement();
     CHECK_RETURN astWhileStatement *parseWhileStatement();
 
-    astBinaryExpression *createExpression();
+    astBinaryExpression *createExpression(const token &operation);
+    astExpression *share(astExpression *expression); // Every expression made, it is typed here
+
+    // Value types are resolved from those of the children, so each node once
+    void prepareValueTypes();
+    unsigned resolveValueType(astExpression *expression);
+    unsigned operationValueType(int operation, astValueType lhs, astValueType rhs);
+    unsigned numericValueType(int scalar, int columns, int rows);
+    unsigned findValueType(astType *type, astConstantExpression *const *arraySizes, size_t dimensions);
 
-    astType *findType(const char *identifier);
-    astVariable *findVariable(const char *identifier);
-    astType* getType(astExpression *expression);
+    void backup();
+    void restore();
+
+    CHECK_RETURN bool defineStructure(astStruct *structure);
+    CHECK_RETURN bool defineInterfaceBlock(astInterfaceBlock *block);
+    astType *findType(const span &identifier); // Structures, block names are not types
+    astVariable *findVariable(const span &identifier);
+    astVariable *findVariable(const char *name); // Interned
+    void defineFunction(astFunction *function);
+    astFunction *findFunction(const char *name, astExpression *const *arguments, size_t count);
+    astBuiltin *findBuiltin(int keyword) const; // 0 when not parsed yet and not in the table
+    astBuiltin *builtinType(int keyword); // Found or made, never 0
+    astType* getType(astExpression *expression); // 0 when not known
+    astVariable *findField(astType *type, const char *name); // Of a structure or interface block
+
+    void pushScope();
+    void popScope(); // Forgets what was declared since the push
+    void declare(astVariable *variable); // In the innermost scope
 private:
-    typedef vector<astVariable *> scope;
+    friend struct builtinTable;
+
+    // The parser of the builtins themselves, it has none to look in
+    explicit parser(const builtinTable *builtins);
+
+    struct symbol {
+        astVariable *variable;
+        size_t scope; // Depth of the scope it was declared in
+    };
+
+    // Block names are kept so they are not taken by a structure
+    struct typeName {
+        astStruct *structure;
+        astInterfaceBlock *interfaceBlock;
+    };
+
+    // Functions of the same name are chained, the latest first
+    struct overload {
+        astFunction *function;
+        unsigned next; // Index into m_overloads plus one, 0 for the end
+    };
+
+    // A declaration hiding another, put back when its scope is popped
+    struct shadow {
+        unsigned id;
+        symbol hidden;
+    };
+
+    // The overloads of a call looked at so far
+    struct overloadMatch {
+        astFunction *fits; // Taking the types of the arguments
+        astFunction *counted; // Taking as many
+        size_t fitting;
+        size_t counting;
+    };
+
+    typeName &typeNameOf(const char *name);
+    void match(overloadMatch &match, astFunction *function, astExpression *const *arguments, size_t count);
 
     // Specialized in .cpp
     template<typename T>
     CHECK_RETURN T *parseBlock(const char* type);
 
     astTU *m_ast;
+    const allocator *m_allocator;
+    const builtinTable *m_builtinTable; // Looked in after what the shader declares
     lexer m_lexer;
     token m_token;
-    vector<scope> m_scopes;
+    token m_backup;
+    vector<symbol> m_symbols; // By interner::id of the name, what it refers to now
+    vector<shadow> m_shadows;
+    vector<size_t> m_scopes; // Where each scope starts in m_shadows
+    vector<typeName> m_typeNames; // By interner::id of the name
+    vector<unsigned> m_functionNames; // By interner::id, the first overload plus one
+    vector<overload> m_overloads;
     vector<astBuiltin*> m_builtins;
     char *m_error;
-    char *m_oom;
     const char *m_fileName;
 
     void strdel(char **what) {
         if (!*what)
             return;
-        free(*what);
+        memdel(m_allocator, *what);
         *what = 0;
     }
 
@@ -159,20 +253,36 @@ private:
         if (!what)
             return 0;
         size_t length = strlen(what) + 1;
-        char *copy = (char*)malloc(length);
-        memcpy(copy, what, length);
-        m_strings.push_back(copy);
+        char *copy = (char*)m_memory.allocate(length);
+        if (copy)
+            memcpy(copy, what, length);
         return copy;
     }
 
+    // Identifiers are only interned once they are stored in the AST
+    const char *intern(const span &what) {
+        return m_names.intern(m_lexer.text(what), what.length);
+    }
+
     bool strnil(const char *what) {
         return !what || !*what;
     }
 
-    vector<astMemory> m_memory; // Memory of AST held here
-    vector<char *> m_strings; // Memory of strings held here
+    astArena m_memory; // Memory of AST held here
+    interner m_names; // Every name in the AST, interned
+    const char *m_main;
+    vector<char *> m_strings; // Memory of error messages held here
+    vector<astExpression *> m_operands; // Of calls being parsed
+    vector<astExpression *> m_shared; // Open addressed, half full at most
+    vector<unsigned> m_valueTypes; // Open addressed indices into m_ast->valueTypes, 0 for none
+    size_t m_sharedCount;
+    bool m_share;
 };
 
+inline const astArena &parser::memory() const {
+    return m_memory;
+}
+
 }
 
 #endif
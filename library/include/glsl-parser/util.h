@@ -17,60 +17,187 @@ static inline I find(I first, I last, const T &value) {
     return last;
 }
 
+// Where the library gets memory from, for embedding it somewhere which keeps
+// track of that. Parsers and converters take one and everything they, their
+// lexer, arena, interner and vectors allocate goes through it. A null
+// allocator is malloc and free.
+//
+// Running out of memory is not recovered from. When allocate gives back 0
+// the library aborts, as std::vector does without exceptions, so a hook
+// wanting something else has to not return.
+struct allocator {
+    void *(*allocate)(void *user, size_t size);
+    void (*deallocate)(void *user, void *data);
+    void *user;
+};
+
+static inline void *memnew(const allocator *memory, size_t size) {
+    void *data = memory ? memory->allocate(memory->user, size) : malloc(size);
+    if (!data && size)
+        abort();
+    return data;
+}
+
+static inline void memdel(const allocator *memory, void *data) {
+    if (!data)
+        return;
+    if (memory)
+        memory->deallocate(memory->user, data);
+    else
+        free(data);
+}
+
 // An implementation of ntoa (number to ascii)
-// Remember to free the string!
+// Remember to free the string, with memdel when given an allocator!
 
 // ntoa("%d", 1); // integer
 template <typename T>
-static inline char* ntoa(const char* fmt, T x) {
+static inline char* ntoa(const char* fmt, T x, const allocator *memory = 0) {
     if (!strlen(fmt)) return nullptr;
 
     int length = snprintf(NULL, 0, fmt, x);
-    char* str = reinterpret_cast<char*>(malloc(length + 1));
+    char* str = reinterpret_cast<char*>(memnew(memory, length + 1));
     snprintf(str, length + 1, fmt, x);
     return str;
 }
 
 // An implementation of vasprintf
 int allocvfmt(char **str, const char *fmt, va_list vp);
+int allocvfmt(const allocator *memory, char **str, const char *fmt, va_list vp);
 
 // An implementation of vsprintf
 int allocfmt(char **str, const char *fmt, ...);
+int allocfmt(const allocator *memory, char **str, const char *fmt, ...);
+
+// Hands out the memory of a vector from an allocator
+template <typename T>
+struct vectorAllocator {
+    typedef T value_type;
+    vectorAllocator(const allocator *memory = 0) : memory(memory) { }
+    template <typename U>
+    vectorAllocator(const vectorAllocator<U> &other) : memory(other.memory) { }
+    T *allocate(size_t count) { return (T*)memnew(memory, count * sizeof(T)); }
+    void deallocate(T *data, size_t) { memdel(memory, data); }
+    const allocator *memory;
+};
+
+template <typename T, typename U>
+inline bool operator==(const vectorAllocator<T> &lhs, const vectorAllocator<U> &rhs) {
+    return lhs.memory == rhs.memory;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const vectorAllocator<T> &lhs, const vectorAllocator<U> &rhs) {
+    return lhs.memory != rhs.memory;
+}
 
 // a tiny wrapper around std::vector so you can provide your own
 template <typename T>
 struct vector {
+    vector() { }
+    explicit vector(const allocator *memory) : m_data(vectorAllocator<T>(memory)) { }
     size_t size() const { return m_data.size(); }
     bool empty() const { return m_data.empty(); }
     const T& operator[](size_t index) const { return m_data[index]; }
     T& operator[](size_t index) { return m_data[index]; }
-    T* begin() { return &m_data[0]; }
-    T* end() { return &m_data[size()]; }
-    const T* begin() const { return &m_data[0]; }
-    const T* end() const { return &m_data[size()]; }
+    // 0 when nothing was ever allocated, never an element past the end
+    T* begin() { return m_data.data(); }
+    T* end() { return m_data.data() + size(); }
+    const T* begin() const { return m_data.data(); }
+    const T* end() const { return m_data.data() + size(); }
     void insert(T *at, const T& value = T()) { m_data.insert(m_data.begin() + size_t(at - begin()), value); }
     void insert(T *at, const T *beg, const T *end) { m_data.insert(m_data.begin() + size_t(at - begin()), beg, end); }
     void push_back(const T &value) { m_data.push_back(value); }
     void reserve(size_t size) { m_data.reserve(size); }
-    T* erase(T *position) { return &*m_data.erase(m_data.begin() + size_t(position - begin())); }
-    T* erase(T *first, T *last) { return &*m_data.erase(m_data.begin() + size_t(first - begin()), m_data.begin() + size_t(last - begin())); }
+    T* erase(T *position) { return begin() + (m_data.erase(m_data.begin() + size_t(position - begin())) - m_data.begin()); }
+    T* erase(T *first, T *last) { return begin() + (m_data.erase(m_data.begin() + size_t(first - begin()), m_data.begin() + size_t(last - begin())) - m_data.begin()); }
     void pop_back() { m_data.pop_back(); }
     T &front() { return *begin(); }
     const T &front() const { return *begin(); }
     T &back() { return *(end() - 1); }
     const T& back() const { return *(end() - 1); }
     void resize(size_t size) { m_data.resize(size); }
+    void swap(vector &other) { m_data.swap(other.m_data); }
+    size_t capacity() const { return m_data.capacity(); }
+    const allocator *memory() const { return m_data.get_allocator().memory; }
 private:
-    std::vector<T> m_data;
+    std::vector<T, vectorAllocator<T> > m_data;
 };
 
+// Strings stored once each, so equal strings are the same pointer. The
+// strings returned are atoms: they stay put until clear() and know their
+// id, which counts up from 0 in the order they were interned.
+//
+// An interner can extend a parent which is not changed while it is used.
+// The atoms of the parent are found first and the ids of its own atoms
+// count up from where those of the parent end.
+struct interner {
+    interner(const allocator *memory = 0, const interner *parent = 0);
+    ~interner();
+
+    const char *intern(const char *text, size_t length);
+    const char *intern(const char *text);
+    const char *find(const char *text, size_t length) const; // 0 when not interned
+
+    static unsigned id(const char *atom);
+    static size_t length(const char *atom);
+
+    size_t size() const; // The atoms of the parent included
+    size_t bytes() const; // Held by its own atoms, their id and length included
+    size_t reserved() const; // Chunks, spare ones included, and slots
+    void clear(); // Keeps the memory for the next atoms
+
+private:
+    interner(const interner&);
+    interner &operator=(const interner&);
+
+    struct chunk {
+        chunk *next;
+        size_t capacity;
+    };
+
+    size_t slot(const char *text, size_t length, unsigned hash) const;
+    void grow();
+
+    const allocator *m_memory;
+    const interner *m_parent;
+    chunk *m_chunks;
+    chunk *m_spare;
+    char *m_cursor;
+    char *m_end;
+    vector<const char *> m_slots; // Open addressing, a power of two in size
+    size_t m_count;
+    size_t m_bytes;
+};
+
+// Every atom is preceded by its id and length
+inline unsigned interner::id(const char *atom) {
+    return ((const unsigned *)atom)[-2];
+}
+
+inline size_t interner::length(const char *atom) {
+    return ((const unsigned *)atom)[-1];
+}
+
+inline const char *interner::intern(const char *text) {
+    return intern(text, strlen(text));
+}
+
+inline size_t interner::size() const {
+    return (m_parent ? m_parent->size() : 0) + m_count;
+}
+
+inline size_t interner::bytes() const {
+    return m_bytes;
+}
+
 struct indent_aware_stringbuilder {
-    indent_aware_stringbuilder() : buffer(NULL), capacity(0), length(0), currentIndent(0), atLineStart(true) {
+    indent_aware_stringbuilder(const allocator *memory = 0) : memory(memory), buffer(NULL), capacity(0), length(0), indentStack(memory), currentIndent(0), atLineStart(true) {
         resize(16);
     }
     
     ~indent_aware_stringbuilder() {
-        delete[] buffer;
+        memdel(memory, buffer);
     }
     
     void pushIndent(int spaces = 4) {
@@ -135,7 +262,7 @@ struct indent_aware_stringbuilder {
     void clear() {
         length = 0;
         currentIndent = 0;
-        indentStack.clear();
+        indentStack.resize(0);
         atLineStart = true;
     }
 
@@ -145,19 +272,20 @@ struct indent_aware_stringbuilder {
     }
 
 private:
+    const allocator* memory;
     char* buffer;
     size_t capacity;
     size_t length;
     
-    std::vector<int> indentStack;
+    vector<int> indentStack;
     int currentIndent;
     bool atLineStart;
     
     void resize(size_t newCapacity) {
-        char* newBuffer = new char[newCapacity];
+        char* newBuffer = reinterpret_cast<char*>(memnew(memory, newCapacity));
         if (buffer) {
             std::memcpy(newBuffer, buffer, length);
-            delete[] buffer;
+            memdel(memory, buffer);
         }
         buffer = newBuffer;
         capacity = newCapacity;
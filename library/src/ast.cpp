@@ -1,66 +1,253 @@
+#include <string.h>    // memset
+#include <type_traits> // is_trivially_destructible
+
 #include "glsl-parser/ast.h"
 
 namespace glsl {
 
-const char *astStatement::name() const {
+// Every node holds at most doubles and pointers
+static const size_t kArenaAlignment = 8;
+static const size_t kArenaFirstChunk = 16 << 10;
+static const size_t kArenaLargestChunk = 1 << 20;
+
+astArena::astArena(const allocator *memory)
+    : m_memory(memory)
+    , m_chunks(0)
+    , m_spare(0)
+    , m_cursor(0)
+    , m_end(0)
+    , m_chunkSize(kArenaFirstChunk)
+    , m_allocations(0)
+    , m_chunkCount(0)
+    , m_bytes(0)
+    , m_peak(0)
+{
+}
+
+static void freeChunks(const allocator *memory, astArena::chunk *chunks) {
+    while (chunks) {
+        astArena::chunk *next = chunks->next;
+        memdel(memory, chunks);
+        chunks = next;
+    }
+}
+
+astArena::~astArena() {
+    freeChunks(m_memory, m_chunks);
+    freeChunks(m_memory, m_spare);
+}
+
+void astArena::reset() {
+    m_peak = peak();
+    // Oldest first, so they are used again in the order they filled up
+    while (m_chunks) {
+        chunk *next = m_chunks->next;
+        m_chunks->next = m_spare;
+        m_spare = m_chunks;
+        m_chunks = next;
+    }
+    m_cursor = 0;
+    m_end = 0;
+    m_allocations = 0;
+    m_chunkCount = 0;
+    m_bytes = 0;
+}
+
+size_t astArena::placed(size_t size) {
+    return (size + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+}
+
+size_t astArena::reserved() const {
+    size_t bytes = 0;
+    for (const chunk *it = m_chunks; it; it = it->next)
+        bytes += it->capacity;
+    for (const chunk *it = m_spare; it; it = it->next)
+        bytes += it->capacity;
+    return bytes;
+}
+
+bool astArena::release(void *data, size_t size) {
+    size = placed(size);
+    if ((unsigned char*)data + size != m_cursor)
+        return false;
+    m_cursor = (unsigned char*)data;
+    m_allocations--;
+    m_bytes -= size;
+    return true;
+}
+
+void *astArena::allocate(size_t size) {
+    size = placed(size);
+    if (size_t(m_end - m_cursor) < size) {
+        // The header is padded so what follows it stays aligned
+        const size_t header = (sizeof(chunk) + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+        chunk *next = m_spare;
+        if (next && next->capacity - header >= size) {
+            m_spare = next->next;
+        } else {
+            size_t capacity = m_chunkSize;
+            while (capacity - header < size)
+                capacity *= 2;
+            next = (chunk*)memnew(m_memory, capacity);
+            next->capacity = capacity;
+            m_chunkCount++;
+            if (m_chunkSize < kArenaLargestChunk)
+                m_chunkSize *= 2;
+        }
+        next->next = m_chunks;
+        m_chunks = next;
+        m_cursor = (unsigned char*)next + header;
+        m_end = (unsigned char*)next + next->capacity;
+    }
+    void *data = m_cursor;
+    m_cursor += size;
+    m_allocations++;
+    m_bytes += size;
+    return data;
+}
+
+// Nothing placed in the arena gets destroyed
+#define ASSERT_TRIVIAL(X) \
+    static_assert(std::is_trivially_destructible<X>::value, #X " is destroyed without its destructor")
+ASSERT_TRIVIAL(astType);
+ASSERT_TRIVIAL(astBuiltin);
+ASSERT_TRIVIAL(astStruct);
+ASSERT_TRIVIAL(astInterfaceBlock);
+ASSERT_TRIVIAL(astVersionDirective);
+ASSERT_TRIVIAL(astExtensionDirective);
+ASSERT_TRIVIAL(astVariable);
+ASSERT_TRIVIAL(astFunctionVariable);
+ASSERT_TRIVIAL(astFunctionParameter);
+ASSERT_TRIVIAL(astGlobalVariable);
+ASSERT_TRIVIAL(astLayoutQualifier);
+ASSERT_TRIVIAL(astFunction);
+ASSERT_TRIVIAL(astDeclaration);
+ASSERT_TRIVIAL(astStatement);
+ASSERT_TRIVIAL(astSimpleStatement);
+ASSERT_TRIVIAL(astCompoundStatement);
+ASSERT_TRIVIAL(astEmptyStatement);
+ASSERT_TRIVIAL(astDeclarationStatement);
+ASSERT_TRIVIAL(astExpressionStatement);
+ASSERT_TRIVIAL(astIfStatement);
+ASSERT_TRIVIAL(astSwitchStatement);
+ASSERT_TRIVIAL(astCaseLabelStatement);
+ASSERT_TRIVIAL(astIterationStatement);
+ASSERT_TRIVIAL(astWhileStatement);
+ASSERT_TRIVIAL(astDoStatement);
+ASSERT_TRIVIAL(astForStatement);
+ASSERT_TRIVIAL(astJumpStatement);
+ASSERT_TRIVIAL(astContinueStatement);
+ASSERT_TRIVIAL(astBreakStatement);
+ASSERT_TRIVIAL(astReturnStatement);
+ASSERT_TRIVIAL(astDiscardStatement);
+ASSERT_TRIVIAL(astExpression);
+ASSERT_TRIVIAL(astIntConstant);
+ASSERT_TRIVIAL(astUIntConstant);
+ASSERT_TRIVIAL(astFloatConstant);
+ASSERT_TRIVIAL(astDoubleConstant);
+ASSERT_TRIVIAL(astBoolConstant);
+ASSERT_TRIVIAL(astVariableIdentifier);
+ASSERT_TRIVIAL(astFieldOrSwizzle);
+ASSERT_TRIVIAL(astArraySubscript);
+ASSERT_TRIVIAL(astFunctionCall);
+ASSERT_TRIVIAL(astConstructorCall);
+ASSERT_TRIVIAL(astUnaryExpression);
+ASSERT_TRIVIAL(astBinaryExpression);
+ASSERT_TRIVIAL(astPostIncrementExpression);
+ASSERT_TRIVIAL(astPostDecrementExpression);
+ASSERT_TRIVIAL(astUnaryPlusExpression);
+ASSERT_TRIVIAL(astUnaryMinusExpression);
+ASSERT_TRIVIAL(astUnaryBitNotExpression);
+ASSERT_TRIVIAL(astUnaryLogicalNotExpression);
+ASSERT_TRIVIAL(astPrefixIncrementExpression);
+ASSERT_TRIVIAL(astPrefixDecrementExpression);
+ASSERT_TRIVIAL(astSequenceExpression);
+ASSERT_TRIVIAL(astAssignmentExpression);
+ASSERT_TRIVIAL(astOperationExpression);
+ASSERT_TRIVIAL(astTernaryExpression);
+#undef ASSERT_TRIVIAL
+
+static const char *statementTypeName(int type) {
     switch (type) {
-    case kCompound:     return "compound";
-    case kDeclaration:  return "declaration";
-    case kExpression:   return "expression";
-    case kIf:           return "if";
-    case kSwitch:       return "switch";
-    case kCaseLabel:    return "case label";
-    case kWhile:        return "while";
-    case kDo:           return "do";
-    case kFor:          return "for";
-    case kContinue:     return "continue";
-    case kBreak:        return "break";
-    case kReturn:       return "return";
-    case kDiscard:      return "discard";
+    case astStatement::kCompound:    return "compound";
+    case astStatement::kEmpty:       return "empty";
+    case astStatement::kDeclaration: return "declaration";
+    case astStatement::kExpression:  return "expression";
+    case astStatement::kIf:          return "if";
+    case astStatement::kSwitch:      return "switch";
+    case astStatement::kCaseLabel:   return "case label";
+    case astStatement::kWhile:       return "while";
+    case astStatement::kDo:          return "do";
+    case astStatement::kFor:         return "for";
+    case astStatement::kContinue:    return "continue";
+    case astStatement::kBreak:       return "break";
+    case astStatement::kReturn:      return "return";
+    case astStatement::kDiscard:     return "discard";
     }
     return "(unknown)";
 }
 
-astTU::astTU(int type)
+const char *astStatement::name() const {
+    return statementTypeName(type);
+}
+
+astTU::astTU(int type, const allocator *memory)
     : type(type)
     , versionDirective(0)
+    , extensionDirectives(memory)
+    , functions(memory)
+    , globals(memory)
+    , structures(memory)
+    , interfaceBlocks(memory)
+    , valueTypes(memory)
 {
 }
 
-astType::astType(bool builtin)
-    : builtin(builtin)
+void astTU::clear(int type) {
+    this->type = type;
+    versionDirective = 0;
+    extensionDirectives.resize(0);
+    functions.resize(0);
+    globals.resize(0);
+    structures.resize(0);
+    interfaceBlocks.resize(0);
+    valueTypes.resize(0);
+}
+
+astType::astType(int kind)
+    : kind(kind)
 {
 }
 
 astStruct::astStruct()
-    : astType(false)
+    : astType(kStruct)
     , name(0)
 {
 }
 
 astInterfaceBlock::astInterfaceBlock()
-    : astType(false)
+    : astType(kInterfaceBlock)
     , name(0)
     , storage(0)
 {
 }
 
 astExtensionDirective::astExtensionDirective()
-    : astType(false)
+    : astType(kDirective)
     , name(0)
     , behavior(-1)
 {
 }
 
 astVersionDirective::astVersionDirective()
-    : astType(false)
+    : astType(kDirective)
     , version(-1)
     , type(-1)
 {
 }
 
 astBuiltin::astBuiltin(int type)
-    : astType(true)
+    : astType(kBuiltin)
     , type(type)
 {
 }
@@ -132,6 +319,7 @@ astFunction::astFunction()
     : returnType(0)
     , name(0)
     , isPrototype(false)
+    , isPure(false)
 {
 }
 
@@ -228,6 +416,7 @@ astDiscardStatement::astDiscardStatement()
 
 astExpression::astExpression(int type)
     : type(type)
+    , valueType(astValueType::kUnknown)
 {
 }
 
@@ -284,6 +473,7 @@ astArraySubscript::astArraySubscript()
 astFunctionCall::astFunctionCall()
     : astExpression(astExpression::kFunctionCall)
     , name(0)
+    , function(0)
 {
 }
 
@@ -371,4 +561,268 @@ astTernaryExpression::astTernaryExpression()
 {
 }
 
+astStats::astStats() {
+    memset(this, 0, sizeof *this);
+}
+
+const char *astStats::expressionName(size_t type) {
+    switch (type) {
+    case astExpression::kIntConstant:        return "int constant";
+    case astExpression::kUIntConstant:       return "uint constant";
+    case astExpression::kFloatConstant:      return "float constant";
+    case astExpression::kDoubleConstant:     return "double constant";
+    case astExpression::kBoolConstant:       return "bool constant";
+    case astExpression::kVariableIdentifier: return "variable identifier";
+    case astExpression::kFieldOrSwizzle:     return "field or swizzle";
+    case astExpression::kArraySubscript:     return "array subscript";
+    case astExpression::kFunctionCall:       return "function call";
+    case astExpression::kConstructorCall:    return "constructor call";
+    case astExpression::kPostIncrement:      return "post increment";
+    case astExpression::kPostDecrement:      return "post decrement";
+    case astExpression::kUnaryMinus:         return "unary minus";
+    case astExpression::kUnaryPlus:          return "unary plus";
+    case astExpression::kBitNot:             return "bit not";
+    case astExpression::kLogicalNot:         return "logical not";
+    case astExpression::kPrefixIncrement:    return "prefix increment";
+    case astExpression::kPrefixDecrement:    return "prefix decrement";
+    case astExpression::kSequence:           return "sequence";
+    case astExpression::kAssign:             return "assign";
+    case astExpression::kOperation:          return "operation";
+    case astExpression::kTernary:            return "ternary";
+    }
+    return "(unknown)";
+}
+
+const char *astStats::statementName(size_t type) {
+    return statementTypeName(int(type));
+}
+
+const char *astStats::variableName(size_t type) {
+    switch (type) {
+    case astVariable::kFunction:  return "function variable";
+    case astVariable::kParameter: return "parameter";
+    case astVariable::kGlobal:    return "global";
+    case astVariable::kField:     return "field";
+    }
+    return "(unknown)";
+}
+
+size_t astExpression::nodeSize() const {
+    switch (type) {
+    case astExpression::kIntConstant:        return sizeof(astIntConstant);
+    case astExpression::kUIntConstant:       return sizeof(astUIntConstant);
+    case astExpression::kFloatConstant:      return sizeof(astFloatConstant);
+    case astExpression::kDoubleConstant:     return sizeof(astDoubleConstant);
+    case astExpression::kBoolConstant:       return sizeof(astBoolConstant);
+    case astExpression::kVariableIdentifier: return sizeof(astVariableIdentifier);
+    case astExpression::kFieldOrSwizzle:     return sizeof(astFieldOrSwizzle);
+    case astExpression::kArraySubscript:     return sizeof(astArraySubscript);
+    case astExpression::kFunctionCall:       return sizeof(astFunctionCall);
+    case astExpression::kConstructorCall:    return sizeof(astConstructorCall);
+    case astExpression::kSequence:           return sizeof(astSequenceExpression);
+    case astExpression::kAssign:             return sizeof(astAssignmentExpression);
+    case astExpression::kOperation:          return sizeof(astOperationExpression);
+    case astExpression::kTernary:            return sizeof(astTernaryExpression);
+    }
+    return sizeof(astUnaryExpression);
+}
+
+static size_t statementSize(int type) {
+    switch (type) {
+    case astStatement::kCompound:    return sizeof(astCompoundStatement);
+    case astStatement::kEmpty:       return sizeof(astEmptyStatement);
+    case astStatement::kDeclaration: return sizeof(astDeclarationStatement);
+    case astStatement::kExpression:  return sizeof(astExpressionStatement);
+    case astStatement::kIf:          return sizeof(astIfStatement);
+    case astStatement::kSwitch:      return sizeof(astSwitchStatement);
+    case astStatement::kCaseLabel:   return sizeof(astCaseLabelStatement);
+    case astStatement::kWhile:       return sizeof(astWhileStatement);
+    case astStatement::kDo:          return sizeof(astDoStatement);
+    case astStatement::kFor:         return sizeof(astForStatement);
+    case astStatement::kContinue:    return sizeof(astContinueStatement);
+    case astStatement::kBreak:       return sizeof(astBreakStatement);
+    case astStatement::kReturn:      return sizeof(astReturnStatement);
+    case astStatement::kDiscard:     return sizeof(astDiscardStatement);
+    }
+    return sizeof(astStatement);
+}
+
+static size_t variableSize(int type) {
+    switch (type) {
+    case astVariable::kFunction:  return sizeof(astFunctionVariable);
+    case astVariable::kParameter: return sizeof(astFunctionParameter);
+    case astVariable::kGlobal:    return sizeof(astGlobalVariable);
+    }
+    return sizeof(astVariable);
+}
+
+static void countNode(astStats &stats, astStats::kind &kind, size_t size) {
+    size = astArena::placed(size);
+    kind.count++;
+    kind.bytes += size;
+    stats.nodeBytes += size;
+}
+
+// Only the elements past the first N are in the arena
+template <typename T, size_t N>
+static void countList(astStats &stats, const astArray<T, N> &list) {
+    if (list.capacity() <= N)
+        return;
+    countNode(stats, stats.lists, list.capacity() * sizeof(T));
+    stats.listSlack += (list.capacity() - list.size()) * sizeof(T);
+}
+
+static void countExpression(astStats &stats, const astExpression *expression);
+static void countStatement(astStats &stats, const astStatement *statement);
+
+template <typename T, size_t N>
+static void countExpressions(astStats &stats, const astArray<T, N> &list) {
+    countList(stats, list);
+    for (size_t i = 0; i < list.size(); i++)
+        countExpression(stats, list[i]);
+}
+
+template <typename T, size_t N>
+static void countStatements(astStats &stats, const astArray<T, N> &list) {
+    countList(stats, list);
+    for (size_t i = 0; i < list.size(); i++)
+        countStatement(stats, list[i]);
+}
+
+static void countExpression(astStats &stats, const astExpression *expression) {
+    if (!expression)
+        return;
+    countNode(stats, stats.expressions[expression->type], expression->nodeSize());
+    switch (expression->type) {
+    case astExpression::kFieldOrSwizzle:
+        countExpression(stats, ((const astFieldOrSwizzle*)expression)->operand);
+        break;
+    case astExpression::kArraySubscript:
+        countExpression(stats, ((const astArraySubscript*)expression)->operand);
+        countExpression(stats, ((const astArraySubscript*)expression)->index);
+        break;
+    case astExpression::kFunctionCall:
+        countExpressions(stats, ((const astFunctionCall*)expression)->parameters);
+        break;
+    case astExpression::kConstructorCall:
+        countExpressions(stats, ((const astConstructorCall*)expression)->parameters);
+        break;
+    case astExpression::kPostIncrement:
+    case astExpression::kPostDecrement:
+    case astExpression::kUnaryMinus:
+    case astExpression::kUnaryPlus:
+    case astExpression::kBitNot:
+    case astExpression::kLogicalNot:
+    case astExpression::kPrefixIncrement:
+    case astExpression::kPrefixDecrement:
+        countExpression(stats, ((const astUnaryExpression*)expression)->operand);
+        break;
+    case astExpression::kSequence:
+    case astExpression::kAssign:
+    case astExpression::kOperation:
+        countExpression(stats, ((const astBinaryExpression*)expression)->operand1);
+        countExpression(stats, ((const astBinaryExpression*)expression)->operand2);
+        break;
+    case astExpression::kTernary:
+        countExpression(stats, ((const astTernaryExpression*)expression)->condition);
+        countExpression(stats, ((const astTernaryExpression*)expression)->onTrue);
+        countExpression(stats, ((const astTernaryExpression*)expression)->onFalse);
+        break;
+    }
+}
+
+static void countVariable(astStats &stats, const astVariable *variable) {
+    countNode(stats, stats.variables[variable->type], variableSize(variable->type));
+    countExpressions(stats, variable->arraySizes);
+    if (variable->type == astVariable::kFunction) {
+        countExpression(stats, ((const astFunctionVariable*)variable)->initialValue);
+    } else if (variable->type == astVariable::kGlobal) {
+        const astGlobalVariable *global = (const astGlobalVariable*)variable;
+        countExpression(stats, global->initialValue);
+        countList(stats, global->layoutQualifiers);
+        for (size_t i = 0; i < global->layoutQualifiers.size(); i++) {
+            countNode(stats, stats.layoutQualifiers, sizeof(astLayoutQualifier));
+            countExpression(stats, global->layoutQualifiers[i]->initialValue);
+        }
+    }
+}
+
+template <typename T, size_t N>
+static void countVariables(astStats &stats, const astArray<T, N> &list) {
+    countList(stats, list);
+    for (size_t i = 0; i < list.size(); i++)
+        countVariable(stats, list[i]);
+}
+
+static void countStatement(astStats &stats, const astStatement *statement) {
+    if (!statement)
+        return;
+    countNode(stats, stats.statements[statement->type], statementSize(statement->type));
+    switch (statement->type) {
+    case astStatement::kCompound:
+        countStatements(stats, ((const astCompoundStatement*)statement)->statements);
+        break;
+    case astStatement::kDeclaration:
+        countVariables(stats, ((const astDeclarationStatement*)statement)->variables);
+        break;
+    case astStatement::kExpression:
+        countExpression(stats, ((const astExpressionStatement*)statement)->expression);
+        break;
+    case astStatement::kIf:
+        countExpression(stats, ((const astIfStatement*)statement)->condition);
+        countStatement(stats, ((const astIfStatement*)statement)->thenStatement);
+        countStatement(stats, ((const astIfStatement*)statement)->elseStatement);
+        break;
+    case astStatement::kSwitch:
+        countExpression(stats, ((const astSwitchStatement*)statement)->expression);
+        countStatements(stats, ((const astSwitchStatement*)statement)->statements);
+        break;
+    case astStatement::kCaseLabel:
+        countExpression(stats, ((const astCaseLabelStatement*)statement)->condition);
+        break;
+    case astStatement::kWhile:
+        countStatement(stats, ((const astWhileStatement*)statement)->condition);
+        countStatement(stats, ((const astWhileStatement*)statement)->body);
+        break;
+    case astStatement::kDo:
+        countStatement(stats, ((const astDoStatement*)statement)->body);
+        countExpression(stats, ((const astDoStatement*)statement)->condition);
+        break;
+    case astStatement::kFor:
+        countStatement(stats, ((const astForStatement*)statement)->init);
+        countExpression(stats, ((const astForStatement*)statement)->condition);
+        countExpression(stats, ((const astForStatement*)statement)->loop);
+        countStatement(stats, ((const astForStatement*)statement)->body);
+        break;
+    case astStatement::kReturn:
+        countExpression(stats, ((const astReturnStatement*)statement)->expression);
+        break;
+    }
+}
+
+void astStats::add(const astTU *tu) {
+    valueTypes.count += tu->valueTypes.size();
+    valueTypes.bytes += tu->valueTypes.size() * sizeof(astValueType);
+    if (tu->versionDirective)
+        countNode(*this, directives, sizeof(astVersionDirective));
+    for (size_t i = 0; i < tu->extensionDirectives.size(); i++)
+        countNode(*this, directives, sizeof(astExtensionDirective));
+    for (size_t i = 0; i < tu->structures.size(); i++) {
+        countNode(*this, types, sizeof(astStruct));
+        countVariables(*this, tu->structures[i]->fields);
+    }
+    for (size_t i = 0; i < tu->interfaceBlocks.size(); i++) {
+        countNode(*this, types, sizeof(astInterfaceBlock));
+        countVariables(*this, tu->interfaceBlocks[i]->fields);
+    }
+    for (size_t i = 0; i < tu->globals.size(); i++)
+        countVariable(*this, tu->globals[i]);
+    for (size_t i = 0; i < tu->functions.size(); i++) {
+        const astFunction *function = tu->functions[i];
+        countNode(*this, functions, sizeof(astFunction));
+        countVariables(*this, function->parameters);
+        countStatements(*this, function->statements);
+    }
+}
+
 }
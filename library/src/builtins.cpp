@@ -0,0 +1,734 @@
+#include <string.h> // strchr, strstr, strncmp, strlen
+
+#include "glsl-parser/builtins.h"
+
+namespace glsl {
+
+enum {
+    kCS = 1 << astTU::kCompute,
+    kVS = 1 << astTU::kVertex,
+    kTCS = 1 << astTU::kTessControl,
+    kTES = 1 << astTU::kTessEvaluation,
+    kGS = 1 << astTU::kGeometry,
+    kFS = 1 << astTU::kFragment,
+    kGraphics = kVS | kTCS | kTES | kGS | kFS,
+    kAll = kCS | kGraphics
+};
+
+struct builtinSpec {
+    const char *declaration;
+    unsigned stages;
+    int version;
+    int removed;
+};
+
+// Placeholders in the declarations are made each of the types they stand
+// for, all of the same size in a declaration. Overloads taking a scalar for
+// a vector are only of the vectors, those of scalars being there already:
+//   $gen $genI $genU $genB $genD  float, int, uint, bool, double and their vectors
+//   $vec $ivec $uvec $bvec $dvec  the vectors only
+//   @                             nothing, i and u before vec4, a sampler or an image
+//
+// Parameters are not named. Nothing is declared with an unsized array or a
+// constructor for an initializer, gl_in, gl_out and gl_WorkGroupSize being
+// left out or declared as an input for it. All of them are parsed as one
+// shader, so the tessellation levels are declared without patch.
+static const builtinSpec kBuiltins[] = {
+    // Implementation-dependent constants, the minimums of the specification
+    { "const int gl_MaxVertexAttribs = 16;",                       kAll, 110, 0 },
+    { "const int gl_MaxVertexUniformComponents = 1024;",           kAll, 110, 0 },
+    { "const int gl_MaxVertexTextureImageUnits = 16;",             kAll, 110, 0 },
+    { "const int gl_MaxCombinedTextureImageUnits = 80;",           kAll, 110, 0 },
+    { "const int gl_MaxTextureImageUnits = 16;",                   kAll, 110, 0 },
+    { "const int gl_MaxFragmentUniformComponents = 1024;",         kAll, 110, 0 },
+    { "const int gl_MaxDrawBuffers = 8;",                          kAll, 110, 0 },
+    { "const int gl_MaxTextureCoords = 8;",                        kAll, 110, 140 },
+    { "const int gl_MaxClipPlanes = 8;",                           kAll, 110, 140 },
+    { "const int gl_MaxVaryingFloats = 60;",                       kAll, 110, 140 },
+    { "const int gl_MaxClipDistances = 8;",                        kAll, 130, 0 },
+    { "const int gl_MaxVaryingComponents = 60;",                   kAll, 130, 0 },
+    { "const int gl_MinProgramTexelOffset = -8;",                  kAll, 130, 0 },
+    { "const int gl_MaxProgramTexelOffset = 7;",                   kAll, 130, 0 },
+    { "const int gl_MaxVertexOutputComponents = 64;",              kAll, 150, 0 },
+    { "const int gl_MaxGeometryInputComponents = 64;",             kAll, 150, 0 },
+    { "const int gl_MaxGeometryOutputComponents = 128;",           kAll, 150, 0 },
+    { "const int gl_MaxGeometryOutputVertices = 256;",             kAll, 150, 0 },
+    { "const int gl_MaxGeometryTotalOutputComponents = 1024;",     kAll, 150, 0 },
+    { "const int gl_MaxGeometryUniformComponents = 1024;",         kAll, 150, 0 },
+    { "const int gl_MaxGeometryTextureImageUnits = 16;",           kAll, 150, 0 },
+    { "const int gl_MaxFragmentInputComponents = 128;",            kAll, 150, 0 },
+    { "const int gl_MaxPatchVertices = 32;",                       kAll, 400, 0 },
+    { "const int gl_MaxTessGenLevel = 64;",                        kAll, 400, 0 },
+    { "const int gl_MaxTessControlInputComponents = 128;",         kAll, 400, 0 },
+    { "const int gl_MaxTessControlOutputComponents = 128;",        kAll, 400, 0 },
+    { "const int gl_MaxTessControlTextureImageUnits = 16;",        kAll, 400, 0 },
+    { "const int gl_MaxTessControlUniformComponents = 1024;",      kAll, 400, 0 },
+    { "const int gl_MaxTessControlTotalOutputComponents = 4096;",  kAll, 400, 0 },
+    { "const int gl_MaxTessEvaluationInputComponents = 128;",      kAll, 400, 0 },
+    { "const int gl_MaxTessEvaluationOutputComponents = 128;",     kAll, 400, 0 },
+    { "const int gl_MaxTessEvaluationTextureImageUnits = 16;",     kAll, 400, 0 },
+    { "const int gl_MaxTessEvaluationUniformComponents = 1024;",   kAll, 400, 0 },
+    { "const int gl_MaxTessPatchComponents = 120;",                kAll, 400, 0 },
+    { "const int gl_MaxViewports = 16;",                           kAll, 410, 0 },
+    { "const int gl_MaxImageUnits = 8;",                           kAll, 420, 0 },
+    { "const int gl_MaxCombinedImageUnitsAndFragmentOutputs = 8;", kAll, 420, 0 },
+    { "const int gl_MaxImageSamples = 0;",                         kAll, 420, 0 },
+    { "const int gl_MaxVertexAtomicCounters = 0;",                 kAll, 420, 0 },
+    { "const int gl_MaxFragmentAtomicCounters = 8;",               kAll, 420, 0 },
+    { "const int gl_MaxCombinedAtomicCounters = 8;",               kAll, 420, 0 },
+    { "const int gl_MaxAtomicCounterBindings = 1;",                kAll, 420, 0 },
+    { "const int gl_MaxComputeUniformComponents = 1024;",          kAll, 430, 0 },
+    { "const int gl_MaxComputeTextureImageUnits = 16;",            kAll, 430, 0 },
+    { "const int gl_MaxComputeImageUniforms = 8;",                 kAll, 430, 0 },
+    { "const int gl_MaxComputeAtomicCounters = 8;",                kAll, 430, 0 },
+    { "const int gl_MaxComputeAtomicCounterBuffers = 1;",          kAll, 430, 0 },
+    { "const int gl_MaxCullDistances = 8;",                        kAll, 450, 0 },
+    { "const int gl_MaxCombinedClipAndCullDistances = 8;",         kAll, 450, 0 },
+
+    // Uniforms
+    { "uniform struct gl_DepthRangeParameters { float near; float far; float diff; } gl_DepthRange;", kGraphics, 110, 0 },
+    { "uniform mat4 gl_ModelViewMatrix;",                          kGraphics, 110, 140 },
+    { "uniform mat4 gl_ProjectionMatrix;",                         kGraphics, 110, 140 },
+    { "uniform mat4 gl_ModelViewProjectionMatrix;",                kGraphics, 110, 140 },
+    { "uniform mat4 gl_TextureMatrix[gl_MaxTextureCoords];",       kGraphics, 110, 140 },
+    { "uniform mat3 gl_NormalMatrix;",                             kGraphics, 110, 140 },
+    { "uniform mat4 gl_ModelViewMatrixInverse;",                   kGraphics, 110, 140 },
+    { "uniform mat4 gl_ProjectionMatrixInverse;",                  kGraphics, 110, 140 },
+    { "uniform mat4 gl_ModelViewProjectionMatrixInverse;",         kGraphics, 110, 140 },
+    { "uniform mat4 gl_ModelViewMatrixTranspose;",                 kGraphics, 110, 140 },
+    { "uniform mat4 gl_ProjectionMatrixTranspose;",                kGraphics, 110, 140 },
+    { "uniform mat4 gl_ModelViewProjectionMatrixTranspose;",       kGraphics, 110, 140 },
+    { "uniform float gl_NormalScale;",                             kGraphics, 110, 140 },
+    { "uniform vec4 gl_ClipPlane[gl_MaxClipPlanes];",              kGraphics, 110, 140 },
+
+    // Vertex shader
+    { "in vec4 gl_Vertex;",                                        kVS, 110, 140 },
+    { "in vec3 gl_Normal;",                                        kVS, 110, 140 },
+    { "in vec4 gl_Color;",                                         kVS, 110, 140 },
+    { "in vec4 gl_SecondaryColor;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord0;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord1;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord2;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord3;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord4;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord5;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord6;",                                kVS, 110, 140 },
+    { "in vec4 gl_MultiTexCoord7;",                                kVS, 110, 140 },
+    { "in float gl_FogCoord;",                                     kVS, 110, 140 },
+    { "in int gl_VertexID;",                                       kVS, 130, 0 },
+    { "in int gl_InstanceID;",                                     kVS, 140, 0 },
+    { "in int gl_DrawID;",                                         kVS, 460, 0 },
+    { "in int gl_BaseVertex;",                                     kVS, 460, 0 },
+    { "in int gl_BaseInstance;",                                   kVS, 460, 0 },
+    { "out vec4 gl_ClipVertex;",                                   kVS, 110, 140 },
+    { "out vec4 gl_FrontColor;",                                   kVS, 110, 140 },
+    { "out vec4 gl_BackColor;",                                    kVS, 110, 140 },
+    { "out vec4 gl_FrontSecondaryColor;",                          kVS, 110, 140 },
+    { "out vec4 gl_BackSecondaryColor;",                           kVS, 110, 140 },
+    { "out vec4 gl_TexCoord[gl_MaxTextureCoords];",                kVS, 110, 140 },
+    { "out float gl_FogFragCoord;",                                kVS, 110, 140 },
+
+    // Outputs of the last stage before rasterization
+    { "out vec4 gl_Position;",                                     kVS | kTES | kGS, 110, 0 },
+    { "out float gl_PointSize;",                                   kVS | kTES | kGS, 110, 0 },
+    { "out float gl_ClipDistance[gl_MaxClipDistances];",           kVS | kTES | kGS, 130, 0 },
+    { "out float gl_CullDistance[gl_MaxCullDistances];",           kVS | kTES | kGS, 450, 0 },
+
+    // Tessellation shaders
+    { "in int gl_PatchVerticesIn;",                                kTCS | kTES, 400, 0 },
+    { "in int gl_PrimitiveID;",                                    kTCS | kTES, 400, 0 },
+    { "in int gl_InvocationID;",                                   kTCS, 400, 0 },
+    { "out float gl_TessLevelOuter[4];",                           kTCS, 400, 0 },
+    { "out float gl_TessLevelInner[2];",                           kTCS, 400, 0 },
+    { "in vec3 gl_TessCoord;",                                     kTES, 400, 0 },
+    { "in float gl_TessLevelOuter[4];",                            kTES, 400, 0 },
+    { "in float gl_TessLevelInner[2];",                            kTES, 400, 0 },
+
+    // Geometry shader
+    { "in int gl_PrimitiveIDIn;",                                  kGS, 150, 0 },
+    { "in int gl_InvocationID;",                                   kGS, 400, 0 },
+    { "out int gl_PrimitiveID;",                                   kGS, 150, 0 },
+    { "out int gl_Layer;",                                         kGS, 150, 0 },
+    { "out int gl_ViewportIndex;",                                 kGS, 410, 0 },
+
+    // Fragment shader
+    { "in vec4 gl_FragCoord;",                                     kFS, 110, 0 },
+    { "in bool gl_FrontFacing;",                                   kFS, 110, 0 },
+    { "in vec2 gl_PointCoord;",                                    kFS, 110, 0 },
+    { "in vec4 gl_Color;",                                         kFS, 110, 140 },
+    { "in vec4 gl_SecondaryColor;",                                kFS, 110, 140 },
+    { "in vec4 gl_TexCoord[gl_MaxTextureCoords];",                 kFS, 110, 140 },
+    { "in float gl_FogFragCoord;",                                 kFS, 110, 140 },
+    { "in float gl_ClipDistance[gl_MaxClipDistances];",            kFS, 130, 0 },
+    { "in int gl_PrimitiveID;",                                    kFS, 150, 0 },
+    { "in int gl_SampleID;",                                       kFS, 400, 0 },
+    { "in vec2 gl_SamplePosition;",                                kFS, 400, 0 },
+    { "in int gl_SampleMaskIn[1];",                                kFS, 400, 0 },
+    { "in int gl_Layer;",                                          kFS, 430, 0 },
+    { "in int gl_ViewportIndex;",                                  kFS, 430, 0 },
+    { "in float gl_CullDistance[gl_MaxCullDistances];",            kFS, 450, 0 },
+    { "in bool gl_HelperInvocation;",                              kFS, 450, 0 },
+    { "out float gl_FragDepth;",                                   kFS, 110, 0 },
+    { "out vec4 gl_FragColor;",                                    kFS, 110, 140 },
+    { "out vec4 gl_FragData[gl_MaxDrawBuffers];",                  kFS, 110, 140 },
+    { "out int gl_SampleMask[1];",                                 kFS, 400, 0 },
+
+    // Compute shader
+    { "in uvec3 gl_NumWorkGroups;",                                kCS, 430, 0 },
+    { "in uvec3 gl_WorkGroupSize;",                                kCS, 430, 0 },
+    { "in uvec3 gl_WorkGroupID;",                                  kCS, 430, 0 },
+    { "in uvec3 gl_LocalInvocationID;",                            kCS, 430, 0 },
+    { "in uvec3 gl_GlobalInvocationID;",                           kCS, 430, 0 },
+    { "in uint gl_LocalInvocationIndex;",                          kCS, 430, 0 },
+
+    // Angle and trigonometry
+    { "$gen radians($gen);",                                       kAll, 110, 0 },
+    { "$gen degrees($gen);",                                       kAll, 110, 0 },
+    { "$gen sin($gen);",                                           kAll, 110, 0 },
+    { "$gen cos($gen);",                                           kAll, 110, 0 },
+    { "$gen tan($gen);",                                           kAll, 110, 0 },
+    { "$gen asin($gen);",                                          kAll, 110, 0 },
+    { "$gen acos($gen);",                                          kAll, 110, 0 },
+    { "$gen atan($gen, $gen);",                                    kAll, 110, 0 },
+    { "$gen atan($gen);",                                          kAll, 110, 0 },
+    { "$gen sinh($gen);",                                          kAll, 130, 0 },
+    { "$gen cosh($gen);",                                          kAll, 130, 0 },
+    { "$gen tanh($gen);",                                          kAll, 130, 0 },
+    { "$gen asinh($gen);",                                         kAll, 130, 0 },
+    { "$gen acosh($gen);",                                         kAll, 130, 0 },
+    { "$gen atanh($gen);",                                         kAll, 130, 0 },
+
+    // Exponential
+    { "$gen pow($gen, $gen);",                                     kAll, 110, 0 },
+    { "$gen exp($gen);",                                           kAll, 110, 0 },
+    { "$gen log($gen);",                                           kAll, 110, 0 },
+    { "$gen exp2($gen);",                                          kAll, 110, 0 },
+    { "$gen log2($gen);",                                          kAll, 110, 0 },
+    { "$gen sqrt($gen);",                                          kAll, 110, 0 },
+    { "$genD sqrt($genD);",                                        kAll, 400, 0 },
+    { "$gen inversesqrt($gen);",                                   kAll, 110, 0 },
+    { "$genD inversesqrt($genD);",                                 kAll, 400, 0 },
+
+    // Common
+    { "$gen abs($gen);",                                           kAll, 110, 0 },
+    { "$genI abs($genI);",                                         kAll, 130, 0 },
+    { "$genD abs($genD);",                                         kAll, 400, 0 },
+    { "$gen sign($gen);",                                          kAll, 110, 0 },
+    { "$genI sign($genI);",                                        kAll, 130, 0 },
+    { "$genD sign($genD);",                                        kAll, 400, 0 },
+    { "$gen floor($gen);",                                         kAll, 110, 0 },
+    { "$genD floor($genD);",                                       kAll, 400, 0 },
+    { "$gen trunc($gen);",                                         kAll, 130, 0 },
+    { "$genD trunc($genD);",                                       kAll, 400, 0 },
+    { "$gen round($gen);",                                         kAll, 130, 0 },
+    { "$genD round($genD);",                                       kAll, 400, 0 },
+    { "$gen roundEven($gen);",                                     kAll, 130, 0 },
+    { "$genD roundEven($genD);",                                   kAll, 400, 0 },
+    { "$gen ceil($gen);",                                          kAll, 110, 0 },
+    { "$genD ceil($genD);",                                        kAll, 400, 0 },
+    { "$gen fract($gen);",                                         kAll, 110, 0 },
+    { "$genD fract($genD);",                                       kAll, 400, 0 },
+    { "$vec mod($vec, float);",                                    kAll, 110, 0 },
+    { "$gen mod($gen, $gen);",                                     kAll, 110, 0 },
+    { "$dvec mod($dvec, double);",                                 kAll, 400, 0 },
+    { "$genD mod($genD, $genD);",                                  kAll, 400, 0 },
+    { "$gen modf($gen, out $gen);",                                kAll, 130, 0 },
+    { "$gen min($gen, $gen);",                                     kAll, 110, 0 },
+    { "$vec min($vec, float);",                                    kAll, 110, 0 },
+    { "$genI min($genI, $genI);",                                  kAll, 130, 0 },
+    { "$ivec min($ivec, int);",                                    kAll, 130, 0 },
+    { "$genU min($genU, $genU);",                                  kAll, 130, 0 },
+    { "$uvec min($uvec, uint);",                                   kAll, 130, 0 },
+    { "$genD min($genD, $genD);",                                  kAll, 400, 0 },
+    { "$dvec min($dvec, double);",                                 kAll, 400, 0 },
+    { "$gen max($gen, $gen);",                                     kAll, 110, 0 },
+    { "$vec max($vec, float);",                                    kAll, 110, 0 },
+    { "$genI max($genI, $genI);",                                  kAll, 130, 0 },
+    { "$ivec max($ivec, int);",                                    kAll, 130, 0 },
+    { "$genU max($genU, $genU);",                                  kAll, 130, 0 },
+    { "$uvec max($uvec, uint);",                                   kAll, 130, 0 },
+    { "$genD max($genD, $genD);",                                  kAll, 400, 0 },
+    { "$dvec max($dvec, double);",                                 kAll, 400, 0 },
+    { "$gen clamp($gen, $gen, $gen);",                             kAll, 110, 0 },
+    { "$vec clamp($vec, float, float);",                           kAll, 110, 0 },
+    { "$genI clamp($genI, $genI, $genI);",                         kAll, 130, 0 },
+    { "$ivec clamp($ivec, int, int);",                             kAll, 130, 0 },
+    { "$genU clamp($genU, $genU, $genU);",                         kAll, 130, 0 },
+    { "$uvec clamp($uvec, uint, uint);",                           kAll, 130, 0 },
+    { "$genD clamp($genD, $genD, $genD);",                         kAll, 400, 0 },
+    { "$dvec clamp($dvec, double, double);",                       kAll, 400, 0 },
+    { "$gen mix($gen, $gen, $gen);",                               kAll, 110, 0 },
+    { "$vec mix($vec, $vec, float);",                              kAll, 110, 0 },
+    { "$gen mix($gen, $gen, $genB);",                              kAll, 130, 0 },
+    { "$genD mix($genD, $genD, $genD);",                           kAll, 400, 0 },
+    { "$dvec mix($dvec, $dvec, double);",                          kAll, 400, 0 },
+    { "$genD mix($genD, $genD, $genB);",                           kAll, 400, 0 },
+    { "$gen step($gen, $gen);",                                    kAll, 110, 0 },
+    { "$vec step(float, $vec);",                                   kAll, 110, 0 },
+    { "$gen smoothstep($gen, $gen, $gen);",                        kAll, 110, 0 },
+    { "$vec smoothstep(float, float, $vec);",                      kAll, 110, 0 },
+    { "$genB isnan($gen);",                                        kAll, 130, 0 },
+    { "$genB isinf($gen);",                                        kAll, 130, 0 },
+    { "$genI floatBitsToInt($gen);",                               kAll, 330, 0 },
+    { "$genU floatBitsToUint($gen);",                              kAll, 330, 0 },
+    { "$gen intBitsToFloat($genI);",                               kAll, 330, 0 },
+    { "$gen uintBitsToFloat($genU);",                              kAll, 330, 0 },
+    { "$gen fma($gen, $gen, $gen);",                               kAll, 400, 0 },
+    { "$genD fma($genD, $genD, $genD);",                           kAll, 400, 0 },
+    { "$gen frexp($gen, out $genI);",                              kAll, 400, 0 },
+    { "$gen ldexp($gen, $genI);",                                  kAll, 400, 0 },
+
+    // Floating-point pack and unpack
+    { "uint packUnorm2x16(vec2);",                                 kAll, 410, 0 },
+    { "uint packSnorm2x16(vec2);",                                 kAll, 420, 0 },
+    { "uint packUnorm4x8(vec4);",                                  kAll, 400, 0 },
+    { "uint packSnorm4x8(vec4);",                                  kAll, 400, 0 },
+    { "vec2 unpackUnorm2x16(uint);",                               kAll, 410, 0 },
+    { "vec2 unpackSnorm2x16(uint);",                               kAll, 420, 0 },
+    { "vec4 unpackUnorm4x8(uint);",                                kAll, 400, 0 },
+    { "vec4 unpackSnorm4x8(uint);",                                kAll, 400, 0 },
+    { "uint packHalf2x16(vec2);",                                  kAll, 420, 0 },
+    { "vec2 unpackHalf2x16(uint);",                                kAll, 420, 0 },
+    { "double packDouble2x32(uvec2);",                             kAll, 400, 0 },
+    { "uvec2 unpackDouble2x32(double);",                           kAll, 400, 0 },
+
+    // Geometric
+    { "float length($gen);",                                       kAll, 110, 0 },
+    { "double length($genD);",                                     kAll, 400, 0 },
+    { "float distance($gen, $gen);",                               kAll, 110, 0 },
+    { "double distance($genD, $genD);",                            kAll, 400, 0 },
+    { "float dot($gen, $gen);",                                    kAll, 110, 0 },
+    { "double dot($genD, $genD);",                                 kAll, 400, 0 },
+    { "vec3 cross(vec3, vec3);",                                   kAll, 110, 0 },
+    { "dvec3 cross(dvec3, dvec3);",                                kAll, 400, 0 },
+    { "$gen normalize($gen);",                                     kAll, 110, 0 },
+    { "$genD normalize($genD);",                                   kAll, 400, 0 },
+    { "vec4 ftransform();",                                        kVS, 110, 140 },
+    { "$gen faceforward($gen, $gen, $gen);",                       kAll, 110, 0 },
+    { "$gen reflect($gen, $gen);",                                 kAll, 110, 0 },
+    { "$gen refract($gen, $gen, float);",                          kAll, 110, 0 },
+
+    // Matrix
+    { "mat2 matrixCompMult(mat2, mat2);",                          kAll, 110, 0 },
+    { "mat3 matrixCompMult(mat3, mat3);",                          kAll, 110, 0 },
+    { "mat4 matrixCompMult(mat4, mat4);",                          kAll, 110, 0 },
+    { "mat2 outerProduct(vec2, vec2);",                            kAll, 120, 0 },
+    { "mat3 outerProduct(vec3, vec3);",                            kAll, 120, 0 },
+    { "mat4 outerProduct(vec4, vec4);",                            kAll, 120, 0 },
+    { "mat2 transpose(mat2);",                                     kAll, 120, 0 },
+    { "mat3 transpose(mat3);",                                     kAll, 120, 0 },
+    { "mat4 transpose(mat4);",                                     kAll, 120, 0 },
+    { "float determinant(mat2);",                                  kAll, 150, 0 },
+    { "float determinant(mat3);",                                  kAll, 150, 0 },
+    { "float determinant(mat4);",                                  kAll, 150, 0 },
+    { "mat2 inverse(mat2);",                                       kAll, 140, 0 },
+    { "mat3 inverse(mat3);",                                       kAll, 140, 0 },
+    { "mat4 inverse(mat4);",                                       kAll, 140, 0 },
+
+    // Vector relational
+    { "$bvec lessThan($vec, $vec);",                               kAll, 110, 0 },
+    { "$bvec lessThan($ivec, $ivec);",                             kAll, 110, 0 },
+    { "$bvec lessThan($uvec, $uvec);",                             kAll, 130, 0 },
+    { "$bvec lessThanEqual($vec, $vec);",                          kAll, 110, 0 },
+    { "$bvec lessThanEqual($ivec, $ivec);",                        kAll, 110, 0 },
+    { "$bvec lessThanEqual($uvec, $uvec);",                        kAll, 130, 0 },
+    { "$bvec greaterThan($vec, $vec);",                            kAll, 110, 0 },
+    { "$bvec greaterThan($ivec, $ivec);",                          kAll, 110, 0 },
+    { "$bvec greaterThan($uvec, $uvec);",                          kAll, 130, 0 },
+    { "$bvec greaterThanEqual($vec, $vec);",                       kAll, 110, 0 },
+    { "$bvec greaterThanEqual($ivec, $ivec);",                     kAll, 110, 0 },
+    { "$bvec greaterThanEqual($uvec, $uvec);",                     kAll, 130, 0 },
+    { "$bvec equal($vec, $vec);",                                  kAll, 110, 0 },
+    { "$bvec equal($ivec, $ivec);",                                kAll, 110, 0 },
+    { "$bvec equal($uvec, $uvec);",                                kAll, 130, 0 },
+    { "$bvec equal($bvec, $bvec);",                                kAll, 110, 0 },
+    { "$bvec notEqual($vec, $vec);",                               kAll, 110, 0 },
+    { "$bvec notEqual($ivec, $ivec);",                             kAll, 110, 0 },
+    { "$bvec notEqual($uvec, $uvec);",                             kAll, 130, 0 },
+    { "$bvec notEqual($bvec, $bvec);",                             kAll, 110, 0 },
+    { "bool any($bvec);",                                          kAll, 110, 0 },
+    { "bool all($bvec);",                                          kAll, 110, 0 },
+    { "$bvec not($bvec);",                                         kAll, 110, 0 },
+
+    // Integer
+    { "$genU uaddCarry($genU, $genU, out $genU);",                 kAll, 400, 0 },
+    { "$genU usubBorrow($genU, $genU, out $genU);",                kAll, 400, 0 },
+    { "void umulExtended($genU, $genU, out $genU, out $genU);",    kAll, 400, 0 },
+    { "void imulExtended($genI, $genI, out $genI, out $genI);",    kAll, 400, 0 },
+    { "$genI bitfieldExtract($genI, int, int);",                   kAll, 400, 0 },
+    { "$genU bitfieldExtract($genU, int, int);",                   kAll, 400, 0 },
+    { "$genI bitfieldInsert($genI, $genI, int, int);",             kAll, 400, 0 },
+    { "$genU bitfieldInsert($genU, $genU, int, int);",             kAll, 400, 0 },
+    { "$genI bitfieldReverse($genI);",                             kAll, 400, 0 },
+    { "$genU bitfieldReverse($genU);",                             kAll, 400, 0 },
+    { "$genI bitCount($genI);",                                    kAll, 400, 0 },
+    { "$genI bitCount($genU);",                                    kAll, 400, 0 },
+    { "$genI findLSB($genI);",                                     kAll, 400, 0 },
+    { "$genI findLSB($genU);",                                     kAll, 400, 0 },
+    { "$genI findMSB($genI);",                                     kAll, 400, 0 },
+    { "$genI findMSB($genU);",                                     kAll, 400, 0 },
+
+    // Texture lookup
+    { "int textureSize(@sampler1D, int);",                         kAll, 130, 0 },
+    { "ivec2 textureSize(@sampler2D, int);",                       kAll, 130, 0 },
+    { "ivec3 textureSize(@sampler3D, int);",                       kAll, 130, 0 },
+    { "ivec2 textureSize(@samplerCube, int);",                     kAll, 130, 0 },
+    { "ivec2 textureSize(@sampler1DArray, int);",                  kAll, 130, 0 },
+    { "ivec3 textureSize(@sampler2DArray, int);",                  kAll, 130, 0 },
+    { "ivec2 textureSize(@sampler2DRect);",                        kAll, 140, 0 },
+    { "int textureSize(@samplerBuffer);",                          kAll, 140, 0 },
+    { "ivec2 textureSize(@sampler2DMS);",                          kAll, 150, 0 },
+    { "ivec3 textureSize(@sampler2DMSArray);",                     kAll, 150, 0 },
+    { "ivec3 textureSize(@samplerCubeArray, int);",                kAll, 400, 0 },
+    { "ivec2 textureSize(sampler2DShadow, int);",                  kAll, 130, 0 },
+    { "ivec2 textureSize(samplerCubeShadow, int);",                kAll, 130, 0 },
+    { "ivec3 textureSize(sampler2DArrayShadow, int);",             kAll, 130, 0 },
+    { "vec2 textureQueryLod(@sampler1D, float);",                  kFS, 400, 0 },
+    { "vec2 textureQueryLod(@sampler2D, vec2);",                   kFS, 400, 0 },
+    { "vec2 textureQueryLod(@sampler3D, vec3);",                   kFS, 400, 0 },
+    { "vec2 textureQueryLod(@samplerCube, vec3);",                 kFS, 400, 0 },
+    { "int textureQueryLevels(@sampler1D);",                       kAll, 430, 0 },
+    { "int textureQueryLevels(@sampler2D);",                       kAll, 430, 0 },
+    { "int textureQueryLevels(@sampler3D);",                       kAll, 430, 0 },
+    { "int textureQueryLevels(@samplerCube);",                     kAll, 430, 0 },
+    { "@vec4 texture(@sampler1D, float);",                         kAll, 130, 0 },
+    { "@vec4 texture(@sampler2D, vec2);",                          kAll, 130, 0 },
+    { "@vec4 texture(@sampler3D, vec3);",                          kAll, 130, 0 },
+    { "@vec4 texture(@samplerCube, vec3);",                        kAll, 130, 0 },
+    { "@vec4 texture(@sampler1DArray, vec2);",                     kAll, 130, 0 },
+    { "@vec4 texture(@sampler2DArray, vec3);",                     kAll, 130, 0 },
+    { "@vec4 texture(@sampler2DRect, vec2);",                      kAll, 140, 0 },
+    { "@vec4 texture(@samplerCubeArray, vec4);",                   kAll, 400, 0 },
+    { "@vec4 texture(@sampler1D, float, float);",                  kFS, 130, 0 },
+    { "@vec4 texture(@sampler2D, vec2, float);",                   kFS, 130, 0 },
+    { "@vec4 texture(@sampler3D, vec3, float);",                   kFS, 130, 0 },
+    { "@vec4 texture(@samplerCube, vec3, float);",                 kFS, 130, 0 },
+    { "float texture(sampler1DShadow, vec3);",                     kAll, 130, 0 },
+    { "float texture(sampler2DShadow, vec3);",                     kAll, 130, 0 },
+    { "float texture(samplerCubeShadow, vec4);",                   kAll, 130, 0 },
+    { "float texture(sampler2DArrayShadow, vec4);",                kAll, 130, 0 },
+    { "@vec4 textureProj(@sampler1D, vec2);",                      kAll, 130, 0 },
+    { "@vec4 textureProj(@sampler1D, vec4);",                      kAll, 130, 0 },
+    { "@vec4 textureProj(@sampler2D, vec3);",                      kAll, 130, 0 },
+    { "@vec4 textureProj(@sampler2D, vec4);",                      kAll, 130, 0 },
+    { "@vec4 textureProj(@sampler3D, vec4);",                      kAll, 130, 0 },
+    { "float textureProj(sampler2DShadow, vec4);",                 kAll, 130, 0 },
+    { "@vec4 textureLod(@sampler1D, float, float);",               kAll, 130, 0 },
+    { "@vec4 textureLod(@sampler2D, vec2, float);",                kAll, 130, 0 },
+    { "@vec4 textureLod(@sampler3D, vec3, float);",                kAll, 130, 0 },
+    { "@vec4 textureLod(@samplerCube, vec3, float);",              kAll, 130, 0 },
+    { "@vec4 textureLod(@sampler1DArray, vec2, float);",           kAll, 130, 0 },
+    { "@vec4 textureLod(@sampler2DArray, vec3, float);",           kAll, 130, 0 },
+    { "float textureLod(sampler2DShadow, vec3, float);",           kAll, 130, 0 },
+    { "@vec4 textureOffset(@sampler1D, float, int);",              kAll, 130, 0 },
+    { "@vec4 textureOffset(@sampler2D, vec2, ivec2);",             kAll, 130, 0 },
+    { "@vec4 textureOffset(@sampler3D, vec3, ivec3);",             kAll, 130, 0 },
+    { "@vec4 textureOffset(@sampler2DArray, vec3, ivec2);",        kAll, 130, 0 },
+    { "float textureOffset(sampler2DShadow, vec3, ivec2);",        kAll, 130, 0 },
+    { "@vec4 texelFetch(@sampler1D, int, int);",                   kAll, 130, 0 },
+    { "@vec4 texelFetch(@sampler2D, ivec2, int);",                 kAll, 130, 0 },
+    { "@vec4 texelFetch(@sampler3D, ivec3, int);",                 kAll, 130, 0 },
+    { "@vec4 texelFetch(@sampler1DArray, ivec2, int);",            kAll, 130, 0 },
+    { "@vec4 texelFetch(@sampler2DArray, ivec3, int);",            kAll, 130, 0 },
+    { "@vec4 texelFetch(@sampler2DRect, ivec2);",                  kAll, 140, 0 },
+    { "@vec4 texelFetch(@samplerBuffer, int);",                    kAll, 140, 0 },
+    { "@vec4 texelFetch(@sampler2DMS, ivec2, int);",               kAll, 150, 0 },
+    { "@vec4 texelFetch(@sampler2DMSArray, ivec3, int);",          kAll, 150, 0 },
+    { "@vec4 texelFetchOffset(@sampler2D, ivec2, int, ivec2);",    kAll, 130, 0 },
+    { "@vec4 textureLodOffset(@sampler2D, vec2, float, ivec2);",   kAll, 130, 0 },
+    { "@vec4 textureGrad(@sampler1D, float, float, float);",       kAll, 130, 0 },
+    { "@vec4 textureGrad(@sampler2D, vec2, vec2, vec2);",          kAll, 130, 0 },
+    { "@vec4 textureGrad(@sampler3D, vec3, vec3, vec3);",          kAll, 130, 0 },
+    { "@vec4 textureGrad(@samplerCube, vec3, vec3, vec3);",        kAll, 130, 0 },
+    { "@vec4 textureGrad(@sampler2DArray, vec3, vec2, vec2);",     kAll, 130, 0 },
+    { "float textureGrad(sampler2DShadow, vec3, vec2, vec2);",     kAll, 130, 0 },
+    { "@vec4 textureGradOffset(@sampler2D, vec2, vec2, vec2, ivec2);", kAll, 130, 0 },
+    { "@vec4 textureGather(@sampler2D, vec2);",                    kAll, 400, 0 },
+    { "@vec4 textureGather(@sampler2D, vec2, int);",               kAll, 400, 0 },
+    { "@vec4 textureGather(@sampler2DArray, vec3);",               kAll, 400, 0 },
+    { "@vec4 textureGather(@samplerCube, vec3);",                  kAll, 400, 0 },
+    { "vec4 textureGather(sampler2DShadow, vec2, float);",         kAll, 400, 0 },
+    { "@vec4 textureGatherOffset(@sampler2D, vec2, ivec2);",       kAll, 400, 0 },
+    { "vec4 texture1D(sampler1D, float);",                         kAll, 110, 140 },
+    { "vec4 texture1D(sampler1D, float, float);",                  kFS, 110, 140 },
+    { "vec4 texture1DProj(sampler1D, vec2);",                      kAll, 110, 140 },
+    { "vec4 texture1DProj(sampler1D, vec4);",                      kAll, 110, 140 },
+    { "vec4 texture1DLod(sampler1D, float, float);",               kVS, 110, 140 },
+    { "vec4 texture2D(sampler2D, vec2);",                          kAll, 110, 140 },
+    { "vec4 texture2D(sampler2D, vec2, float);",                   kFS, 110, 140 },
+    { "vec4 texture2DProj(sampler2D, vec3);",                      kAll, 110, 140 },
+    { "vec4 texture2DProj(sampler2D, vec4);",                      kAll, 110, 140 },
+    { "vec4 texture2DLod(sampler2D, vec2, float);",                kVS, 110, 140 },
+    { "vec4 texture2DProjLod(sampler2D, vec3, float);",            kVS, 110, 140 },
+    { "vec4 texture2DProjLod(sampler2D, vec4, float);",            kVS, 110, 140 },
+    { "vec4 texture3D(sampler3D, vec3);",                          kAll, 110, 140 },
+    { "vec4 texture3D(sampler3D, vec3, float);",                   kFS, 110, 140 },
+    { "vec4 texture3DProj(sampler3D, vec4);",                      kAll, 110, 140 },
+    { "vec4 texture3DLod(sampler3D, vec3, float);",                kVS, 110, 140 },
+    { "vec4 textureCube(samplerCube, vec3);",                      kAll, 110, 140 },
+    { "vec4 textureCube(samplerCube, vec3, float);",               kFS, 110, 140 },
+    { "vec4 textureCubeLod(samplerCube, vec3, float);",            kVS, 110, 140 },
+    { "vec4 shadow1D(sampler1DShadow, vec3);",                     kAll, 110, 140 },
+    { "vec4 shadow2D(sampler2DShadow, vec3);",                     kAll, 110, 140 },
+    { "vec4 shadow2DProj(sampler2DShadow, vec4);",                 kAll, 110, 140 },
+
+    // Atomic counters
+    { "uint atomicCounterIncrement(atomic_uint);",                 kAll, 420, 0 },
+    { "uint atomicCounterDecrement(atomic_uint);",                 kAll, 420, 0 },
+    { "uint atomicCounter(atomic_uint);",                          kAll, 420, 0 },
+
+    // Atomic memory
+    { "uint atomicAdd(inout uint, uint);",                         kAll, 430, 0 },
+    { "int atomicAdd(inout int, int);",                            kAll, 430, 0 },
+    { "uint atomicMin(inout uint, uint);",                         kAll, 430, 0 },
+    { "int atomicMin(inout int, int);",                            kAll, 430, 0 },
+    { "uint atomicMax(inout uint, uint);",                         kAll, 430, 0 },
+    { "int atomicMax(inout int, int);",                            kAll, 430, 0 },
+    { "uint atomicAnd(inout uint, uint);",                         kAll, 430, 0 },
+    { "int atomicAnd(inout int, int);",                            kAll, 430, 0 },
+    { "uint atomicOr(inout uint, uint);",                          kAll, 430, 0 },
+    { "int atomicOr(inout int, int);",                             kAll, 430, 0 },
+    { "uint atomicXor(inout uint, uint);",                         kAll, 430, 0 },
+    { "int atomicXor(inout int, int);",                            kAll, 430, 0 },
+    { "uint atomicExchange(inout uint, uint);",                    kAll, 430, 0 },
+    { "int atomicExchange(inout int, int);",                       kAll, 430, 0 },
+    { "uint atomicCompSwap(inout uint, uint, uint);",              kAll, 430, 0 },
+    { "int atomicCompSwap(inout int, int, int);",                  kAll, 430, 0 },
+
+    // Image
+    { "int imageSize(@image1D);",                                  kAll, 430, 0 },
+    { "ivec2 imageSize(@image2D);",                                kAll, 430, 0 },
+    { "ivec3 imageSize(@image3D);",                                kAll, 430, 0 },
+    { "ivec2 imageSize(@imageCube);",                              kAll, 430, 0 },
+    { "ivec3 imageSize(@image2DArray);",                           kAll, 430, 0 },
+    { "int imageSize(@imageBuffer);",                              kAll, 430, 0 },
+    { "@vec4 imageLoad(@image1D, int);",                           kAll, 420, 0 },
+    { "@vec4 imageLoad(@image2D, ivec2);",                         kAll, 420, 0 },
+    { "@vec4 imageLoad(@image3D, ivec3);",                         kAll, 420, 0 },
+    { "@vec4 imageLoad(@imageCube, ivec3);",                       kAll, 420, 0 },
+    { "@vec4 imageLoad(@image2DArray, ivec3);",                    kAll, 420, 0 },
+    { "@vec4 imageLoad(@imageBuffer, int);",                       kAll, 420, 0 },
+    { "void imageStore(@image1D, int, @vec4);",                    kAll, 420, 0 },
+    { "void imageStore(@image2D, ivec2, @vec4);",                  kAll, 420, 0 },
+    { "void imageStore(@image3D, ivec3, @vec4);",                  kAll, 420, 0 },
+    { "void imageStore(@imageCube, ivec3, @vec4);",                kAll, 420, 0 },
+    { "void imageStore(@image2DArray, ivec3, @vec4);",             kAll, 420, 0 },
+    { "void imageStore(@imageBuffer, int, @vec4);",                kAll, 420, 0 },
+    { "uint imageAtomicAdd(uimage2D, ivec2, uint);",               kAll, 420, 0 },
+    { "int imageAtomicAdd(iimage2D, ivec2, int);",                 kAll, 420, 0 },
+    { "uint imageAtomicExchange(uimage2D, ivec2, uint);",          kAll, 420, 0 },
+    { "int imageAtomicExchange(iimage2D, ivec2, int);",            kAll, 420, 0 },
+    { "uint imageAtomicCompSwap(uimage2D, ivec2, uint, uint);",    kAll, 420, 0 },
+    { "int imageAtomicCompSwap(iimage2D, ivec2, int, int);",       kAll, 420, 0 },
+
+    // Fragment processing
+    { "$gen dFdx($gen);",                                          kFS, 110, 0 },
+    { "$gen dFdy($gen);",                                          kFS, 110, 0 },
+    { "$gen fwidth($gen);",                                        kFS, 110, 0 },
+    { "$gen dFdxFine($gen);",                                      kFS, 450, 0 },
+    { "$gen dFdyFine($gen);",                                      kFS, 450, 0 },
+    { "$gen fwidthFine($gen);",                                    kFS, 450, 0 },
+    { "$gen dFdxCoarse($gen);",                                    kFS, 450, 0 },
+    { "$gen dFdyCoarse($gen);",                                    kFS, 450, 0 },
+    { "$gen fwidthCoarse($gen);",                                  kFS, 450, 0 },
+    { "$gen interpolateAtCentroid($gen);",                         kFS, 400, 0 },
+    { "$gen interpolateAtSample($gen, int);",                      kFS, 400, 0 },
+    { "$gen interpolateAtOffset($gen, vec2);",                     kFS, 400, 0 },
+
+    // Noise
+    { "float noise1($gen);",                                       kAll, 110, 0 },
+    { "vec2 noise2($gen);",                                        kAll, 110, 0 },
+    { "vec3 noise3($gen);",                                        kAll, 110, 0 },
+    { "vec4 noise4($gen);",                                        kAll, 110, 0 },
+
+    // Geometry shader
+    { "void EmitVertex();",                                        kGS, 150, 0 },
+    { "void EndPrimitive();",                                      kGS, 150, 0 },
+    { "void EmitStreamVertex(int);",                               kGS, 400, 0 },
+    { "void EndStreamPrimitive(int);",                             kGS, 400, 0 },
+
+    // Invocation control and memory barriers
+    { "void barrier();",                                           kTCS, 400, 0 },
+    { "void barrier();",                                           kCS, 430, 0 },
+    { "void memoryBarrier();",                                     kAll, 420, 0 },
+    { "void memoryBarrierAtomicCounter();",                        kAll, 430, 0 },
+    { "void memoryBarrierBuffer();",                               kAll, 430, 0 },
+    { "void memoryBarrierImage();",                                kAll, 430, 0 },
+    { "void memoryBarrierShared();",                               kCS, 430, 0 },
+    { "void groupMemoryBarrier();",                                kCS, 430, 0 }
+};
+
+static const size_t kBuiltinCount = sizeof kBuiltins / sizeof *kBuiltins;
+
+#undef TYPENAME
+#define TYPENAME(X) kKeyword_##X,
+static const int kTypeNames[] = {
+    #include "glsl-parser/lexemes.h"
+};
+#undef TYPENAME
+#define TYPENAME(...)
+
+static const size_t kTypeNameCount = sizeof kTypeNames / sizeof *kTypeNames;
+
+static void append(vector<char> &source, const char *text) {
+    source.insert(source.end(), text, text + strlen(text));
+}
+
+// Writes the declaration with its placeholders made types of the given size
+// and with the prefix given for @
+static void expand(vector<char> &source, const char *text, int size, const char *prefix) {
+    static const char *const kScalars[] = { "float", "int", "uint", "bool", "double" };
+    static const char *const kVectors[] = { "vec", "ivec", "uvec", "bvec", "dvec" };
+    static const char kKinds[] = "IUBD"; // Of $gen, after the float one
+    while (*text) {
+        if (*text == '@') {
+            append(source, prefix);
+            text++;
+            continue;
+        }
+        if (*text != '$') {
+            source.push_back(*text++);
+            continue;
+        }
+        text++; // skip '$'
+        int kind = 0;
+        if (!strncmp(text, "gen", 3)) {
+            text += 3;
+            if (const char *found = *text ? strchr(kKinds, *text) : 0) {
+                kind = int(found - kKinds) + 1;
+                text++;
+            }
+        } else {
+            while (strncmp(text, kVectors[kind], strlen(kVectors[kind])))
+                kind++;
+            text += strlen(kVectors[kind]);
+        }
+        if (size == 1) {
+            append(source, kScalars[kind]);
+        } else {
+            append(source, kVectors[kind]);
+            source.push_back(char('0' + size));
+        }
+    }
+    source.push_back('\n');
+}
+
+// Images and atomic counters are memory which calls read and write
+static bool isOpaqueMemory(int keyword) {
+    switch (keyword) {
+    case kKeyword_atomic_uint:
+    case kKeyword_image1D: case kKeyword_iimage1D: case kKeyword_uimage1D:
+    case kKeyword_image2D: case kKeyword_iimage2D: case kKeyword_uimage2D:
+    case kKeyword_image3D: case kKeyword_iimage3D: case kKeyword_uimage3D:
+    case kKeyword_imageCube: case kKeyword_iimageCube: case kKeyword_uimageCube:
+    case kKeyword_image2DRect: case kKeyword_iimage2DRect: case kKeyword_uimage2DRect:
+    case kKeyword_image1DArray: case kKeyword_iimage1DArray: case kKeyword_uimage1DArray:
+    case kKeyword_image2DArray: case kKeyword_iimage2DArray: case kKeyword_uimage2DArray:
+    case kKeyword_imageBuffer: case kKeyword_iimageBuffer: case kKeyword_uimageBuffer:
+    case kKeyword_image2DMS: case kKeyword_iimage2DMS: case kKeyword_uimage2DMS:
+    case kKeyword_image2DMSArray: case kKeyword_iimage2DMSArray: case kKeyword_uimage2DMSArray:
+    case kKeyword_imageCubeArray: case kKeyword_iimageCubeArray: case kKeyword_uimageCubeArray:
+        return true;
+    }
+    return false;
+}
+
+// A builtin returning nothing is only called for what it does, as are those
+// writing through a parameter or reading memory others write
+static bool isPure(const astFunction *function) {
+    if (((const astBuiltin*)function->returnType)->type == kKeyword_void)
+        return false;
+    for (size_t i = 0; i < function->parameters.size(); i++) {
+        const astFunctionParameter *parameter = function->parameters[i];
+        if (parameter->storage == kOut || parameter->storage == kInOut)
+            return false;
+        if (isOpaqueMemory(((const astBuiltin*)parameter->baseType)->type))
+            return false;
+    }
+    return true;
+}
+
+const builtinTable &builtinTable::instance() {
+    // Made by the first thread to get here, the others wait for it
+    static const builtinTable table;
+    return table;
+}
+
+builtinTable::builtinTable()
+    : m_parser((const builtinTable *)0)
+    , m_error(0)
+{
+    static const char *const kPrefixes[] = { "", "i", "u" };
+
+    // Each declaration in the source is of the specification before it
+    vector<const builtinSpec*> variables;
+    vector<const builtinSpec*> functions;
+    for (size_t i = 0; i < kBuiltinCount; i++) {
+        const builtinSpec &spec = kBuiltins[i];
+        const char *text = spec.declaration;
+        const bool scalars = strstr(text, "$gen") != 0;
+        const int sizes = strchr(text, '$') ? (scalars ? 4 : 3) : 1;
+        const int prefixes = strchr(text, '@') ? 3 : 1;
+        for (int prefix = 0; prefix < prefixes; prefix++) {
+            for (int size = 0; size < sizes; size++) {
+                expand(m_source, text, sizes == 1 || scalars ? size + 1 : size + 2, kPrefixes[prefix]);
+                (strchr(text, '(') ? functions : variables).push_back(&spec);
+            }
+        }
+    }
+
+    m_parser.reset(&m_source[0], m_source.size(), "builtins");
+    astTU *tu = m_parser.parse(astTU::kVertex);
+
+    // Types which are not in a declaration are made for the shaders
+    int last = 0;
+    for (size_t i = 0; i < kTypeNameCount; i++)
+        last = kTypeNames[i] > last ? kTypeNames[i] : last;
+    m_types.resize(last + 1);
+    for (size_t i = 0; i < kTypeNameCount; i++)
+        m_types[kTypeNames[i]] = m_parser.builtinType(kTypeNames[i]);
+
+    // Only when a declaration above is wrong, the shaders then have no builtins
+    if (!tu) {
+        m_error = m_parser.error();
+        return;
+    }
+    if (tu->globals.size() != variables.size() || tu->functions.size() != functions.size()) {
+        m_error = "builtins: the declarations parsed are not those of the specifications";
+        return;
+    }
+
+    m_declarations.resize(variables.size() + functions.size());
+    for (size_t i = 0; i < m_declarations.size(); i++) {
+        declaration &entry = m_declarations[i];
+        const bool variable = i < variables.size();
+        const builtinSpec *spec = variable ? variables[i] : functions[i - variables.size()];
+        entry.variable = variable ? tu->globals[i] : 0;
+        entry.function = variable ? 0 : tu->functions[i - variables.size()];
+        if (entry.function)
+            entry.function->isPure = isPure(entry.function);
+        entry.stages = spec->stages;
+        entry.version = spec->version;
+        entry.removed = spec->removed;
+    }
+
+    // Chained in the order they were declared in
+    m_byName.resize(m_parser.m_names.size());
+    for (size_t i = m_declarations.size(); i--; ) {
+        declaration &entry = m_declarations[i];
+        const unsigned id = interner::id(entry.variable ? entry.variable->name : entry.function->name);
+        entry.next = m_byName[id];
+        m_byName[id] = &entry;
+    }
+}
+
+bool builtinTable::declaration::in(int shaderType, int version, int profile) const {
+    // An ES version has the builtins of the desktop one it is nearest to
+    if (profile == kES)
+        version = version >= 320 ? 450 : version >= 310 ? 430 : version >= 300 ? 330 : 110;
+    if (!(stages & (1u << shaderType)) || version < this->version)
+        return false;
+    return !removed || version < removed || profile == kCompatibility;
+}
+
+}
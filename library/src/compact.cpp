@@ -0,0 +1,911 @@
+#include <string.h> // memcpy
+
+#include "glsl-parser/compact.h"
+#include "glsl-parser/lexer.h" // kKeyword_*, kOperator_*
+
+namespace glsl {
+
+double compactExpression::doubleValue() const {
+    double value;
+    memcpy(&value, asDouble, sizeof value);
+    return value;
+}
+
+compactTU::compactTU(const allocator *memory)
+    : shaderType(-1)
+    , version(-1)
+    , profile(-1)
+    , m_types(memory)
+    , m_variables(memory)
+    , m_layoutQualifiers(memory)
+    , m_functionPool(memory)
+    , m_extensionPool(memory)
+    , m_expressions(memory)
+    , m_statements(memory)
+    , m_children(memory)
+    , m_names(memory)
+{
+    memset(&extensions, 0, sizeof extensions);
+    memset(&structures, 0, sizeof structures);
+    memset(&interfaceBlocks, 0, sizeof interfaceBlocks);
+    memset(&globals, 0, sizeof globals);
+    memset(&functions, 0, sizeof functions);
+}
+
+template <typename T>
+static size_t poolBytes(const compactPool<T> &pool) {
+    return pool.size() * sizeof(T);
+}
+
+template <typename T>
+static void pointPool(compactPool<T> &pool, const vector<T> &held) {
+    pool.data = held.empty() ? 0 : &held[0];
+    pool.count = held.size();
+}
+
+void compactTU::point() {
+    pointPool(types, m_types);
+    pointPool(variables, m_variables);
+    pointPool(layoutQualifiers, m_layoutQualifiers);
+    pointPool(functionPool, m_functionPool);
+    pointPool(extensionPool, m_extensionPool);
+    pointPool(expressions, m_expressions);
+    pointPool(statements, m_statements);
+    pointPool(children, m_children);
+    pointPool(names, m_names);
+}
+
+size_t compactTU::bytes() const {
+    return poolBytes(types)
+         + poolBytes(variables)
+         + poolBytes(layoutQualifiers)
+         + poolBytes(functionPool)
+         + poolBytes(extensionPool)
+         + poolBytes(expressions)
+         + poolBytes(statements)
+         + poolBytes(children)
+         + poolBytes(names);
+}
+
+// Indices of what has already been copied, so variables, types and names
+// referred to from many places are only copied once
+struct compactIndices {
+    compactIndices(const allocator *memory);
+    unsigned find(const void *node) const; // 0 when not copied
+    void insert(const void *node, unsigned index);
+private:
+    size_t slot(const void *node) const;
+    vector<const void*> m_keys; // Open addressing, a power of two in size
+    vector<unsigned> m_values;
+    size_t m_count;
+};
+
+compactIndices::compactIndices(const allocator *memory)
+    : m_keys(memory)
+    , m_values(memory)
+    , m_count(0)
+{
+    m_keys.resize(256);
+    m_values.resize(256);
+}
+
+size_t compactIndices::slot(const void *node) const {
+    const size_t mask = m_keys.size() - 1;
+    size_t hash = size_t(node) >> 3;
+    hash ^= hash >> 16;
+    size_t index = (hash * 0x9E3779B1u) & mask;
+    while (m_keys[index] && m_keys[index] != node)
+        index = (index + 1) & mask;
+    return index;
+}
+
+unsigned compactIndices::find(const void *node) const {
+    const size_t index = slot(node);
+    return m_keys[index] ? m_values[index] : 0;
+}
+
+void compactIndices::insert(const void *node, unsigned index) {
+    if ((m_count + 1) * 2 > m_keys.size()) {
+        vector<const void*> keys(m_keys.memory());
+        vector<unsigned> values(m_keys.memory());
+        keys.resize(m_keys.size() * 2);
+        values.resize(m_keys.size() * 2);
+        for (size_t i = 0; i < m_keys.size(); i++) {
+            keys[i] = m_keys[i];
+            values[i] = m_values[i];
+        }
+        m_keys.resize(0);
+        m_keys.resize(keys.size());
+        m_values.resize(0);
+        m_values.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (!keys[i])
+                continue;
+            const size_t at = slot(keys[i]);
+            m_keys[at] = keys[i];
+            m_values[at] = values[i];
+        }
+    }
+    const size_t at = slot(node);
+    m_keys[at] = node;
+    m_values[at] = index;
+    m_count++;
+}
+
+struct compactBuilder {
+    compactBuilder(compactTU *tu);
+
+    unsigned name(const char *name);
+    unsigned type(const astType *type);
+    unsigned interfaceBlock(const astInterfaceBlock *block);
+    unsigned variable(const astVariable *variable);
+    unsigned layoutQualifier(const astLayoutQualifier *layoutQualifier);
+    unsigned function(const astFunction *function);
+    unsigned extension(const astExtensionDirective *extension);
+    unsigned expression(const astExpression *expression);
+    unsigned statement(const astStatement *statement);
+
+    // Children are placed before copying them, as copying them places
+    // their own children after
+    template <typename T>
+    compactRange range(const T *first, const T *last, unsigned (compactBuilder::*copy)(const T&));
+
+    unsigned structureChild(astStruct *const &structure) { return type(structure); }
+    unsigned interfaceBlockChild(astInterfaceBlock *const &block) { return interfaceBlock(block); }
+    unsigned fieldChild(astVariable *const &field) { return variable(field); }
+    unsigned parameterChild(astFunctionParameter *const &parameter) { return variable(parameter); }
+    unsigned localChild(astFunctionVariable *const &local) { return variable(local); }
+    unsigned globalChild(astGlobalVariable *const &global) { return variable(global); }
+    unsigned layoutQualifierChild(astLayoutQualifier *const &qualifier) { return layoutQualifier(qualifier); }
+    unsigned functionChild(astFunction *const &function) { return this->function(function); }
+    unsigned extensionChild(astExtensionDirective *const &extension) { return this->extension(extension); }
+    unsigned expressionChild(astExpression *const &expression) { return this->expression(expression); }
+    unsigned statementChild(astStatement *const &statement) { return this->statement(statement); }
+
+private:
+    compactTU *m_tu;
+    compactIndices m_copied;
+    compactIndices m_names;
+};
+
+compactBuilder::compactBuilder(compactTU *tu)
+    : m_tu(tu)
+    , m_copied(tu->m_children.memory())
+    , m_names(tu->m_children.memory())
+{
+}
+
+template <typename T>
+compactRange compactBuilder::range(const T *first, const T *last, unsigned (compactBuilder::*copy)(const T&)) {
+    compactRange range;
+    range.start = unsigned(m_tu->m_children.size());
+    range.count = unsigned(last - first);
+    m_tu->m_children.resize(range.start + range.count);
+    for (unsigned i = 0; first != last; ++first, ++i) {
+        // Copying can grow the children, so index them after
+        const unsigned index = (this->*copy)(*first);
+        m_tu->m_children[range.start + i] = index;
+    }
+    return range;
+}
+
+unsigned compactBuilder::name(const char *name) {
+    if (!name || !*name)
+        return 0;
+    if (unsigned offset = m_names.find(name))
+        return offset;
+    const unsigned offset = unsigned(m_tu->m_names.size());
+    const size_t length = strlen(name) + 1;
+    m_tu->m_names.resize(offset + length);
+    memcpy(&m_tu->m_names[offset], name, length);
+    m_names.insert(name, offset);
+    return offset;
+}
+
+unsigned compactBuilder::type(const astType *type) {
+    if (!type)
+        return 0;
+    if (unsigned index = m_copied.find(type))
+        return index;
+    const unsigned index = unsigned(m_tu->m_types.size());
+    m_tu->m_types.resize(index + 1);
+    m_copied.insert(type, index);
+    compactType copy;
+    memset(&copy, 0, sizeof copy);
+    copy.storage = -1;
+    if (type->kind == astType::kBuiltin) {
+        copy.kind = compactType::kBuiltin;
+        copy.keyword = ((const astBuiltin*)type)->type;
+    } else {
+        // Interface blocks are copied before anything can refer to them
+        copy.kind = compactType::kStruct;
+        const astStruct *structure = (const astStruct*)type;
+        copy.name = name(structure->name);
+        copy.fields = range(structure->fields.begin(), structure->fields.end(), &compactBuilder::fieldChild);
+    }
+    m_tu->m_types[index] = copy;
+    return index;
+}
+
+unsigned compactBuilder::interfaceBlock(const astInterfaceBlock *block) {
+    const unsigned index = unsigned(m_tu->m_types.size());
+    m_tu->m_types.resize(index + 1);
+    m_copied.insert(block, index);
+    compactType copy;
+    memset(&copy, 0, sizeof copy);
+    copy.kind = compactType::kInterfaceBlock;
+    copy.name = name(block->name);
+    copy.storage = block->storage;
+    copy.fields = range(block->fields.begin(), block->fields.end(), &compactBuilder::fieldChild);
+    m_tu->m_types[index] = copy;
+    return index;
+}
+
+unsigned compactBuilder::variable(const astVariable *variable) {
+    if (!variable)
+        return 0;
+    if (unsigned index = m_copied.find(variable))
+        return index;
+    const unsigned index = unsigned(m_tu->m_variables.size());
+    m_tu->m_variables.resize(index + 1);
+    m_copied.insert(variable, index);
+    compactVariable copy;
+    memset(&copy, 0, sizeof copy);
+    copy.type = variable->type;
+    copy.name = name(variable->name);
+    copy.baseType = type(variable->baseType);
+    copy.arraySizes = range(variable->arraySizes.begin(), variable->arraySizes.end(), &compactBuilder::expressionChild);
+    copy.isArray = variable->isArray;
+    copy.isPrecise = variable->isPrecise;
+    copy.storage = -1;
+    copy.auxiliary = -1;
+    copy.precision = -1;
+    copy.interpolation = -1;
+    switch (variable->type) {
+    case astVariable::kFunction: {
+        const astFunctionVariable *local = (const astFunctionVariable*)variable;
+        copy.isConst = local->isConst;
+        copy.initialValue = expression(local->initialValue);
+        break;
+    }
+    case astVariable::kParameter: {
+        const astFunctionParameter *parameter = (const astFunctionParameter*)variable;
+        copy.storage = (signed char)parameter->storage;
+        copy.auxiliary = (signed char)parameter->auxiliary;
+        copy.memory = (unsigned char)parameter->memory;
+        copy.precision = (signed char)parameter->precision;
+        break;
+    }
+    case astVariable::kGlobal: {
+        const astGlobalVariable *global = (const astGlobalVariable*)variable;
+        copy.storage = (signed char)global->storage;
+        copy.auxiliary = (signed char)global->auxiliary;
+        copy.memory = (unsigned char)global->memory;
+        copy.precision = (signed char)global->precision;
+        copy.interpolation = (signed char)global->interpolation;
+        copy.isInvariant = global->isInvariant;
+        copy.initialValue = expression(global->initialValue);
+        copy.layoutQualifiers = range(global->layoutQualifiers.begin(), global->layoutQualifiers.end(), &compactBuilder::layoutQualifierChild);
+        break;
+    }
+    }
+    m_tu->m_variables[index] = copy;
+    return index;
+}
+
+unsigned compactBuilder::layoutQualifier(const astLayoutQualifier *layoutQualifier) {
+    compactLayoutQualifier copy;
+    copy.name = name(layoutQualifier->name);
+    copy.initialValue = expression(layoutQualifier->initialValue);
+    m_tu->m_layoutQualifiers.push_back(copy);
+    return unsigned(m_tu->m_layoutQualifiers.size() - 1);
+}
+
+unsigned compactBuilder::function(const astFunction *function) {
+    compactFunction copy;
+    memset(&copy, 0, sizeof copy);
+    copy.returnType = type(function->returnType);
+    copy.name = name(function->name);
+    copy.parameters = range(function->parameters.begin(), function->parameters.end(), &compactBuilder::parameterChild);
+    copy.statements = range(function->statements.begin(), function->statements.end(), &compactBuilder::statementChild);
+    copy.isPrototype = function->isPrototype;
+    m_tu->m_functionPool.push_back(copy);
+    return unsigned(m_tu->m_functionPool.size() - 1);
+}
+
+unsigned compactBuilder::extension(const astExtensionDirective *extension) {
+    compactExtension copy;
+    copy.name = name(extension->name);
+    copy.behavior = extension->behavior;
+    m_tu->m_extensionPool.push_back(copy);
+    return unsigned(m_tu->m_extensionPool.size() - 1);
+}
+
+unsigned compactBuilder::expression(const astExpression *expression) {
+    if (!expression)
+        return 0;
+    compactExpression copy;
+    memset(&copy, 0, sizeof copy);
+    copy.type = expression->type;
+    switch (expression->type) {
+    case astExpression::kIntConstant:
+        copy.asInt = ((const astIntConstant*)expression)->value;
+        break;
+    case astExpression::kUIntConstant:
+        copy.asUInt = ((const astUIntConstant*)expression)->value;
+        break;
+    case astExpression::kFloatConstant:
+        copy.asFloat = ((const astFloatConstant*)expression)->value;
+        break;
+    case astExpression::kDoubleConstant:
+        memcpy(copy.asDouble, &((const astDoubleConstant*)expression)->value, sizeof copy.asDouble);
+        break;
+    case astExpression::kBoolConstant:
+        copy.asBool = ((const astBoolConstant*)expression)->value;
+        break;
+    case astExpression::kVariableIdentifier:
+        copy.asVariable = variable(((const astVariableIdentifier*)expression)->variable);
+        break;
+    case astExpression::kFieldOrSwizzle: {
+        const astFieldOrSwizzle *field = (const astFieldOrSwizzle*)expression;
+        copy.asFieldOrSwizzle.operand = this->expression(field->operand);
+        copy.asFieldOrSwizzle.name = name(field->name);
+        break;
+    }
+    case astExpression::kArraySubscript: {
+        const astArraySubscript *subscript = (const astArraySubscript*)expression;
+        copy.asArraySubscript.operand = this->expression(subscript->operand);
+        copy.asArraySubscript.index = this->expression(subscript->index);
+        break;
+    }
+    case astExpression::kFunctionCall: {
+        const astFunctionCall *call = (const astFunctionCall*)expression;
+        copy.asFunctionCall.name = name(call->name);
+        copy.asFunctionCall.parameters = range(call->parameters.begin(), call->parameters.end(), &compactBuilder::expressionChild);
+        break;
+    }
+    case astExpression::kConstructorCall: {
+        const astConstructorCall *call = (const astConstructorCall*)expression;
+        copy.asConstructorCall.type = type(call->type);
+        copy.asConstructorCall.parameters = range(call->parameters.begin(), call->parameters.end(), &compactBuilder::expressionChild);
+        break;
+    }
+    case astExpression::kPostIncrement:
+    case astExpression::kPostDecrement:
+    case astExpression::kUnaryMinus:
+    case astExpression::kUnaryPlus:
+    case astExpression::kBitNot:
+    case astExpression::kLogicalNot:
+    case astExpression::kPrefixIncrement:
+    case astExpression::kPrefixDecrement:
+        copy.asUnary = this->expression(((const astUnaryExpression*)expression)->operand);
+        break;
+    case astExpression::kSequence:
+    case astExpression::kAssign:
+    case astExpression::kOperation: {
+        const astBinaryExpression *binary = (const astBinaryExpression*)expression;
+        copy.asBinary.operand1 = this->expression(binary->operand1);
+        copy.asBinary.operand2 = this->expression(binary->operand2);
+        if (expression->type == astExpression::kAssign)
+            copy.asBinary.operation = ((const astAssignmentExpression*)expression)->assignment;
+        else if (expression->type == astExpression::kOperation)
+            copy.asBinary.operation = ((const astOperationExpression*)expression)->operation;
+        break;
+    }
+    case astExpression::kTernary: {
+        const astTernaryExpression *ternary = (const astTernaryExpression*)expression;
+        copy.asTernary.condition = this->expression(ternary->condition);
+        copy.asTernary.onTrue = this->expression(ternary->onTrue);
+        copy.asTernary.onFalse = this->expression(ternary->onFalse);
+        break;
+    }
+    }
+    m_tu->m_expressions.push_back(copy);
+    return unsigned(m_tu->m_expressions.size() - 1);
+}
+
+unsigned compactBuilder::statement(const astStatement *statement) {
+    if (!statement)
+        return 0;
+    compactStatement copy;
+    memset(&copy, 0, sizeof copy);
+    copy.type = statement->type;
+    switch (statement->type) {
+    case astStatement::kCompound: {
+        const astCompoundStatement *compound = (const astCompoundStatement*)statement;
+        copy.asCompound = range(compound->statements.begin(), compound->statements.end(), &compactBuilder::statementChild);
+        break;
+    }
+    case astStatement::kDeclaration: {
+        const astDeclarationStatement *declaration = (const astDeclarationStatement*)statement;
+        copy.asDeclaration = range(declaration->variables.begin(), declaration->variables.end(), &compactBuilder::localChild);
+        break;
+    }
+    case astStatement::kExpression:
+        copy.asExpression = expression(((const astExpressionStatement*)statement)->expression);
+        break;
+    case astStatement::kIf: {
+        const astIfStatement *ifStatement = (const astIfStatement*)statement;
+        copy.asIf.condition = expression(ifStatement->condition);
+        copy.asIf.thenStatement = this->statement(ifStatement->thenStatement);
+        copy.asIf.elseStatement = this->statement(ifStatement->elseStatement);
+        break;
+    }
+    case astStatement::kSwitch: {
+        const astSwitchStatement *switchStatement = (const astSwitchStatement*)statement;
+        copy.asSwitch.expression = expression(switchStatement->expression);
+        copy.asSwitch.statements = range(switchStatement->statements.begin(), switchStatement->statements.end(), &compactBuilder::statementChild);
+        break;
+    }
+    case astStatement::kCaseLabel: {
+        const astCaseLabelStatement *caseLabel = (const astCaseLabelStatement*)statement;
+        copy.asCaseLabel.condition = expression(caseLabel->condition);
+        copy.asCaseLabel.isDefault = caseLabel->isDefault;
+        break;
+    }
+    case astStatement::kWhile: {
+        const astWhileStatement *whileStatement = (const astWhileStatement*)statement;
+        copy.asWhile.condition = this->statement(whileStatement->condition);
+        copy.asWhile.body = this->statement(whileStatement->body);
+        break;
+    }
+    case astStatement::kDo: {
+        const astDoStatement *doStatement = (const astDoStatement*)statement;
+        copy.asDo.body = this->statement(doStatement->body);
+        copy.asDo.condition = expression(doStatement->condition);
+        break;
+    }
+    case astStatement::kFor: {
+        const astForStatement *forStatement = (const astForStatement*)statement;
+        copy.asFor.init = this->statement(forStatement->init);
+        copy.asFor.condition = expression(forStatement->condition);
+        copy.asFor.loop = expression(forStatement->loop);
+        copy.asFor.body = this->statement(forStatement->body);
+        break;
+    }
+    case astStatement::kReturn:
+        copy.asReturn = expression(((const astReturnStatement*)statement)->expression);
+        break;
+    }
+    m_tu->m_statements.push_back(copy);
+    return unsigned(m_tu->m_statements.size() - 1);
+}
+
+void compactTU::build(const astTU *tu) {
+    m_types.resize(0);
+    m_variables.resize(0);
+    m_layoutQualifiers.resize(0);
+    m_functionPool.resize(0);
+    m_extensionPool.resize(0);
+    m_expressions.resize(0);
+    m_statements.resize(0);
+    m_children.resize(0);
+    m_names.resize(0);
+
+    // Index 0 of every pool is no node and offset 0 of the names is ""
+    m_types.resize(1);
+    m_variables.resize(1);
+    m_layoutQualifiers.resize(1);
+    m_functionPool.resize(1);
+    m_extensionPool.resize(1);
+    m_expressions.resize(1);
+    m_statements.resize(1);
+    m_names.resize(1);
+
+    shaderType = tu->type;
+    version = tu->versionDirective ? tu->versionDirective->version : -1;
+    profile = tu->versionDirective ? tu->versionDirective->type : -1;
+
+    compactBuilder builder(this);
+    extensions = builder.range(tu->extensionDirectives.begin(), tu->extensionDirectives.end(), &compactBuilder::extensionChild);
+    structures = builder.range(tu->structures.begin(), tu->structures.end(), &compactBuilder::structureChild);
+    interfaceBlocks = builder.range(tu->interfaceBlocks.begin(), tu->interfaceBlocks.end(), &compactBuilder::interfaceBlockChild);
+    globals = builder.range(tu->globals.begin(), tu->globals.end(), &compactBuilder::globalChild);
+    functions = builder.range(tu->functions.begin(), tu->functions.end(), &compactBuilder::functionChild);
+    point();
+}
+
+static const char kImageMagic[8] = { 'G', 'L', 'S', 'L', 'T', 'R', 'E', 'E' };
+static const unsigned kImageVersion = 1; // Bump when a node, astExpression::k* or the lexemes change
+
+struct compactImageHeader {
+    char magic[8];
+    unsigned version;
+    unsigned layout;
+    int shaderType;
+    int glslVersion;
+    int profile;
+    compactRange extensions;
+    compactRange structures;
+    compactRange interfaceBlocks;
+    compactRange globals;
+    compactRange functions;
+    unsigned counts[9]; // Of the pools, in the order they follow the header
+};
+
+// Images are only read by builds which lay out the nodes the same
+static unsigned imageLayout() {
+    const size_t sizes[] = {
+        sizeof(compactType),
+        sizeof(compactVariable),
+        sizeof(compactLayoutQualifier),
+        sizeof(compactFunction),
+        sizeof(compactExtension),
+        sizeof(compactExpression),
+        sizeof(compactStatement),
+        sizeof(compactImageHeader)
+    };
+    const unsigned one = 1;
+    unsigned layout = *(const unsigned char *)&one;
+    for (size_t i = 0; i < sizeof sizes / sizeof *sizes; i++)
+        layout = layout * 31 + unsigned(sizes[i]);
+    return layout;
+}
+
+static inline unsigned long long imagePadded(unsigned long long size) {
+    return (size + 7) & ~7ull;
+}
+
+static void appendSection(vector<unsigned char> &image, const void *data, size_t size) {
+    const size_t at = image.size();
+    image.resize(size_t(imagePadded(at + size)));
+    if (size)
+        memcpy(&image[at], data, size);
+}
+
+template <typename T>
+static void appendPool(vector<unsigned char> &image, const compactPool<T> &pool) {
+    appendSection(image, pool.data, pool.count * sizeof(T));
+}
+
+template <typename T>
+static void loadPool(compactPool<T> &pool, const unsigned char *&at, unsigned count) {
+    pool.data = (const T *)at;
+    pool.count = count;
+    at += imagePadded(count * (unsigned long long)sizeof(T));
+}
+
+bool compactTU::save(vector<unsigned char> &image) const {
+    if (!types.count)
+        return false;
+
+    compactImageHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, kImageMagic, sizeof header.magic);
+    header.version = kImageVersion;
+    header.layout = imageLayout();
+    header.shaderType = shaderType;
+    header.glslVersion = version;
+    header.profile = profile;
+    header.extensions = extensions;
+    header.structures = structures;
+    header.interfaceBlocks = interfaceBlocks;
+    header.globals = globals;
+    header.functions = functions;
+    header.counts[0] = unsigned(types.count);
+    header.counts[1] = unsigned(variables.count);
+    header.counts[2] = unsigned(layoutQualifiers.count);
+    header.counts[3] = unsigned(functionPool.count);
+    header.counts[4] = unsigned(extensionPool.count);
+    header.counts[5] = unsigned(expressions.count);
+    header.counts[6] = unsigned(statements.count);
+    header.counts[7] = unsigned(children.count);
+    header.counts[8] = unsigned(names.count);
+
+    image.resize(0);
+    appendSection(image, &header, sizeof header);
+    appendPool(image, types);
+    appendPool(image, variables);
+    appendPool(image, layoutQualifiers);
+    appendPool(image, functionPool);
+    appendPool(image, extensionPool);
+    appendPool(image, expressions);
+    appendPool(image, statements);
+    appendPool(image, children);
+    appendPool(image, names);
+    return true;
+}
+
+// The tags of builtin types and operations read from an image are below these
+#undef KEYWORD
+#define KEYWORD(X) kKeyword_##X,
+static const int kKeywords[] = {
+    #include "glsl-parser/lexemes.h"
+};
+#undef KEYWORD
+#define KEYWORD(...)
+static const int kKeywordCount = int(sizeof kKeywords / sizeof *kKeywords);
+
+#undef OPERATOR
+#define OPERATOR(X, ...) kOperator_##X,
+static const int kOperators[] = {
+    #include "glsl-parser/lexemes.h"
+};
+#undef OPERATOR
+#define OPERATOR(...)
+static const int kOperatorCount = int(sizeof kOperators / sizeof *kOperators);
+
+static bool inChildren(const compactRange &range, unsigned children) {
+    return (unsigned long long)range.start + range.count <= children;
+}
+
+// Any other byte in a bool is undefined to read
+static bool isBool(const bool &value) {
+    unsigned char byte;
+    memcpy(&byte, &value, 1);
+    return byte <= 1;
+}
+
+// Every node of an image refers only to what is in it: indices into their
+// pools, ranges into the children, offsets into the names, the tags the
+// readers switch or index on and the bools. Expressions and statements only
+// refer to ones of their own pool placed before them, so following them
+// always ends. The ranges of an image built here hold each child once, so no
+// more children are checked than there are and this stays linear.
+struct compactChecker {
+    compactChecker(const compactTU &tu);
+    bool check();
+
+private:
+    template <typename T>
+    bool in(unsigned index, const compactPool<T> &pool) const { return index < pool.count; }
+    bool name(unsigned offset) const { return offset < m_tu.names.count; }
+    bool range(const compactRange &range, unsigned bound);
+    template <typename T>
+    bool range(const compactRange &range, const compactPool<T> &pool) { return this->range(range, unsigned(pool.count)); }
+
+    bool type(const compactType &type);
+    bool variable(const compactVariable &variable);
+    bool expression(const compactExpression &expression, unsigned index);
+    bool statement(const compactStatement &statement, unsigned index);
+
+    const compactTU &m_tu;
+    unsigned m_unclaimed; // Children not in any range yet
+};
+
+compactChecker::compactChecker(const compactTU &tu)
+    : m_tu(tu)
+    , m_unclaimed(unsigned(tu.children.count))
+{
+}
+
+// The children of the range are below bound
+bool compactChecker::range(const compactRange &range, unsigned bound) {
+    if (!inChildren(range, unsigned(m_tu.children.count)) || range.count > m_unclaimed)
+        return false;
+    m_unclaimed -= range.count;
+    for (unsigned i = 0; i < range.count; i++)
+        if (m_tu.child(range, i) >= bound)
+            return false;
+    return true;
+}
+
+// Every part is checked whatever the kind, the structures and interface
+// blocks are read without looking at it
+bool compactChecker::type(const compactType &type) {
+    if (!name(type.name) || !range(type.fields, m_tu.variables))
+        return false;
+    switch (type.kind) {
+    case compactType::kBuiltin:
+        return type.keyword >= 0 && type.keyword < kKeywordCount;
+    case compactType::kStruct:
+    case compactType::kInterfaceBlock:
+        return true;
+    }
+    return false;
+}
+
+bool compactChecker::variable(const compactVariable &variable) {
+    return variable.type >= astVariable::kFunction && variable.type <= astVariable::kField
+        && name(variable.name)
+        && isBool(variable.isArray)
+        && isBool(variable.isPrecise)
+        && isBool(variable.isConst)
+        && isBool(variable.isInvariant)
+        && in(variable.baseType, m_tu.types)
+        && in(variable.initialValue, m_tu.expressions)
+        && range(variable.arraySizes, m_tu.expressions)
+        && range(variable.layoutQualifiers, m_tu.layoutQualifiers);
+}
+
+bool compactChecker::expression(const compactExpression &expression, unsigned index) {
+    switch (expression.type) {
+    case astExpression::kIntConstant:
+    case astExpression::kUIntConstant:
+    case astExpression::kFloatConstant:
+    case astExpression::kDoubleConstant:
+        return true;
+    case astExpression::kBoolConstant:
+        return isBool(expression.asBool);
+    case astExpression::kVariableIdentifier:
+        return in(expression.asVariable, m_tu.variables);
+    case astExpression::kFieldOrSwizzle:
+        return expression.asFieldOrSwizzle.operand < index && name(expression.asFieldOrSwizzle.name);
+    case astExpression::kArraySubscript:
+        return expression.asArraySubscript.operand < index && expression.asArraySubscript.index < index;
+    case astExpression::kFunctionCall:
+        return name(expression.asFunctionCall.name) && range(expression.asFunctionCall.parameters, index);
+    case astExpression::kConstructorCall:
+        return in(expression.asConstructorCall.type, m_tu.types) && range(expression.asConstructorCall.parameters, index);
+    case astExpression::kPostIncrement:
+    case astExpression::kPostDecrement:
+    case astExpression::kUnaryMinus:
+    case astExpression::kUnaryPlus:
+    case astExpression::kBitNot:
+    case astExpression::kLogicalNot:
+    case astExpression::kPrefixIncrement:
+    case astExpression::kPrefixDecrement:
+        return expression.asUnary < index;
+    case astExpression::kSequence:
+    case astExpression::kAssign:
+    case astExpression::kOperation:
+        return expression.asBinary.operand1 < index && expression.asBinary.operand2 < index
+            && expression.asBinary.operation >= 0 && expression.asBinary.operation < kOperatorCount;
+    case astExpression::kTernary:
+        return expression.asTernary.condition < index
+            && expression.asTernary.onTrue < index
+            && expression.asTernary.onFalse < index;
+    }
+    return false;
+}
+
+bool compactChecker::statement(const compactStatement &statement, unsigned index) {
+    switch (statement.type) {
+    case astStatement::kCompound:
+        return range(statement.asCompound, index);
+    case astStatement::kEmpty:
+    case astStatement::kContinue:
+    case astStatement::kBreak:
+    case astStatement::kDiscard:
+        return true;
+    case astStatement::kDeclaration:
+        return range(statement.asDeclaration, m_tu.variables);
+    case astStatement::kExpression:
+        return in(statement.asExpression, m_tu.expressions);
+    case astStatement::kIf:
+        return in(statement.asIf.condition, m_tu.expressions)
+            && statement.asIf.thenStatement < index
+            && statement.asIf.elseStatement < index;
+    case astStatement::kSwitch:
+        return in(statement.asSwitch.expression, m_tu.expressions) && range(statement.asSwitch.statements, index);
+    case astStatement::kCaseLabel:
+        return in(statement.asCaseLabel.condition, m_tu.expressions) && isBool(statement.asCaseLabel.isDefault);
+    case astStatement::kWhile:
+        return statement.asWhile.condition < index && statement.asWhile.body < index;
+    case astStatement::kDo:
+        return statement.asDo.body < index && in(statement.asDo.condition, m_tu.expressions);
+    case astStatement::kFor:
+        return statement.asFor.init < index
+            && in(statement.asFor.condition, m_tu.expressions)
+            && in(statement.asFor.loop, m_tu.expressions)
+            && statement.asFor.body < index;
+    case astStatement::kReturn:
+        return in(statement.asReturn, m_tu.expressions);
+    }
+    return false;
+}
+
+bool compactChecker::check() {
+    if (!range(m_tu.extensions, m_tu.extensionPool)
+        || !range(m_tu.structures, m_tu.types)
+        || !range(m_tu.interfaceBlocks, m_tu.types)
+        || !range(m_tu.globals, m_tu.variables)
+        || !range(m_tu.functions, m_tu.functionPool))
+        return false;
+    for (size_t i = 0; i < m_tu.types.count; i++)
+        if (!type(m_tu.types[i]))
+            return false;
+    for (size_t i = 0; i < m_tu.variables.count; i++)
+        if (!variable(m_tu.variables[i]))
+            return false;
+    for (size_t i = 0; i < m_tu.layoutQualifiers.count; i++) {
+        const compactLayoutQualifier &qualifier = m_tu.layoutQualifiers[i];
+        if (!name(qualifier.name) || !in(qualifier.initialValue, m_tu.expressions))
+            return false;
+    }
+    for (size_t i = 0; i < m_tu.functionPool.count; i++) {
+        const compactFunction &function = m_tu.functionPool[i];
+        if (!in(function.returnType, m_tu.types)
+            || !name(function.name)
+            || !isBool(function.isPrototype)
+            || !range(function.parameters, m_tu.variables)
+            || !range(function.statements, m_tu.statements))
+            return false;
+    }
+    for (size_t i = 0; i < m_tu.extensionPool.count; i++)
+        if (!name(m_tu.extensionPool[i].name))
+            return false;
+    for (size_t i = 0; i < m_tu.expressions.count; i++)
+        if (!expression(m_tu.expressions[i], unsigned(i)))
+            return false;
+    for (size_t i = 0; i < m_tu.statements.count; i++)
+        if (!statement(m_tu.statements[i], unsigned(i)))
+            return false;
+    return true;
+}
+
+bool compactTU::load(const void *image, size_t size) {
+    const unsigned char *data = (const unsigned char *)image;
+    compactImageHeader header;
+    if (!data || size < sizeof header || size_t(data) % sizeof(unsigned))
+        return false;
+    memcpy(&header, data, sizeof header);
+    if (memcmp(header.magic, kImageMagic, sizeof header.magic)
+        || header.version != kImageVersion
+        || header.layout != imageLayout())
+        return false;
+
+    const size_t sizes[] = {
+        sizeof(compactType),
+        sizeof(compactVariable),
+        sizeof(compactLayoutQualifier),
+        sizeof(compactFunction),
+        sizeof(compactExtension),
+        sizeof(compactExpression),
+        sizeof(compactStatement),
+        sizeof(unsigned),
+        sizeof(char)
+    };
+    unsigned long long total = imagePadded(sizeof header);
+    for (size_t i = 0; i < sizeof sizes / sizeof *sizes; i++)
+        total += imagePadded(header.counts[i] * (unsigned long long)sizes[i]);
+    if (total != size)
+        return false;
+
+    const unsigned nameCount = header.counts[8];
+    const char *nameData = (const char *)data + size - imagePadded(nameCount);
+    if (!header.counts[0] || !nameCount || nameData[nameCount - 1])
+        return false;
+
+    // Read into another until every node is checked, this is left as it was
+    // when they are not
+    compactTU loaded;
+    const unsigned char *at = data + imagePadded(sizeof header);
+    loadPool(loaded.types, at, header.counts[0]);
+    loadPool(loaded.variables, at, header.counts[1]);
+    loadPool(loaded.layoutQualifiers, at, header.counts[2]);
+    loadPool(loaded.functionPool, at, header.counts[3]);
+    loadPool(loaded.extensionPool, at, header.counts[4]);
+    loadPool(loaded.expressions, at, header.counts[5]);
+    loadPool(loaded.statements, at, header.counts[6]);
+    loadPool(loaded.children, at, header.counts[7]);
+    loadPool(loaded.names, at, header.counts[8]);
+    loaded.extensions = header.extensions;
+    loaded.structures = header.structures;
+    loaded.interfaceBlocks = header.interfaceBlocks;
+    loaded.globals = header.globals;
+    loaded.functions = header.functions;
+    if (!compactChecker(loaded).check())
+        return false;
+
+    shaderType = header.shaderType;
+    version = header.glslVersion;
+    profile = header.profile;
+    extensions = loaded.extensions;
+    structures = loaded.structures;
+    interfaceBlocks = loaded.interfaceBlocks;
+    globals = loaded.globals;
+    functions = loaded.functions;
+    types = loaded.types;
+    variables = loaded.variables;
+    layoutQualifiers = loaded.layoutQualifiers;
+    functionPool = loaded.functionPool;
+    extensionPool = loaded.extensionPool;
+    expressions = loaded.expressions;
+    statements = loaded.statements;
+    children = loaded.children;
+    names = loaded.names;
+
+    m_types.resize(0);
+    m_variables.resize(0);
+    m_layoutQualifiers.resize(0);
+    m_functionPool.resize(0);
+    m_extensionPool.resize(0);
+    m_expressions.resize(0);
+    m_statements.resize(0);
+    m_children.resize(0);
+    m_names.resize(0);
+    return true;
+}
+
+}
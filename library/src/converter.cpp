@@ -1,5 +1,6 @@
 #include "glsl-parser/converter.h"
 #include "glsl-parser/ast.h"
+#include "glsl-parser/compact.h"
 #include "glsl-parser/lexer.h"
 #include "glsl-parser/util.h"
 #include <cstring>
@@ -91,17 +92,36 @@ inline const char* memoryToString(int memory) {
 }
 
 inline const char* astTypeToString(astType* type) {
-    if (type->builtin) {
+    if (type->kind == astType::kBuiltin) {
         astBuiltin* builtin = static_cast<astBuiltin*>(type);
         return builtinKeywordMap[builtin->type];
-    } else if (astStruct* structure = reinterpret_cast<astStruct*>(type)) {
-        return structure->name;
+    } else if (type->kind == astType::kStruct) {
+        return static_cast<astStruct*>(type)->name;
+    } else if (type->kind == astType::kInterfaceBlock) {
+        return static_cast<astInterfaceBlock*>(type)->name;
     }
 
     return "unknown_type";
 }
 
-inline void expandParameters(vector<astExpression*> parameters, indent_aware_stringbuilder& sb) {
+// Numbers are formatted on the stack, nothing is allocated for them
+template <typename T>
+inline void numberToString(const char* fmt, T value, indent_aware_stringbuilder& sb) {
+    char buffer[64];
+    snprintf(buffer, sizeof buffer, fmt, value);
+    sb += buffer;
+}
+
+inline void floatConstantToString(float value, indent_aware_stringbuilder& sb) {
+    char format[64];
+    snprintf(format, sizeof format, "%g", value);
+    if (!strchr(format, '.'))
+        numberToString("%g.0", value, sb);
+    else
+        sb += format;
+}
+
+inline void expandParameters(const astArray<astExpression*, 4> &parameters, indent_aware_stringbuilder& sb) {
     sb += "(";
     if (!parameters.size()) {
         for (size_t i = 0; i < parameters.size(); ++i) {
@@ -130,27 +150,19 @@ inline void decrementExpression(astUnaryExpression* expr, indent_aware_stringbui
 inline void astExpressionToString(astExpression* expression, indent_aware_stringbuilder& sb) {
     switch (expression->type) {
         case EXPRC(Int):
-            sb += ntoa("%i", reinterpret_cast<astIntConstant*>(expression)->value);
+            numberToString("%i", reinterpret_cast<astIntConstant*>(expression)->value, sb);
         break;
         
         case EXPRC(UInt):
-            sb += ntoa("%u", reinterpret_cast<astUIntConstant*>(expression)->value);
+            numberToString("%u", reinterpret_cast<astUIntConstant*>(expression)->value, sb);
         break;
         
         case EXPRC(Float):
-        {
-            astFloatConstant* floatExpression = reinterpret_cast<astFloatConstant*>(expression);
-            char format[1024];
-            snprintf(format, sizeof format, "%g", floatExpression->value);
-            if (!strchr(format, '.'))
-                sb += ntoa("%g.0", floatExpression->value);
-            else
-                sb += ntoa("%f", format);
-        }
+            floatConstantToString(reinterpret_cast<astFloatConstant*>(expression)->value, sb);
         break;
 
         case EXPRC(Double):
-            sb += ntoa("%g", reinterpret_cast<astDoubleConstant*>(expression)->value);
+            numberToString("%g", reinterpret_cast<astDoubleConstant*>(expression)->value, sb);
         break;
 
         case EXPRC(Bool):
@@ -499,7 +511,335 @@ inline void astStatementToString(astStatement* statement, indent_aware_stringbui
     }
 }
 
-converter::converter() : stringBuffer(indent_aware_stringbuilder()) { }
+// The same over a compactTU, where nodes are indices
+
+inline void compactExpressionToString(const compactTU&, unsigned, indent_aware_stringbuilder&);
+inline void compactStatementToString(const compactTU&, unsigned, indent_aware_stringbuilder&, int = kDefault);
+
+inline const char* compactTypeToString(const compactTU& tu, unsigned index) {
+    const compactType& type = tu.type(index);
+    if (type.kind == compactType::kBuiltin)
+        return builtinKeywordMap[type.keyword];
+    return tu.name(type.name);
+}
+
+inline void compactParametersToString(const compactTU& tu, const compactRange& parameters, indent_aware_stringbuilder& sb) {
+    sb += "(";
+    if (!parameters.count) {
+        for (size_t i = 0; i < parameters.count; ++i) {
+            compactExpressionToString(tu, tu.child(parameters, i), sb);
+            if (i != parameters.count - 1)
+                sb += ", ";
+        }
+    }
+    sb += ")";
+}
+
+inline void compactExpressionToString(const compactTU& tu, unsigned index, indent_aware_stringbuilder& sb) {
+    const compactExpression& expression = tu.expression(index);
+    switch (expression.type) {
+        case EXPRC(Int):
+            numberToString("%i", expression.asInt, sb);
+        break;
+
+        case EXPRC(UInt):
+            numberToString("%u", expression.asUInt, sb);
+        break;
+
+        case EXPRC(Float):
+            floatConstantToString(expression.asFloat, sb);
+        break;
+
+        case EXPRC(Double):
+            numberToString("%g", expression.doubleValue(), sb);
+        break;
+
+        case EXPRC(Bool):
+            sb += expression.asBool ? "true" : "false";
+        break;
+
+        case EXPRN(VariableIdentifier):
+        {
+            const compactVariable& variable = tu.variable(expression.asVariable);
+            if (variable.isPrecise) sb.append("precise ");
+            sb += tu.name(variable.name);
+        }
+        break;
+
+        case EXPRN(FieldOrSwizzle):
+            compactExpressionToString(tu, expression.asFieldOrSwizzle.operand, sb);
+            sb += ".";
+            sb += tu.name(expression.asFieldOrSwizzle.name);
+        break;
+
+        case EXPRN(ArraySubscript):
+            compactExpressionToString(tu, expression.asArraySubscript.operand, sb);
+            sb += "[";
+            compactExpressionToString(tu, expression.asArraySubscript.index, sb);
+            sb += "]";
+        break;
+
+        case EXPRN(FunctionCall):
+            sb += tu.name(expression.asFunctionCall.name);
+            compactParametersToString(tu, expression.asFunctionCall.parameters, sb);
+        break;
+
+        case EXPRN(ConstructorCall):
+            sb += compactTypeToString(tu, expression.asConstructorCall.type);
+            compactParametersToString(tu, expression.asConstructorCall.parameters, sb);
+        break;
+
+        case EXPRN(PostIncrement):
+            compactExpressionToString(tu, expression.asUnary, sb);
+            sb += operatorMap[5];
+        break;
+
+        case EXPRN(PostDecrement):
+            compactExpressionToString(tu, expression.asUnary, sb);
+            sb += operatorMap[6];
+        break;
+
+        case EXPRN(UnaryMinus):
+            sb += operatorMap[13];
+            compactExpressionToString(tu, expression.asUnary, sb);
+        break;
+
+        case EXPRN(UnaryPlus):
+            sb += operatorMap[12];
+            compactExpressionToString(tu, expression.asUnary, sb);
+        break;
+
+        case EXPRN(BitNot):
+            sb += operatorMap[7];
+            compactExpressionToString(tu, expression.asUnary, sb);
+        break;
+
+        case EXPRN(LogicalNot):
+            sb += operatorMap[8];
+            compactExpressionToString(tu, expression.asUnary, sb);
+        break;
+
+        case EXPRN(PrefixIncrement):
+            sb += operatorMap[5];
+            compactExpressionToString(tu, expression.asUnary, sb);
+        break;
+
+        case EXPRN(PrefixDecrement):
+            sb += operatorMap[6];
+            compactExpressionToString(tu, expression.asUnary, sb);
+        break;
+
+        case EXPRN(Assign):
+        case EXPRN(Operation):
+            compactExpressionToString(tu, expression.asBinary.operand1, sb);
+            sb += " ";
+            sb += operatorMap[expression.asBinary.operation];
+            sb += " ";
+            compactExpressionToString(tu, expression.asBinary.operand2, sb);
+        break;
+
+        case EXPRN(Sequence):
+            sb += "(";
+            compactExpressionToString(tu, expression.asBinary.operand1, sb);
+            sb += ", ";
+            compactExpressionToString(tu, expression.asBinary.operand2, sb);
+            sb += ")";
+        break;
+
+        case EXPRN(Ternary):
+            sb += "(";
+            compactExpressionToString(tu, expression.asTernary.condition, sb);
+            sb += " ? ";
+            compactExpressionToString(tu, expression.asTernary.onTrue, sb);
+            sb += " : ";
+            compactExpressionToString(tu, expression.asTernary.onFalse, sb);
+            sb += ")";
+        break;
+    }
+}
+
+inline void compactVariableToString(const compactTU& tu, unsigned index, indent_aware_stringbuilder& sb, bool nameOnly = false) {
+    const compactVariable& variable = tu.variable(index);
+    if (variable.isPrecise) sb.append("precise ");
+    if (nameOnly) {
+        sb += tu.name(variable.name);
+        return;
+    }
+
+    sb += compactTypeToString(tu, variable.baseType);
+    sb += " ";
+    sb += tu.name(variable.name);
+
+    if (variable.isArray) {
+        for (size_t i = 0; i < variable.arraySizes.count; ++i) {
+            sb += "[";
+            compactExpressionToString(tu, tu.child(variable.arraySizes, i), sb);
+            sb += "]";
+        }
+    }
+}
+
+inline void compactFunctionVariableToString(const compactTU& tu, unsigned index, indent_aware_stringbuilder& sb, int flags = kDefault) {
+    const compactVariable& variable = tu.variable(index);
+    if (variable.isConst) sb += "const ";
+    compactVariableToString(tu, index, sb);
+
+    if (variable.initialValue) {
+        sb += " = ";
+        compactExpressionToString(tu, variable.initialValue, sb);
+    }
+
+    if (flags & kSemicolon) sb.append(";");
+    if (flags & kNewLine) sb.appendLine();
+}
+
+inline void compactStatementToString(const compactTU& tu, unsigned index, indent_aware_stringbuilder& sb, int flags) {
+    const compactStatement& statement = tu.statement(index);
+    switch (statement.type) {
+        case STATEMENT(Empty):
+            sb += ";";
+        break;
+        case STATEMENT(Continue):
+            sb += "continue;";
+            if (flags & kPopIndent) sb.popIndent();
+        break;
+        case STATEMENT(Break):
+            sb += "break;";
+            if (flags & kPopIndent) sb.popIndent();
+        break;
+        case STATEMENT(Discard):
+            sb += "discard;";
+            if (flags & kPopIndent) sb.popIndent();
+        break;
+
+        case STATEMENT(Compound):
+            if (!statement.asCompound.count) {
+                sb.append("{");
+                if (flags & kNewLine) sb.appendLine(" }");
+                else sb.append(" }");
+            } else {
+                sb.appendLine("{");
+                sb.pushIndent();
+
+                for (size_t i = 0; i < statement.asCompound.count; ++i) {
+                    compactStatementToString(tu, tu.child(statement.asCompound, i), sb, flags);
+                }
+
+                sb.popIndent();
+                if (flags & kCompoundChain) sb += "}";
+                else sb.appendLine("}");
+            }
+        break;
+
+        case STATEMENT(Declaration):
+            for (size_t i = 0; i < statement.asDeclaration.count; ++i) {
+                compactFunctionVariableToString(tu, tu.child(statement.asDeclaration, i), sb, flags);
+            }
+        break;
+
+        case STATEMENT(Expression):
+            compactExpressionToString(tu, statement.asExpression, sb);
+            if (flags & kSemicolon) sb += ";";
+            if (flags & kNewLine) sb.appendLine();
+        break;
+
+        case STATEMENT(Switch):
+            sb += "switch (";
+            compactExpressionToString(tu, statement.asSwitch.expression, sb);
+            sb.appendLine(") {");
+            sb.pushIndent();
+
+            for (size_t i = 0; i < statement.asSwitch.statements.count; ++i) {
+                compactStatementToString(tu, tu.child(statement.asSwitch.statements, i), sb, kSemicolon | kPopIndent);
+                sb.appendLine();
+            }
+
+            sb.popIndent();
+            sb.appendLine("}");
+        break;
+
+        case STATEMENT(CaseLabel):
+            if (statement.asCaseLabel.isDefault) {
+                sb += "default";
+            } else {
+                sb += "case ";
+                compactExpressionToString(tu, statement.asCaseLabel.condition, sb);
+            }
+
+            sb += (":");
+            sb.pushIndent();
+        break;
+
+        case STATEMENT(While):
+            sb += "while (";
+            compactStatementToString(tu, statement.asWhile.condition, sb, false);
+            sb += ") ";
+            compactStatementToString(tu, statement.asWhile.body, sb);
+        break;
+
+        case STATEMENT(Do):
+        {
+            const compactStatement& body = tu.statement(statement.asDo.body);
+            sb += "do ";
+
+            int doFlags = kSemicolon;
+            if (body.type == STATEMENT(Compound) && body.asCompound.count) {
+                doFlags |= kNewLine;
+            }
+
+            compactStatementToString(tu, statement.asDo.body, sb, doFlags);
+            if (body.type != STATEMENT(Compound) || !(doFlags & kNewLine)) sb += " ";
+
+            sb += "while (";
+            compactExpressionToString(tu, statement.asDo.condition, sb);
+            sb.appendLine(");");
+        }
+        break;
+
+        case STATEMENT(For):
+            sb += "for (";
+
+            if (statement.asFor.init) {
+                compactStatementToString(tu, statement.asFor.init, sb, false);
+            } else {
+                sb += ";;";
+            }
+
+            if (statement.asFor.condition) {
+                sb += "; ";
+                compactExpressionToString(tu, statement.asFor.condition, sb);
+            }
+
+            if (statement.asFor.loop) {
+                sb += "; ";
+                compactExpressionToString(tu, statement.asFor.loop, sb);
+            }
+            sb += ") ";
+            compactStatementToString(tu, statement.asFor.body, sb);
+        break;
+
+        case STATEMENT(If):
+        {
+            sb += "if (";
+            compactExpressionToString(tu, statement.asIf.condition, sb);
+            sb += ") ";
+            int ifFlags = kSemicolon | kNewLine;
+            if (statement.asIf.elseStatement) ifFlags |= kCompoundChain;
+
+            compactStatementToString(tu, statement.asIf.thenStatement, sb, ifFlags);
+            if (tu.statement(statement.asIf.thenStatement).type != STATEMENT(Compound)) sb.appendLine();
+
+            if (statement.asIf.elseStatement) {
+                sb += " else ";
+                if (tu.statement(statement.asIf.elseStatement).type == STATEMENT(If)) sb += " ";
+                compactStatementToString(tu, statement.asIf.elseStatement, sb);
+            }
+        }
+        break;
+    }
+}
+
+converter::converter(const allocator *memory) : stringBuffer(memory) { }
 
 const char* converter::convertTU(astTU* translationUnit) {
     visitPreprocessors(translationUnit);
@@ -514,7 +854,7 @@ const char* converter::convertTU(astTU* translationUnit) {
 void converter::visitPreprocessors(astTU* tu) {
     if (tu->versionDirective) {
         stringBuffer += "#version ";
-        stringBuffer += ntoa("%d", tu->versionDirective->version);
+        numberToString("%d", tu->versionDirective->version, stringBuffer);
         stringBuffer += " ";
         stringBuffer += profileToString(tu->versionDirective->type);
         stringBuffer.appendLine();
@@ -644,4 +984,152 @@ void converter::visitFunctions(astTU* tu) {
     }
 }
 
+const char* converter::convertTU(const compactTU* translationUnit) {
+    visitPreprocessors(translationUnit);
+    visitStructures(translationUnit);
+    visitInterfaceBlocks(translationUnit);
+    visitGlobalVariables(translationUnit);
+    visitFunctions(translationUnit);
+
+    return stringBuffer.toString();
+}
+
+void converter::visitPreprocessors(const compactTU* tu) {
+    if (tu->version != -1) {
+        stringBuffer += "#version ";
+        numberToString("%d", tu->version, stringBuffer);
+        stringBuffer += " ";
+        stringBuffer += profileToString(tu->profile);
+        stringBuffer.appendLine();
+    }
+
+    for (size_t i = 0; i < tu->extensions.count; ++i) {
+        const compactExtension& extension = tu->extension(tu->child(tu->extensions, i));
+        stringBuffer += "#extension ";
+        stringBuffer += tu->name(extension.name);
+        stringBuffer += " : ";
+        stringBuffer += extensionBehaviorToString(extension.behavior);
+        stringBuffer.appendLine();
+    }
+}
+
+void converter::visitStructures(const compactTU* tu) {
+    for (size_t i = 0; i < tu->structures.count; ++i) {
+        const compactType& structure = tu->type(tu->child(tu->structures, i));
+        stringBuffer += "struct ";
+        stringBuffer += tu->name(structure.name);
+        stringBuffer.appendLine(" {");
+        stringBuffer.pushIndent();
+
+        for (size_t j = 0; j < structure.fields.count; ++j) {
+            compactVariableToString(*tu, tu->child(structure.fields, j), stringBuffer);
+            stringBuffer.appendLine(";");
+        }
+
+        stringBuffer.popIndent();
+        stringBuffer.appendLine("};");
+        stringBuffer.appendLine();
+    }
+}
+
+void converter::visitInterfaceBlocks(const compactTU* tu) {
+    for (size_t i = 0; i < tu->interfaceBlocks.count; ++i) {
+        const compactType& interfaceBlock = tu->type(tu->child(tu->interfaceBlocks, i));
+        stringBuffer += storageToString(interfaceBlock.storage);
+        stringBuffer += " ";
+        stringBuffer += tu->name(interfaceBlock.name);
+        stringBuffer.appendLine(" {");
+        stringBuffer.pushIndent();
+
+        for (size_t j = 0; j < interfaceBlock.fields.count; ++j) {
+            compactVariableToString(*tu, tu->child(interfaceBlock.fields, j), stringBuffer);
+            stringBuffer.appendLine();
+        }
+
+        stringBuffer.popIndent();
+        stringBuffer.appendLine("};");
+        stringBuffer.appendLine();
+    }
+}
+
+void converter::visitGlobalVariables(const compactTU* tu) {
+    for (size_t i = 0; i < tu->globals.count; ++i) {
+        const unsigned index = tu->child(tu->globals, i);
+        const compactVariable& global = tu->variable(index);
+        if (global.layoutQualifiers.count) {
+            stringBuffer += "layout(";
+            for (size_t j = 0; j < global.layoutQualifiers.count; ++j) {
+                const compactLayoutQualifier& layoutQualifier = tu->layoutQualifier(tu->child(global.layoutQualifiers, j));
+                stringBuffer += tu->name(layoutQualifier.name);
+                if (layoutQualifier.initialValue) {
+                    stringBuffer += " = ";
+                    compactExpressionToString(*tu, layoutQualifier.initialValue, stringBuffer);
+                    if (j != global.layoutQualifiers.count - 1)
+                        stringBuffer += ", ";
+                }
+            }
+            stringBuffer += ") ";
+        }
+
+        stringBuffer += storageToString(global.storage);
+        stringBuffer += " ";
+
+        if (global.auxiliary != -1) {
+            stringBuffer += auxiliaryToString(global.auxiliary);
+            stringBuffer += " ";
+        }
+
+        if (global.memory != 0) {
+            stringBuffer += memoryToString(global.memory);
+            stringBuffer += " ";
+        }
+
+        if (global.isInvariant) stringBuffer += "invariant ";
+
+        compactVariableToString(*tu, index, stringBuffer);
+
+        if (global.initialValue) {
+            stringBuffer += " = ";
+            compactExpressionToString(*tu, global.initialValue, stringBuffer);
+        }
+
+        stringBuffer.appendLine(";");
+    }
+}
+
+void converter::visitFunctions(const compactTU* tu) {
+    for (size_t i = 0; i < tu->functions.count; ++i) {
+        const compactFunction& function = tu->function(tu->child(tu->functions, i));
+        stringBuffer += compactTypeToString(*tu, function.returnType);
+        stringBuffer += " ";
+        stringBuffer += tu->name(function.name);
+
+        stringBuffer += "(";
+        if (!function.parameters.count) {
+            for (size_t j = 0; j < function.parameters.count; ++j) {
+                compactVariableToString(*tu, tu->child(function.parameters, j), stringBuffer, true);
+                if (j != function.parameters.count - 1)
+                    stringBuffer += ", ";
+            }
+        }
+        stringBuffer += ")";
+
+        if (function.isPrototype) {
+            stringBuffer.appendLine(";");
+            continue;
+        }
+
+        stringBuffer.appendLine(" {");
+        stringBuffer.pushIndent();
+
+        for (size_t j = 0; j < function.statements.count; ++j) {
+            compactStatementToString(*tu, tu->child(function.statements, j), stringBuffer);
+        }
+
+        stringBuffer.popIndent();
+        stringBuffer.appendLine("}");
+        stringBuffer.appendLine();
+    }
+}
+
 }
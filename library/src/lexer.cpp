@@ -1,23 +1,25 @@
-#include <string.h> // memcpy, strlen
-#include <stdlib.h> // malloc, free
-#include <limits.h> // INT_MAX, UINT_MAX
+#include <string.h> // memcmp, memcpy, memmove, strlen, strncmp
+#include <limits.h> // INT_MAX, UINT_MAX, ULLONG_MAX
 
 #include "glsl-parser/lexer.h"
 
-namespace glsl {
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GLSL_LEXER_SIMD
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GLSL_LEXER_SIMD
+#endif
 
-// Lookup table of keywords
-#undef KEYWORD
-#define KEYWORD(X) { #X, kKeyword_##X },
-static const keywordInfo kKeywords[] = {
-    #include "glsl-parser/lexemes.h"
-};
-#undef KEYWORD
-#define KEYWORD(...)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace glsl {
 
 // Lookup table of operators
 #undef OPERATOR
-#define OPERATOR(X, S, PREC) { #X, S, PREC },
+#define OPERATOR(X, S, PREC) { #X, S, PREC, sizeof(S) - 1 },
 static const operatorInfo kOperators[] = {
     #include "glsl-parser/lexemes.h"
 };
@@ -36,6 +38,26 @@ int token::precedence() const {
     return -1;
 }
 
+/// tokenArray
+tokenArray::tokenArray(const allocator *memory)
+    : types(memory)
+    , values(memory)
+    , offsets(memory)
+    , directives(memory)
+    , error(0)
+    , errorOffset(0)
+{
+}
+
+void tokenArray::clear() {
+    types.resize(0);
+    values.resize(0);
+    offsets.resize(0);
+    directives.resize(0);
+    error = 0;
+    errorOffset = 0;
+}
+
 /// location
 location::location()
     : column(1)
@@ -44,16 +66,6 @@ location::location()
 {
 }
 
-void location::advanceColumn(size_t count) {
-    column += count;
-    position += count;
-}
-
-void location::advanceLine() {
-    line++;
-    position++;
-    column = 1;
-}
 
 static inline bool isDigit(int ch) {
     return unsigned(ch) - '0' < 10;
@@ -75,15 +87,614 @@ static inline bool isSpace(int ch) {
     return (ch >= '\t' && ch <= '\r') || ch == ' ';
 }
 
-lexer::lexer(const char *string)
-    : m_data(string)
+// Block scanning for whitespace and comments. Each helper compares a whole
+// block against a character and returns a bit mask with one bit per byte,
+// lowest address in the lowest bit. Blocks are only loaded when they lie
+// entirely before the end, the tail is always handled a byte at a time.
+#if defined(__AVX2__)
+static const size_t kBlockSize = 32;
+typedef __m256i block;
+
+static inline block loadBlock(const char *data) {
+    return _mm256_loadu_si256((const __m256i *)data);
+}
+
+static inline unsigned matchBlock(block data, char ch) {
+    return unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, _mm256_set1_epi8(ch))));
+}
+#elif defined(GLSL_LEXER_SIMD)
+static const size_t kBlockSize = 16;
+typedef __m128i block;
+
+static inline block loadBlock(const char *data) {
+    return _mm_loadu_si128((const __m128i *)data);
+}
+
+static inline unsigned matchBlock(block data, char ch) {
+    return unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(data, _mm_set1_epi8(ch))));
+}
+#endif
+
+#if defined(GLSL_LEXER_SIMD)
+static const unsigned kBlockMask = unsigned((1ull << kBlockSize) - 1);
+
+// Index of the lowest set bit, mask must not be zero
+static inline int lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Index of the first character from where on which is not a space or a tab
+static size_t skipBlanks(const char *data, size_t where, size_t end) {
+#if defined(GLSL_LEXER_SIMD)
+    for (; where + kBlockSize <= end; where += kBlockSize) {
+        const block chunk = loadBlock(data + where);
+        const unsigned other = ~(matchBlock(chunk, ' ') | matchBlock(chunk, '\t')) & kBlockMask;
+        if (other)
+            return where + lowestBit(other);
+    }
+#endif
+    while (where < end && (data[where] == ' ' || data[where] == '\t'))
+        where++;
+    return where;
+}
+
+// Index of the first newline from where on, end if there is none
+static size_t findNewline(const char *data, size_t where, size_t end) {
+#if defined(GLSL_LEXER_SIMD)
+    for (; where + kBlockSize <= end; where += kBlockSize) {
+        const unsigned newlines = matchBlock(loadBlock(data + where), '\n');
+        if (newlines)
+            return where + lowestBit(newlines);
+    }
+#endif
+    while (where < end && data[where] != '\n')
+        where++;
+    return where;
+}
+
+// Index of the first "*/" from where on, end if there is none
+static size_t findCommentEnd(const char *data, size_t where, size_t end) {
+#if defined(GLSL_LEXER_SIMD)
+    // Needs one byte past the block to see the '/' after a trailing '*'
+    for (; where + kBlockSize < end; where += kBlockSize) {
+        const unsigned stars = matchBlock(loadBlock(data + where), '*');
+        const unsigned slashes = matchBlock(loadBlock(data + where + 1), '/');
+        if (stars & slashes)
+            return where + lowestBit(stars & slashes);
+    }
+#endif
+    for (; where < end; where++) {
+        if (data[where] == '*' && where + 1 < end && data[where + 1] == '/')
+            return where;
+    }
+    return end;
+}
+
+// Integer literal digits in the given base. Values which do not fit in 32
+// bits come back as anything above UINT_MAX.
+static unsigned long long parseInteger(const char *digits, size_t length, int base) {
+    unsigned long long value = 0;
+    for (size_t i = 0; i < length; i++) {
+        const int ch = digits[i];
+        const int digit = isDigit(ch) ? ch - '0' : (ch | 32) - 'a' + 10;
+        value = value * base + digit;
+        if (value > UINT_MAX)
+            return ULLONG_MAX;
+    }
+    return value;
+}
+
+// Exact decimal to binary floating point conversion. Literals of up to 19
+// significant digits with a small exponent are converted with a single
+// rounding in floating point arithmetic, since both operands are exact
+// (Clinger's fast path.) Everything else goes through a fixed size decimal
+// which is scaled by powers of two until the binary exponent is known and
+// the mantissa can be read off as an integer. Neither path allocates or
+// depends on the C locale.
+struct floatFormat {
+    int mantissaBits;
+    int exponentBits;
+    int bias;
+};
+
+static const floatFormat kFloatFormat = { 23, 8, -127 };
+static const floatFormat kDoubleFormat = { 52, 11, -1023 };
+
+struct decimalNumber {
+    decimalNumber() : count(0), point(0), truncated(false) { }
+    static const int kMaxDigits = 800;
+    char digits[kMaxDigits]; // Significant digits, no leading or trailing zeros
+    int count;
+    int point; // Value is 0.digits * 10^point
+    bool truncated; // Non zero digits were dropped past kMaxDigits
+};
+
+static void trimDecimal(decimalNumber &number) {
+    while (number.count > 0 && number.digits[number.count - 1] == '0')
+        number.count--;
+    if (number.count == 0)
+        number.point = 0;
+}
+
+// Largest shift for which the accumulators below cannot overflow
+static const unsigned kMaxDecimalShift = 60;
+
+static void shiftDecimalRight(decimalNumber &number, unsigned shift) {
+    int read = 0;
+    int write = 0;
+    unsigned long long value = 0;
+    for (; (value >> shift) == 0; read++) {
+        if (read >= number.count) {
+            if (value == 0) {
+                number.count = 0;
+                return;
+            }
+            while ((value >> shift) == 0) {
+                value *= 10;
+                read++;
+            }
+            break;
+        }
+        value = value * 10 + (number.digits[read] - '0');
+    }
+    number.point -= read - 1;
+    const unsigned long long mask = (1ull << shift) - 1;
+    for (; read < number.count; read++) {
+        const int digit = int(value >> shift);
+        value &= mask;
+        number.digits[write++] = char('0' + digit);
+        value = value * 10 + (number.digits[read] - '0');
+    }
+    while (value > 0) {
+        const int digit = int(value >> shift);
+        value &= mask;
+        if (write < decimalNumber::kMaxDigits)
+            number.digits[write++] = char('0' + digit);
+        else if (digit > 0)
+            number.truncated = true;
+        value *= 10;
+    }
+    number.count = write;
+    trimDecimal(number);
+}
+
+static void shiftDecimalLeft(decimalNumber &number, unsigned shift) {
+    // Multiplying by 2^shift adds at most this many digits
+    const int grow = int(shift * 30103u / 100000u) + 1;
+    const int end = number.count + grow;
+    int write = end;
+    unsigned long long value = 0;
+    for (int read = number.count - 1; read >= 0; read--) {
+        value += (unsigned long long)(number.digits[read] - '0') << shift;
+        const unsigned long long quotient = value / 10;
+        const int digit = int(value - quotient * 10);
+        if (--write < decimalNumber::kMaxDigits)
+            number.digits[write] = char('0' + digit);
+        else if (digit != 0)
+            number.truncated = true;
+        value = quotient;
+    }
+    while (value > 0) {
+        const unsigned long long quotient = value / 10;
+        const int digit = int(value - quotient * 10);
+        if (--write < decimalNumber::kMaxDigits)
+            number.digits[write] = char('0' + digit);
+        else if (digit != 0)
+            number.truncated = true;
+        value = quotient;
+    }
+    const int count = end - write;
+    const int kept = count < decimalNumber::kMaxDigits ? count : decimalNumber::kMaxDigits;
+    memmove(number.digits, number.digits + write, kept);
+    number.point += count - number.count;
+    number.count = kept;
+    trimDecimal(number);
+}
+
+static void shiftDecimal(decimalNumber &number, int shift) {
+    if (number.count == 0)
+        return;
+    for (; shift > int(kMaxDecimalShift); shift -= kMaxDecimalShift)
+        shiftDecimalLeft(number, kMaxDecimalShift);
+    for (; shift < -int(kMaxDecimalShift); shift += kMaxDecimalShift)
+        shiftDecimalRight(number, kMaxDecimalShift);
+    if (shift > 0)
+        shiftDecimalLeft(number, shift);
+    else if (shift < 0)
+        shiftDecimalRight(number, -shift);
+}
+
+// Integer part rounded half to even, number must be below 2^64
+static unsigned long long roundDecimal(const decimalNumber &number) {
+    unsigned long long value = 0;
+    int i = 0;
+    for (; i < number.point && i < number.count; i++)
+        value = value * 10 + (number.digits[i] - '0');
+    for (; i < number.point; i++)
+        value *= 10;
+    const int next = number.point;
+    if (next >= 0 && next < number.count) {
+        bool up = number.digits[next] >= '5';
+        if (number.digits[next] == '5' && next + 1 == number.count && !number.truncated)
+            up = next > 0 && (number.digits[next - 1] - '0') % 2 != 0;
+        if (up)
+            value++;
+    }
+    return value;
+}
+
+// IEEE bit pattern nearest to number in the given format
+static unsigned long long decimalToBits(decimalNumber &number, const floatFormat &format) {
+    // Scale by this much to go from 10^point to a power of two exponent
+    static const int kPowerShifts[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+    static const int kPowerShiftCount = int(sizeof kPowerShifts / sizeof *kPowerShifts);
+    const unsigned long long mantissaMask = (1ull << format.mantissaBits) - 1;
+    const int maxExponent = (1 << format.exponentBits) - 1;
+
+    unsigned long long mantissa = 0;
+    int exponent = format.bias;
+    if (number.count == 0 || number.point < -330) {
+        // Zero or certain underflow, zero either way
+    } else if (number.point > 310) {
+        exponent = maxExponent + format.bias;
+    } else {
+        exponent = 0;
+        while (number.point > 0) {
+            const int shift = number.point >= kPowerShiftCount ? 27 : kPowerShifts[number.point];
+            shiftDecimal(number, -shift);
+            exponent += shift;
+        }
+        while (number.point < 0 || (number.point == 0 && number.digits[0] < '5')) {
+            const int shift = -number.point >= kPowerShiftCount ? 27 : kPowerShifts[-number.point];
+            shiftDecimal(number, shift);
+            exponent -= shift;
+        }
+        // Now in [0.5, 1) but the format wants [1, 2)
+        exponent--;
+        // Denormals keep the smallest exponent and lose mantissa bits instead
+        if (exponent < format.bias + 1) {
+            shiftDecimal(number, -(format.bias + 1 - exponent));
+            exponent = format.bias + 1;
+        }
+        if (exponent - format.bias >= maxExponent) {
+            exponent = maxExponent + format.bias;
+        } else {
+            shiftDecimal(number, 1 + format.mantissaBits);
+            mantissa = roundDecimal(number);
+            // Rounding can carry into a new bit
+            if (mantissa == (2ull << format.mantissaBits)) {
+                mantissa >>= 1;
+                exponent++;
+            }
+            if (exponent - format.bias >= maxExponent) {
+                mantissa = 0;
+                exponent = maxExponent + format.bias;
+            } else if (!(mantissa & (1ull << format.mantissaBits))) {
+                exponent = format.bias;
+            }
+        }
+    }
+    return (mantissa & mantissaMask)
+        | ((unsigned long long)((exponent - format.bias) & maxExponent) << format.mantissaBits);
+}
+
+// Gathers the significant digits of whole.fraction * 10^exponent
+static void readDecimal(decimalNumber &number, const char *whole, size_t wholeLength,
+    const char *fraction, size_t fractionLength, int exponent)
+{
+    for (size_t i = 0; i < wholeLength + fractionLength; i++) {
+        if (i == wholeLength)
+            number.point = number.count;
+        const char ch = i < wholeLength ? whole[i] : fraction[i - wholeLength];
+        if (ch == '0' && number.count == 0) {
+            number.point--;
+            continue;
+        }
+        if (number.count < decimalNumber::kMaxDigits)
+            number.digits[number.count++] = ch;
+        else if (ch != '0')
+            number.truncated = true;
+    }
+    if (fractionLength == 0)
+        number.point = number.count;
+    number.point += exponent;
+    trimDecimal(number);
+}
+
+static const double kExactPowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Significant digits as an integer and the power of ten to scale it by, only
+// when there are few enough of them for the fast path
+static bool decimalMantissa(const decimalNumber &number, unsigned long long &mantissa, int &exponent) {
+    if (number.truncated || number.count > 19)
+        return false;
+    mantissa = 0;
+    for (int i = 0; i < number.count; i++)
+        mantissa = mantissa * 10 + (number.digits[i] - '0');
+    exponent = number.point - number.count;
+    return true;
+}
+
+static double decimalToDouble(decimalNumber &number) {
+    unsigned long long mantissa;
+    int exponent;
+    if (decimalMantissa(number, mantissa, exponent) && mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        const double value = double(mantissa);
+        return exponent < 0 ? value / kExactPowers[-exponent] : value * kExactPowers[exponent];
+    }
+    const unsigned long long bits = decimalToBits(number, kDoubleFormat);
+    double value;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+static float decimalToFloat(decimalNumber &number) {
+    unsigned long long mantissa;
+    int exponent;
+    if (decimalMantissa(number, mantissa, exponent) && mantissa < (1ull << 24) && exponent >= -10 && exponent <= 10) {
+        const float value = float(mantissa);
+        const float scale = float(kExactPowers[exponent < 0 ? -exponent : exponent]);
+        return exponent < 0 ? value / scale : value * scale;
+    }
+    const unsigned bits = unsigned(decimalToBits(number, kFloatFormat));
+    float value;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+// Maximal munch operator tables generated from lexemes.h. Every prefix of an
+// operator is an operator too, so the lexer state is simply the operator
+// matched so far. Every character that can continue an operator is also an
+// operator on its own, so it is classified by that operator's index.
+#undef OPERATOR
+#define OPERATOR(X, S, PREC) S,
+static constexpr const char *kOperatorStrings[] = {
+    #include "glsl-parser/lexemes.h"
+};
+#undef OPERATOR
+#define OPERATOR(...)
+
+static const int kOperatorCount = int(sizeof kOperatorStrings / sizeof *kOperatorStrings);
+
+// Whether longer is shorter followed by ch
+static inline constexpr bool operatorExtends(const char *longer, const char *shorter, char ch) {
+    return *shorter
+        ? *longer == *shorter && operatorExtends(longer + 1, shorter + 1, ch)
+        : *longer && *longer == ch && !longer[1];
+}
+
+// The operator spelled like the given one followed by ch, or -1
+static inline constexpr int operatorExtension(const char *prefix, char ch, int index = 0) {
+    return index == kOperatorCount
+        ? -1
+        : operatorExtends(kOperatorStrings[index], prefix, ch) ? index : operatorExtension(prefix, ch, index + 1);
+}
+
+static inline constexpr size_t operatorLength(const char *string) {
+    return *string ? 1 + operatorLength(string + 1) : 0;
+}
+
+static inline constexpr bool operatorSpells(const char *string, const char *what, size_t length) {
+    return length ? *string == *what && operatorSpells(string + 1, what + 1, length - 1) : !*string;
+}
+
+// Whether the first length characters of what spell an operator
+static inline constexpr bool operatorIsPrefix(const char *what, size_t length, int index = 0) {
+    return index != kOperatorCount
+        && (operatorSpells(kOperatorStrings[index], what, length) || operatorIsPrefix(what, length, index + 1));
+}
+
+// Whether an operator is a shorter operator followed by the character of a
+// single character operator
+static inline constexpr bool operatorIsReachable(const char *string, size_t length) {
+    return length == 1 || (operatorIsPrefix(string, length - 1) && operatorIsPrefix(string + length - 1, 1));
+}
+
+static inline constexpr bool operatorsAreReachable(int index = 0) {
+    return index == kOperatorCount
+        || (operatorIsReachable(kOperatorStrings[index], operatorLength(kOperatorStrings[index]))
+            && operatorsAreReachable(index + 1));
+}
+
+static_assert(operatorsAreReachable(), "every operator must extend another one by a single character operator");
+
+template <size_t... I>
+struct indexList { };
+
+template <size_t N, size_t... I>
+struct makeIndexList : makeIndexList<N - 1, N - 1, I...> { };
+
+template <size_t... I>
+struct makeIndexList<0, I...> {
+    typedef indexList<I...> type;
+};
+
+// Single character operator for every character, or -1
+struct operatorStartTable {
+    signed char at[256];
+};
+
+template <size_t... C>
+static inline constexpr operatorStartTable makeOperatorStart(indexList<C...>) {
+    return operatorStartTable { { (signed char)operatorExtension("", char(C))... } };
+}
+
+static constexpr operatorStartTable kOperatorStart = makeOperatorStart(makeIndexList<256>::type());
+
+// Operator matched after an operator is followed by the character of a single
+// character operator, or -1
+struct operatorNextRow {
+    signed char at[kOperatorCount];
+};
+
+static inline constexpr int operatorNext(int from, int with) {
+    return kOperatorStrings[with][1] ? -1 : operatorExtension(kOperatorStrings[from], kOperatorStrings[with][0]);
+}
+
+template <size_t... C>
+static inline constexpr operatorNextRow makeOperatorNext(int from, indexList<C...>) {
+    return operatorNextRow { { (signed char)operatorNext(from, int(C))... } };
+}
+
+#undef OPERATOR
+#define OPERATOR(X, S, PREC) makeOperatorNext(kOperator_##X, makeIndexList<kOperatorCount>::type()),
+static constexpr operatorNextRow kOperatorNext[] = {
+    #include "glsl-parser/lexemes.h"
+};
+#undef OPERATOR
+#define OPERATOR(...)
+
+// FNV-1a, usable both at compile time for the KEYWORD() entries and at run
+// time while an identifier is being scanned.
+static const unsigned kKeywordHashBasis = 2166136261u;
+
+static inline constexpr unsigned keywordHashStep(unsigned hash, int ch) {
+    return (hash ^ (unsigned char)ch) * 16777619u;
+}
+
+static inline constexpr unsigned keywordHash(const char *string, size_t length, unsigned hash = kKeywordHashBasis) {
+    return length ? keywordHash(string + 1, length - 1, keywordHashStep(hash, *string)) : hash;
+}
+
+// Keyword classifier generated from lexemes.h. Every KEYWORD() becomes a case
+// label of its own hash, so this is a perfect hash over the keyword set: two
+// keywords hashing to the same value is a duplicate case label and fails to
+// compile. A matching hash is confirmed with a single comparison.
+#undef KEYWORD
+#define KEYWORD(X) \
+    case keywordHash(#X, sizeof(#X) - 1): \
+        if (length == sizeof(#X) - 1 && !memcmp(identifier, #X, length)) \
+            return kKeyword_##X; \
+        return -1;
+static int findKeyword(const char *identifier, size_t length, unsigned hash) {
+    switch (hash) {
+    #include "glsl-parser/lexemes.h"
+    }
+    return -1;
+}
+#undef KEYWORD
+#define KEYWORD(...)
+
+// Token caches are tied to every table generated from lexemes.h
+#undef TYPE
+#undef KEYWORD
+#undef OPERATOR
+#undef TYPENAME
+#define TYPE(X) "type " #X,
+#define KEYWORD(X) "keyword " #X,
+#define OPERATOR(X, S, PREC) "operator " #X " " S " " #PREC,
+#define TYPENAME(X) "typename " #X,
+static constexpr const char *kLexemes[] = {
+    #include "glsl-parser/lexemes.h"
+};
+#undef TYPE
+#undef KEYWORD
+#undef OPERATOR
+#undef TYPENAME
+#define TYPE(...)
+#define KEYWORD(...)
+#define OPERATOR(...)
+#define TYPENAME(...)
+
+// Halves the range each time to stay clear of constexpr recursion limits
+static inline constexpr unsigned lexemesHash(size_t begin, size_t end) {
+    return end - begin == 1
+        ? keywordHash(kLexemes[begin], operatorLength(kLexemes[begin]))
+        : (lexemesHash(begin, begin + (end - begin) / 2) ^ 0x9E3779B9u) * 16777619u
+            ^ lexemesHash(begin + (end - begin) / 2, end);
+}
+
+static constexpr unsigned kLexemesHash = lexemesHash(0, sizeof kLexemes / sizeof *kLexemes);
+
+#undef TYPE
+#define TYPE(X) 1 +
+static const int kTypeCount =
+    #include "glsl-parser/lexemes.h"
+    0;
+#undef TYPE
+#define TYPE(...)
+
+#undef KEYWORD
+#define KEYWORD(X) 1 +
+static const int kKeywordCount =
+    #include "glsl-parser/lexemes.h"
+    0;
+#undef KEYWORD
+#define KEYWORD(...)
+
+lexer::lexer(const char *string, const allocator *memory)
+    : m_memory(memory)
+    , m_data(string)
     , m_length(0)
     , m_error(0)
+    , m_position(0)
+    , m_backup(0)
+    , m_lineStarts(memory)
+    , m_tokens(memory)
+    , m_gap(0)
+    , m_gapSize(0)
+    , m_shift(0)
+    , m_directiveTokens(memory)
+    , m_ends(memory)
+    , m_cursor(0)
+    , m_backupCursor(0)
+    , m_tokenized(false)
+    , m_cached(false)
 {
     if (m_data)
         m_length = strlen(m_data);
 }
 
+lexer::lexer(const char *string, size_t length, const allocator *memory)
+    : m_memory(memory)
+    , m_data(string)
+    , m_length(length)
+    , m_error(0)
+    , m_position(0)
+    , m_backup(0)
+    , m_lineStarts(memory)
+    , m_tokens(memory)
+    , m_gap(0)
+    , m_gapSize(0)
+    , m_shift(0)
+    , m_directiveTokens(memory)
+    , m_ends(memory)
+    , m_cursor(0)
+    , m_backupCursor(0)
+    , m_tokenized(false)
+    , m_cached(false)
+{
+}
+
+void lexer::reset(const char *data, size_t length) {
+    m_data = data;
+    m_length = length;
+    m_error = 0;
+    m_position = 0;
+    m_backup = 0;
+    m_lineStarts.resize(0);
+    m_tokens.clear();
+    m_gap = 0;
+    m_gapSize = 0;
+    m_shift = 0;
+    m_directiveTokens.resize(0);
+    m_ends.resize(0);
+    m_cursor = 0;
+    m_backupCursor = 0;
+    m_tokenized = false;
+    m_cached = false;
+}
+
 int lexer::at(int offset) const {
     if (position() + offset < m_length)
         return m_data[position() + offset];
@@ -91,26 +702,51 @@ int lexer::at(int offset) const {
 }
 
 void lexer::skipWhitespace(bool allowNewlines) {
-    while (position() < m_length && isSpace(at())) {
-        if (at() == '\n') {
-            if (allowNewlines) {
-                m_location.advanceLine();
-            } else {
-                break;
-            }
-        } else {
-            m_location.advanceColumn();
-        }
+    for (;;) {
+        // Runs of spaces and tabs are skipped a block at a time
+        m_position = skipBlanks(m_data, m_position, m_length);
+        if (m_position == m_length || !isSpace(m_data[m_position]))
+            break;
+        if (m_data[m_position] == '\n' && !allowNewlines)
+            break;
+        m_position++;
     }
 }
 
-void lexer::read(token &out) {
-    // Any previous identifier must be freed
-    if (out.m_type == kType_identifier)
-        free(out.asIdentifier);
-    else if (out.m_type == kType_directive && out.asDirective.type == directive::kExtension)
-        free(out.asDirective.asExtension.name);
+span lexer::readWord() {
+    span word;
+    word.offset = position();
+    while (position() < m_length && isChar(at()))
+        m_position++;
+    word.length = position() - word.offset;
+    return word;
+}
+
+bool lexer::matches(const span &word, const char *what) const {
+    return !strncmp(m_data + word.offset, what, word.length) && !what[word.length];
+}
+
+// Longest operator at the current position
+bool lexer::readOperator(token &out) {
+    const unsigned char *data = (const unsigned char *)m_data + m_position;
+    const unsigned char *end = (const unsigned char *)m_data + m_length;
+    int match = kOperatorStart.at[*data];
+    if (match < 0)
+        return false;
+    while (++data != end) {
+        const int with = kOperatorStart.at[*data];
+        const int longer = with < 0 ? -1 : kOperatorNext[match].at[with];
+        if (longer < 0)
+            break;
+        match = longer;
+    }
+    out.m_type = kType_operator;
+    out.asOperator = match;
+    m_position += kOperators[match].length;
+    return true;
+}
 
+void lexer::read(token &out) {
     // TODO: Line continuation (backslash `\'.)
     if (position() == m_length) {
         out.m_type = kType_eof;
@@ -132,33 +768,37 @@ void lexer::read(token &out) {
         if (at() == '0') {
             if (ch1 && (ch1 == 'x' || ch1 == 'X')) {
                 isHexish = true;
-                m_location.advanceColumn(2);
+                m_position += 2;
             } else {
                 isOctalish = true;
             }
         }
 
-        vector<char> numeric = readNumeric(isOctalish, isHexish);
+        // Literals are converted in place, remember where each part is. The
+        // digits of an octal one are checked once it is known not to be a
+        // float, 09.5 being one
+        const span whole = readNumeric(isHexish);
+        span fraction = { 0, 0 };
+        int exponent = 0;
         if (position() != m_length && at() == '.') {
             isFloat = true;
             isOctalish = false;
-            numeric.push_back('.');
-            m_location.advanceColumn();
-            vector<char> others = readNumeric(isOctalish, isHexish);
-            numeric.reserve(numeric.size() + others.size());
-            numeric.insert(numeric.end(), others.begin(), others.end());
+            m_position++;
+            fraction = readNumeric(isHexish);
         }
 
         if (position() != m_length && (at() == 'e' || at() == 'E')) {
             ch1 = at(1);
             ch2 = at(2);
-            if ((ch1 == '+' || ch1 == '-') && (ch2 >= '0' && ch2 <= '9')) {
-                numeric.push_back(ch1);
-                numeric.push_back(ch2);
-                m_location.advanceColumn(2);
-                vector<char> others = readNumeric(isOctalish, isHexish);
-                numeric.reserve(numeric.size() + others.size());
-                numeric.insert(numeric.end(), others.begin(), others.end());
+            const bool isSigned = ch1 == '+' || ch1 == '-';
+            if (isDigit(ch1) || (isSigned && isDigit(ch2))) {
+                m_position += isSigned ? 2 : 1;
+                const span digits = readNumeric(false);
+                const unsigned long long value = parseInteger(text(digits), digits.length, 10);
+                // Anything past this is zero or infinity anyway
+                exponent = value > 100000 ? 100000 : int(value);
+                if (ch1 == '-')
+                    exponent = -exponent;
                 isFloat = true;
                 isOctalish = false;
             } else {
@@ -176,7 +816,7 @@ void lexer::read(token &out) {
                 isFloat = false;
                 isDouble = true;
                 isOctalish = false;
-                m_location.advanceColumn();
+                m_position++;
             } else if (at() == 'u' || at() == 'U') {
                 if (isFloat) {
                     m_error = "invalid use of suffix on literal";
@@ -187,7 +827,7 @@ void lexer::read(token &out) {
                 m_error = "invalid numeric literal";
                 return;
             }
-            m_location.advanceColumn();
+            m_position++;
         }
 
         if (isHexish && (isFloat || isDouble)) {
@@ -195,133 +835,111 @@ void lexer::read(token &out) {
             return;
         }
 
-        numeric.push_back('\0');
-        int base = isHexish ? 16 : (isOctalish ? 8 : 10);
-        char *error;
-        if (isFloat) {
-            out.m_type = kType_constant_float;
-            out.asFloat = strtof(&numeric[0], &error);
-            if (error == &numeric[0]) {
-                m_error = "invalid numeric literal";
-                return;
-            }
-        } else if (isDouble) {
-            out.m_type = kType_constant_double;
-            out.asDouble = strtod(&numeric[0], &error);
-            if (error == &numeric[0]) {
-                m_error = "invalid numeric literal";
-                return;
-            }
-        } else if (isUnsigned) {
-            out.m_type = kType_constant_uint;
-            unsigned long long value = strtoull(&numeric[0], 0, base);
-            if (value <= UINT_MAX) {
-                out.asUnsigned = (unsigned int)value;
+        if (isFloat || isDouble) {
+            decimalNumber number;
+            readDecimal(number, text(whole), whole.length, text(fraction), fraction.length, exponent);
+            if (isFloat) {
+                out.m_type = kType_constant_float;
+                out.asFloat = decimalToFloat(number);
             } else {
-                m_error = "literal needs more than 32-bits";
+                out.m_type = kType_constant_double;
+                out.asDouble = decimalToDouble(number);
             }
         } else {
-            out.m_type = kType_constant_int;
-            long long value = strtoll(&numeric[0], 0, base);
-            if (value <= INT_MAX) {
-                out.asInt = (int)value;
+            for (size_t i = 0; isOctalish && i < whole.length; i++) {
+                if (!isOctal(text(whole)[i])) {
+                    m_error = "invalid octal literal";
+                    return;
+                }
+            }
+            const int base = isHexish ? 16 : (isOctalish ? 8 : 10);
+            const unsigned long long value = parseInteger(text(whole), whole.length, base);
+            if (isUnsigned) {
+                out.m_type = kType_constant_uint;
+                if (value <= UINT_MAX) {
+                    out.asUnsigned = (unsigned int)value;
+                } else {
+                    m_error = "literal needs more than 32-bits";
+                }
             } else {
-                m_error = "literal needs more than 32-bits";
+                out.m_type = kType_constant_int;
+                if (value <= INT_MAX) {
+                    out.asInt = (int)value;
+                } else {
+                    m_error = "literal needs more than 32-bits";
+                }
             }
         }
     } else if (isChar(at()) || at() == '_') {
         // Identifiers
-        out.m_type = kType_identifier;
-        vector<char> identifier;
+        const char *identifier = m_data + position();
+        unsigned hash = kKeywordHashBasis;
         while (position() != m_length && (isChar(at()) || isDigit(at()) || at() == '_')) {
-            identifier.push_back(at());
-            m_location.advanceColumn();
-        }
-        identifier.push_back('\0');
-        out.asIdentifier = (char *)malloc(identifier.size());
-        if (!out.asIdentifier) {
-            m_error = "Out of memory";
-            return;
+            hash = keywordHashStep(hash, at());
+            m_position++;
         }
-        memcpy(out.asIdentifier, &identifier[0], identifier.size());
+        const size_t length = size_t(m_data + position() - identifier);
 
         // Or is it a keyword?
-        for (size_t i = 0; i < sizeof(kKeywords)/sizeof(kKeywords[0]); i++) {
-            if (strcmp(kKeywords[i].name, out.asIdentifier))
-                continue;
-            free(out.asIdentifier);
-            out.asIdentifier = 0;
+        const int keyword = findKeyword(identifier, length, hash);
+        if (keyword != -1) {
             out.m_type = kType_keyword;
-            out.asKeyword = int(i);
-            break;
+            out.asKeyword = keyword;
+            return;
         }
+
+        out.m_type = kType_identifier;
+        out.asIdentifier.offset = size_t(identifier - m_data);
+        out.asIdentifier.length = length;
     } else if (at() == '#') {
-        m_location.advanceColumn(); // Skip '#'.
+        m_position++; // Skip '#'.
 
-        vector<char> chars;
-        while (isChar(at())) {
-            chars.push_back(at());
-            m_location.advanceColumn();
-        }
+        span chars = readWord();
 
         // Directive should immediately proceed the # token.
-        if (chars.empty()) {
+        if (!chars.length) {
             m_error = "Expected directive";
             return;
         }
 
-        if (!strcmp(&chars[0], "version")) {
+        if (matches(chars, "version")) {
             out.asDirective.type = directive::kVersion;
 
             // version [0-9]+ (core|compatibility|es)?
             skipWhitespace(false);
 
-            vector<char> digits = readNumeric(false, false);
-            if (digits.empty()) {
+            const span digits = readNumeric(false);
+            if (!digits.length) {
                 m_error = "Expected version number in #version directive";
                 return;
             }
-            digits.push_back('\0');
 
-            long long value = strtoll(&digits[0], 0, 10);
-            out.asDirective.asVersion.version = value;
+            out.asDirective.asVersion.version = int(parseInteger(text(digits), digits.length, 10));
             out.asDirective.asVersion.type = kCore;
 
             skipWhitespace(false);
 
-            vector<char> chars;
-            while (isChar(at())) {
-                chars.push_back(at());
-                m_location.advanceColumn();
-            }
-
-            if (!chars.empty()) {
-                chars.push_back('\0');
-                if (!strcmp(&chars[0], "core")) {
+            span profile = readWord();
+            if (profile.length) {
+                if (matches(profile, "core")) {
                     // Do nothing, already core.
-                } else if (!strcmp(&chars[0], "compatibility")) {
+                } else if (matches(profile, "compatibility")) {
                     out.asDirective.asVersion.type = kCompatibility;
-                } else if (!strcmp(&chars[0], "es")) {
+                } else if (matches(profile, "es")) {
                     out.asDirective.asVersion.type = kES;
                 } else {
                     m_error = "Invalid profile in #version directive";
                     return;
                 }
             }
-        } else if (!strcmp(&chars[0], "extension")) {
+        } else if (matches(chars, "extension")) {
             out.asDirective.type = directive::kExtension;
 
             // extension [a-zA-Z_]+ : (enable|require|warn|disable)
             skipWhitespace(false);
 
-            vector<char> extension;
-            while (isChar(at())) {
-                extension.push_back(at());
-                m_location.advanceColumn();
-            }
-            extension.push_back('\0');
-
-            if (extension.empty()) {
+            span extension = readWord();
+            if (!extension.length) {
                 m_error = "Expected extension name in #extension directive";
                 return;
             }
@@ -333,50 +951,38 @@ void lexer::read(token &out) {
                 return;
             }
 
-            m_location.advanceColumn(); // Skip ':'.
+            m_position++; // Skip ':'.
 
             skipWhitespace(false);
 
-            vector<char> behavior;
-            while (isChar(at())) {
-                behavior.push_back(at());
-                m_location.advanceColumn();
-            }
-            behavior.push_back('\0');
-
-            if (behavior.empty()) {
+            span behavior = readWord();
+            if (!behavior.length) {
                 m_error = "Expected behavior in #extension directive";
                 return;
             }
 
-            if (!strcmp(&behavior[0], "enable")) {
+            if (matches(behavior, "enable")) {
                 out.asDirective.asExtension.behavior = kEnable;
-            } else if (!strcmp(&behavior[0], "require")) {
+            } else if (matches(behavior, "require")) {
                 out.asDirective.asExtension.behavior = kRequire;
-            } else if (!strcmp(&behavior[0], "warn")) {
+            } else if (matches(behavior, "warn")) {
                 out.asDirective.asExtension.behavior = kWarn;
-            } else if (!strcmp(&behavior[0], "disable")) {
+            } else if (matches(behavior, "disable")) {
                 out.asDirective.asExtension.behavior = kDisable;
             } else {
                 m_error = "Unexpected behavior in #extension directive";
                 return;
             }
 
-            // Do this late when nothing can fail so we don't leak memory.
-            size_t name_len = strlen(&extension[0]);
-            char *name = (char*)malloc(name_len + 1);
-            if (!name) {
-                m_error = "Out of memory";
-                return;
-            }
-            memcpy(name, &extension[0], name_len + 1);
-            out.asDirective.asExtension.name = name;
+            out.asDirective.asExtension.name = extension;
         } else {
             m_error = "Unsupported directive";
             return;
         }
 
         out.m_type = kType_directive;
+    } else if (at() != '/' && readOperator(out)) {
+        // Operators, except for '/' which could begin a comment
     } else {
         switch (at()) {
         // Non operators
@@ -391,236 +997,744 @@ void lexer::read(token &out) {
             break;
         case ';':
             out.m_type = kType_semicolon;
-            m_location.advanceColumn();
+            m_position++;
             break;
         case '{':
             out.m_type = kType_scope_begin;
-            m_location.advanceColumn();
+            m_position++;
             break;
         case '}':
             out.m_type = kType_scope_end;
-            m_location.advanceColumn();
-            break;
-        // Operators
-        case '.':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_dot;
-            break;
-        case '+':
-            out.m_type = kType_operator;
-            if (ch1 == '+')
-                out.asOperator = kOperator_increment;
-            else if (ch1 == '=')
-                out.asOperator = kOperator_add_assign;
-            else
-                out.asOperator = kOperator_plus;
-            break;
-        case '-':
-            out.m_type = kType_operator;
-            if (ch1 == '-')
-                out.asOperator = kOperator_decrement;
-            else if (ch1 == '=')
-                out.asOperator = kOperator_sub_assign;
-            else
-                out.asOperator = kOperator_minus;
+            m_position++;
             break;
         case '/':
             if (ch1 == '/') {
                 // Skip line comments
-                while (position() != m_length) {
-                    if (at() == '\n') {
-                        m_location.advanceLine();
-                        break;
-                    }
-                    m_location.advanceColumn();
-                }
+                m_position = findNewline(m_data, m_position, m_length);
+                if (m_position != m_length)
+                    m_position++;
                 out.m_type = kType_comment;
             } else if (ch1 == '*') {
                 // Skip block comments
-                while (position() != m_length) {
-                    if (at() == '\n') {
-                        m_location.advanceLine();
-                        continue;
-                    }
-                    if (at() == '*' && position() + 1 < m_length && m_data[position() + 1] == '/') {
-                        m_location.advanceColumn(2);
-                        break;
-                    }
-                    m_location.advanceColumn();
-                }
+                m_position = findCommentEnd(m_data, m_position, m_length);
+                if (m_position != m_length)
+                    m_position += 2;
                 out.m_type = kType_comment;
-            } else if (ch1 == '=') {
-                out.m_type = kType_operator;
-                out.asOperator = kOperator_divide_assign;
             } else {
-                out.m_type = kType_operator;
-                out.asOperator = kOperator_divide;
+                readOperator(out);
             }
             break;
-        case '*':
-            out.m_type = kType_operator;
-            if (ch1 == '=')
-                out.asOperator = kOperator_multiply_assign;
-            else
-                out.asOperator = kOperator_multiply;
-            break;
-        case '%':
-            out.m_type = kType_operator;
-            if (ch1 == '=')
-                out.asOperator = kOperator_modulus_assign;
-            else
-                out.asOperator = kOperator_modulus;
-            break;
-        case '<':
-            out.m_type = kType_operator;
-            if (ch1 == '<' && ch2 == '=')
-                out.asOperator = kOperator_shift_left_assign;
-            else if (ch1 == '<')
-                out.asOperator = kOperator_shift_left;
-            else if (ch1 == '=')
-                out.asOperator = kOperator_less_equal;
-            else
-                out.asOperator = kOperator_less;
-            break;
-        case '>':
-            out.m_type = kType_operator;
-            if (ch1 == '>' && ch2 == '=')
-                out.asOperator = kOperator_shift_right_assign;
-            else if (ch1 == '>')
-                out.asOperator = kOperator_shift_right;
-            else if (ch1 == '=')
-                out.asOperator = kOperator_greater_equal;
-            else
-                out.asOperator = kOperator_greater;
-            break;
-        case '[':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_bracket_begin;
-            break;
-        case ']':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_bracket_end;
-            break;
-        case '(':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_paranthesis_begin;
-            break;
-        case ')':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_paranthesis_end;
-            break;
-        case '^':
-            out.m_type = kType_operator;
-            if (ch1 == '^')
-                out.asOperator = kOperator_logical_xor;
-            else if (ch1 == '=')
-                out.asOperator = kOperator_bit_xor_assign;
-            else
-                out.asOperator = kOperator_bit_xor;
-            break;
-        case '|':
-            out.m_type = kType_operator;
-            if (ch1 == '|')
-                out.asOperator = kOperator_logical_or;
-            else if (ch1 == '=')
-                out.asOperator = kOperator_bit_or_assign;
-            else
-                out.asOperator = kOperator_bit_or;
-            break;
-        case '&':
-            out.m_type = kType_operator;
-            if (ch1 == '&')
-                out.asOperator = kOperator_logical_and;
-            else if (ch1 == '=')
-                out.asOperator = kOperator_bit_and_assign;
-            else
-                out.asOperator = kOperator_bit_and;
-            break;
-        case '~':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_bit_not;
-            break;
-        case '=':
-            out.m_type = kType_operator;
-            if (ch1 == '=')
-                out.asOperator = kOperator_equal;
-            else
-                out.asOperator = kOperator_assign;
-            break;
-        case '!':
-            out.m_type = kType_operator;
-            if (ch1 == '=')
-                out.asOperator = kOperator_not_equal;
-            else
-                out.asOperator = kOperator_logical_not;
-            break;
-        case ':':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_colon;
-            break;
-        case ',':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_comma;
-            break;
-        case '?':
-            out.m_type = kType_operator;
-            out.asOperator = kOperator_questionmark;
-            break;
         default:
             m_error = "invalid character encountered";
             return;
         }
-        // Skip whitespace for operator
-        if (out.m_type == kType_operator)
-            m_location.advanceColumn(strlen(kOperators[out.asOperator].string));
     }
 }
 
-vector<char> lexer::readNumeric(bool isOctalish, bool isHexish) {
-    vector<char> digits;
-    if (isOctalish) {
-        while (position() < m_length && isOctal(at())) {
-            digits.push_back(at());
-            m_location.advanceColumn();
-        }
-    } else if (isHexish) {
-        while (position() < m_length && isHex(at())) {
-            digits.push_back(at());
-            m_location.advanceColumn();
-        }
+span lexer::readNumeric(bool isHexish) {
+    span digits;
+    digits.offset = position();
+    if (isHexish) {
+        while (position() < m_length && isHex(at()))
+            m_position++;
     } else {
-        while (position() < m_length && isDigit(at())) {
-            digits.push_back(at());
-            m_location.advanceColumn();
-        }
+        while (position() < m_length && isDigit(at()))
+            m_position++;
     }
+    digits.length = position() - digits.offset;
     return digits;
 }
 
+token lexer::read() {
+    token out;
+    read(out, true);
+    return out;
+}
+
 token lexer::peek() {
     token out;
-    backup();
+    if (m_tokenized) {
+        settle();
+        if (m_cursor < m_tokens.size())
+            load(out, m_cursor);
+        else {
+            out.m_type = kType_eof;
+            if (m_tokens.error) // As reading it ahead would when streaming
+                m_error = m_tokens.error;
+        }
+        return out;
+    }
+    const size_t saved = m_position;
     read(out, true);
-    restore();
+    m_position = saved;
     return out;
 }
 
 void lexer::read(token &out, bool) {
+    if (m_tokenized) {
+        settle();
+        if (m_cursor < m_tokens.size()) {
+            load(out, m_cursor++);
+            return;
+        }
+        // The error comes with the read after the last token, like when
+        // streaming, and nothing was stored for it
+        out.m_type = kType_eof;
+        if (m_tokens.error)
+            m_error = m_tokens.error;
+        return;
+    }
     do {
         read(out);
     } while ((out.m_type == kType_whitespace || out.m_type == kType_comment) && !m_error);
 }
 
+void lexer::tokenize() {
+    m_tokens.clear();
+    m_gap = 0;
+    m_gapSize = 0;
+    m_shift = 0;
+    m_directiveTokens.resize(0);
+    m_lineStarts.resize(0);
+    m_ends.resize(0);
+    m_cached = false;
+    m_position = 0;
+    m_error = 0;
+
+    if (m_length > UINT_MAX) {
+        m_tokens.error = "source too large";
+        m_tokenized = true;
+        return;
+    }
+
+    // A token every four characters or so is typical, avoid regrowing
+    m_tokens.types.reserve(m_length / 4);
+    m_tokens.values.reserve(m_length / 4);
+    m_tokens.offsets.reserve(m_length / 4);
+
+    token out;
+    for (;;) {
+        const size_t offset = position();
+        read(out);
+        if (m_error) {
+            m_tokens.error = m_error;
+            m_tokens.errorOffset = position();
+            m_error = 0;
+            break;
+        }
+        if (out.m_type == kType_whitespace || out.m_type == kType_comment)
+            continue;
+        if (out.m_type == kType_directive)
+            m_directiveTokens.push_back(unsigned(m_tokens.size()));
+        store(m_tokens, out, offset);
+        if (out.m_type == kType_eof)
+            break;
+    }
+
+    m_tokenized = true;
+    m_cursor = 0;
+    m_backupCursor = 0;
+}
+
+// Replaces the elements [first, last) of into with those of with
+template <typename T>
+static void splice(vector<T> &into, size_t first, size_t last, const vector<T> &with) {
+    if (first != last)
+        into.erase(into.begin() + first, into.begin() + last);
+    if (with.empty())
+        return;
+    if (into.empty()) {
+        for (size_t i = 0; i < with.size(); i++)
+            into.push_back(with[i]);
+        return;
+    }
+    into.insert(into.begin() + first, with.begin(), with.end());
+}
+
+// Makes the gap at gap of size elements grow elements larger
+template <typename T>
+static void growGap(vector<T> &into, size_t gap, size_t size, size_t grow) {
+    const size_t after = into.size() - gap - size;
+    into.resize(into.size() + grow);
+    if (after)
+        memmove(&into[gap + size + grow], &into[gap + size], after * sizeof(T));
+}
+
+// Where the token at index starts, with the gap left out
+size_t lexer::offsetOf(size_t index) const {
+    if (index < m_gap)
+        return m_tokens.offsets[index];
+    return unsigned(m_tokens.offsets[index + m_gapSize] + m_shift);
+}
+
+// Index of the first token starting at or after offset. Edits are mostly
+// near the last one, so it is looked for outwards from the gap first.
+size_t lexer::findToken(size_t offset) const {
+    const size_t count = m_tokens.size() - m_gapSize;
+    const size_t near = m_gap < count ? m_gap : count;
+    size_t lo = 0;
+    size_t hi = count;
+    if (near < count && offsetOf(near) < offset) {
+        lo = near + 1;
+        for (size_t step = 1; near + step < count; step *= 2) {
+            if (offsetOf(near + step) >= offset) {
+                hi = near + step;
+                break;
+            }
+            lo = near + step + 1;
+        }
+    } else {
+        hi = near;
+        for (size_t step = 1; step <= near; step *= 2) {
+            if (offsetOf(near - step) < offset) {
+                lo = near - step + 1;
+                break;
+            }
+            hi = near - step;
+        }
+    }
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (offsetOf(mid) < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Only the tokens between where the gap is and where it goes are moved,
+// taking or giving back the shift of those after it
+void lexer::moveGap(size_t to) const {
+    if (!m_gapSize && !m_shift) {
+        m_gap = to;
+        return;
+    }
+    for (; m_gap < to; m_gap++) {
+        const size_t from = m_gap + m_gapSize;
+        m_tokens.types[m_gap] = m_tokens.types[from];
+        m_tokens.values[m_gap] = m_tokens.values[from];
+        m_tokens.offsets[m_gap] = unsigned(m_tokens.offsets[from] + m_shift);
+    }
+    while (m_gap > to) {
+        m_gap--;
+        const size_t into = m_gap + m_gapSize;
+        m_tokens.types[into] = m_tokens.types[m_gap];
+        m_tokens.values[into] = m_tokens.values[m_gap];
+        m_tokens.offsets[into] = unsigned(m_tokens.offsets[m_gap] - m_shift);
+    }
+}
+
+void lexer::closeGap() const {
+    moveGap(m_tokens.size() - m_gapSize);
+    m_tokens.types.resize(m_gap);
+    m_tokens.values.resize(m_gap);
+    m_tokens.offsets.resize(m_gap);
+    m_gapSize = 0;
+    m_shift = 0;
+}
+
+void lexer::relex(const char *data, size_t length, size_t offset, size_t removed, size_t inserted) {
+    m_data = data;
+    m_length = length;
+    m_lineStarts.resize(0);
+    if (!m_tokenized || m_cached || m_length > UINT_MAX) {
+        tokenize();
+        return;
+    }
+    m_error = 0;
+    m_cursor = 0;
+    m_backupCursor = 0;
+
+    // Tokens are lexed the same no matter what came before them, and none
+    // looks further ahead than the character after its end. So lexing can
+    // restart at the last token starting before the edit, which may grow
+    // into it.
+    const size_t count = m_tokens.size() - m_gapSize;
+    size_t first = findToken(offset);
+    if (first)
+        first--;
+    m_position = first < count && offsetOf(first) < offset ? offsetOf(first) : 0;
+
+    // The old stream can be picked up again at any token after the edit
+    // starting where a new one does. From there on the source is the same,
+    // so are the tokens. Comments opened or closed by the edit only move
+    // the point where that happens.
+    const unsigned shift = unsigned(inserted - removed);
+    const size_t insertedEnd = offset + inserted;
+    size_t resume = findToken(offset + removed);
+
+    tokenArray fresh(m_memory);
+    vector<unsigned> freshDirectives(m_memory);
+    token out;
+    for (;;) {
+        const size_t start = position();
+        if (start >= insertedEnd) {
+            while (resume < count && unsigned(offsetOf(resume) + shift) < start)
+                resume++;
+            if (resume < count && unsigned(offsetOf(resume) + shift) == start)
+                break;
+        }
+        read(out);
+        if (m_error) {
+            fresh.error = m_error;
+            fresh.errorOffset = position();
+            m_error = 0;
+            resume = count;
+            break;
+        }
+        if (out.m_type == kType_whitespace || out.m_type == kType_comment)
+            continue;
+        if (out.m_type == kType_directive)
+            freshDirectives.push_back(unsigned(first + fresh.size()));
+        store(fresh, out, start);
+        if (out.m_type == kType_eof) {
+            resume = count;
+            break;
+        }
+    }
+
+    // Directives are numbered in source order, find those being replaced
+    size_t firstDirective = 0;
+    while (firstDirective < m_directiveTokens.size() && m_directiveTokens[firstDirective] < first)
+        firstDirective++;
+    size_t removedDirectives = 0;
+    while (firstDirective + removedDirectives < m_directiveTokens.size()
+        && m_directiveTokens[firstDirective + removedDirectives] < resume)
+        removedDirectives++;
+    for (size_t i = 0; i < fresh.size(); i++) {
+        if (fresh.types[i] == kType_directive)
+            fresh.values[i].asDirective += unsigned(firstDirective);
+    }
+
+    // The replaced tokens join the gap, which is moved to the edit, and the
+    // new ones fill it from the front. Typing in one place moves nothing
+    // else, the tokens after the gap only take the shift of the edit.
+    moveGap(first);
+    m_gapSize += resume - first;
+    if (fresh.size() > m_gapSize) {
+        const size_t grow = fresh.size() - m_gapSize + count / 16 + 64;
+        growGap(m_tokens.types, m_gap, m_gapSize, grow);
+        growGap(m_tokens.values, m_gap, m_gapSize, grow);
+        growGap(m_tokens.offsets, m_gap, m_gapSize, grow);
+        m_gapSize += grow;
+    }
+    for (size_t i = 0; i < fresh.size(); i++) {
+        m_tokens.types[m_gap] = fresh.types[i];
+        m_tokens.values[m_gap] = fresh.values[i];
+        m_tokens.offsets[m_gap] = fresh.offsets[i];
+        m_gap++;
+        m_gapSize--;
+    }
+    m_shift += shift;
+
+    // Directives are rare, those after the edit are renumbered right away
+    const unsigned moved = unsigned(fresh.size() - (resume - first));
+    const unsigned renumber = unsigned(fresh.directives.size() - removedDirectives);
+    splice(m_directiveTokens, firstDirective, firstDirective + removedDirectives, freshDirectives);
+    for (size_t i = firstDirective + freshDirectives.size(); i < m_directiveTokens.size(); i++) {
+        m_directiveTokens[i] += moved;
+        m_tokens.values[m_directiveTokens[i] + m_gapSize].asDirective += renumber;
+    }
+    for (size_t i = firstDirective + removedDirectives; i < m_tokens.directives.size(); i++) {
+        span &name = m_tokens.directives[i].asExtension.name;
+        if (m_tokens.directives[i].type == directive::kExtension)
+            name.offset = unsigned(name.offset + shift);
+    }
+    splice(m_tokens.directives, firstDirective, firstDirective + removedDirectives, fresh.directives);
+    if (resume == count) {
+        m_tokens.error = fresh.error;
+        m_tokens.errorOffset = fresh.errorOffset;
+    } else if (m_tokens.error) {
+        m_tokens.errorOffset = unsigned(m_tokens.errorOffset + shift);
+    }
+}
+
+// Token cache layout. The header is followed by the values, directives,
+// offsets, ends, line starts, types and strings, each padded to 8 bytes.
+// Identifiers and extension names refer to the strings, each of which is
+// stored once and NUL terminated.
+static const char kTokenCacheMagic[8] = { 'G', 'L', 'S', 'L', 'T', 'O', 'K', 'S' };
+static const unsigned kTokenCacheVersion = 1;
+
+struct tokenCacheHeader {
+    char magic[8];
+    unsigned version;
+    unsigned lexemes;
+    unsigned layout;
+    unsigned tokens;
+    unsigned directives;
+    unsigned lines;
+    unsigned strings; // In bytes
+    unsigned error; // Where the error message is in the strings plus one, 0 when none
+    unsigned errorOffset;
+    unsigned reserved;
+};
+
+// Sizes of what is stored as is, and byte order
+static unsigned tokenCacheLayout() {
+    const unsigned one = 1;
+    return unsigned(sizeof(tokenArray::value))
+        | unsigned(sizeof(directive)) << 8
+        | unsigned(sizeof(size_t)) << 16
+        | unsigned(*(const unsigned char *)&one) << 24;
+}
+
+static inline unsigned long long tokenCachePadded(unsigned long long size) {
+    return (size + 7) & ~7ull;
+}
+
+// Offset of text in strings, adding it if it is not there yet. Slots hold
+// offsets plus one, zero for free ones.
+static unsigned internString(vector<char> &strings, vector<unsigned> &slots, const char *text, size_t length) {
+    unsigned hash = kKeywordHashBasis;
+    for (size_t i = 0; i < length; i++)
+        hash = keywordHashStep(hash, text[i]);
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        if (!slots[slot]) {
+            const unsigned offset = unsigned(strings.size());
+            for (size_t i = 0; i < length; i++)
+                strings.push_back(text[i]);
+            strings.push_back('\0');
+            slots[slot] = offset + 1;
+            return offset;
+        }
+        const char *existing = &strings[slots[slot] - 1];
+        if (!memcmp(existing, text, length) && !existing[length])
+            return slots[slot] - 1;
+    }
+}
+
+template <typename T>
+static void appendSection(vector<unsigned char> &cache, const T *data, size_t count) {
+    const size_t at = cache.size();
+    cache.resize(size_t(tokenCachePadded(at + count * sizeof(T))));
+    if (count)
+        memcpy(&cache[at], data, count * sizeof(T));
+}
+
+template <typename T>
+static void copySection(vector<T> &into, const unsigned char *data, size_t count) {
+    into.resize(count);
+    if (count)
+        memcpy(&into[0], data, count * sizeof(T));
+}
+
+bool lexer::saveTokens(vector<unsigned char> &cache) const {
+    if (!m_tokenized)
+        return false;
+    settle();
+
+    const size_t count = m_tokens.size();
+    vector<tokenArray::value> values = m_tokens.values;
+    vector<directive> directives = m_tokens.directives;
+    vector<char> strings(m_memory);
+    vector<unsigned> slots(m_memory);
+    size_t capacity = 64;
+    while (capacity < count * 2)
+        capacity *= 2;
+    slots.resize(capacity);
+
+    for (size_t i = 0; i < count; i++) {
+        if (m_tokens.types[i] != kType_identifier)
+            continue;
+        const size_t offset = m_cached ? values[i].asIdentifier.text : m_tokens.offsets[i];
+        values[i].asIdentifier.text = internString(strings, slots, m_data + offset, values[i].asIdentifier.length);
+    }
+    for (size_t i = 0; i < directives.size(); i++) {
+        if (directives[i].type != directive::kExtension)
+            continue;
+        span &name = directives[i].asExtension.name;
+        name.offset = internString(strings, slots, m_data + name.offset, name.length);
+    }
+    unsigned error = 0;
+    if (m_tokens.error) {
+        error = unsigned(strings.size()) + 1;
+        for (const char *letter = m_tokens.error; *letter; letter++)
+            strings.push_back(*letter);
+        strings.push_back('\0');
+    }
+
+    // Where each token ends, for diagnostics once the source is gone
+    vector<unsigned> ends = m_ends;
+    if (!m_cached) {
+        lexer scan(m_data, m_length);
+        token out;
+        ends.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            scan.m_position = m_tokens.offsets[i];
+            scan.read(out);
+            ends[i] = unsigned(scan.m_position);
+        }
+    }
+
+    locate(0); // Finds the line starts
+    vector<unsigned> lines(m_memory);
+    lines.resize(m_lineStarts.size());
+    for (size_t i = 0; i < lines.size(); i++)
+        lines[i] = unsigned(m_lineStarts[i]);
+
+    tokenCacheHeader header;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, kTokenCacheMagic, sizeof header.magic);
+    header.version = kTokenCacheVersion;
+    header.lexemes = kLexemesHash;
+    header.layout = tokenCacheLayout();
+    header.tokens = unsigned(count);
+    header.directives = unsigned(directives.size());
+    header.lines = unsigned(lines.size());
+    header.strings = unsigned(strings.size());
+    header.error = error;
+    header.errorOffset = unsigned(m_tokens.errorOffset);
+
+    cache.resize(0);
+    appendSection(cache, (const unsigned char *)&header, sizeof header);
+    appendSection(cache, count ? &values[0] : 0, count);
+    appendSection(cache, directives.empty() ? 0 : &directives[0], directives.size());
+    appendSection(cache, count ? &m_tokens.offsets[0] : 0, count);
+    appendSection(cache, count ? &ends[0] : 0, count);
+    appendSection(cache, &lines[0], lines.size());
+    appendSection(cache, count ? &m_tokens.types[0] : 0, count);
+    appendSection(cache, strings.empty() ? 0 : &strings[0], strings.size());
+    return true;
+}
+
+bool lexer::loadTokens(const void *cache, size_t size) {
+    const unsigned char *data = (const unsigned char *)cache;
+    tokenCacheHeader header;
+    if (!data || size < sizeof header)
+        return false;
+    memcpy(&header, data, sizeof header);
+    if (memcmp(header.magic, kTokenCacheMagic, sizeof header.magic)
+        || header.version != kTokenCacheVersion
+        || header.lexemes != kLexemesHash
+        || header.layout != tokenCacheLayout())
+        return false;
+
+    const unsigned long long count = header.tokens;
+    const unsigned long long sizes[] = {
+        sizeof header,
+        count * sizeof(tokenArray::value),
+        header.directives * (unsigned long long)sizeof(directive),
+        count * sizeof(unsigned),
+        count * sizeof(unsigned),
+        header.lines * (unsigned long long)sizeof(unsigned),
+        count,
+        header.strings
+    };
+    const unsigned char *sections[sizeof sizes / sizeof *sizes];
+    unsigned long long total = 0;
+    for (size_t i = 0; i < sizeof sizes / sizeof *sizes; i++) {
+        sections[i] = data + (total <= size ? total : 0);
+        total += tokenCachePadded(sizes[i]);
+    }
+    if (total != size || !header.lines)
+        return false;
+
+    // Only the parts which are used as indices are checked
+    const char *strings = (const char *)sections[7];
+    if (header.strings && strings[header.strings - 1])
+        return false;
+    if (header.error && header.error > header.strings)
+        return false;
+    tokenArray tokens(m_memory);
+    copySection(tokens.types, sections[6], count);
+    copySection(tokens.values, sections[1], count);
+    copySection(tokens.directives, sections[2], header.directives);
+    copySection(tokens.offsets, sections[3], count);
+    for (size_t i = 0; i < count; i++) {
+        const tokenArray::value &value = tokens.values[i];
+        // Lexing drops whitespace and comments, the parser never expects them
+        if (tokens.types[i] >= kTypeCount || tokens.types[i] == kType_whitespace || tokens.types[i] == kType_comment)
+            return false;
+        // Both index tables
+        if (tokens.types[i] == kType_keyword && (value.asKeyword < 0 || value.asKeyword >= kKeywordCount))
+            return false;
+        if (tokens.types[i] == kType_operator && (value.asOperator < 0 || value.asOperator >= kOperatorCount))
+            return false;
+        if (tokens.types[i] == kType_identifier && (!value.asIdentifier.length
+            || (unsigned long long)value.asIdentifier.text + value.asIdentifier.length > header.strings))
+            return false;
+        if (tokens.types[i] == kType_directive && value.asDirective >= header.directives)
+            return false;
+    }
+    for (size_t i = 0; i < tokens.directives.size(); i++) {
+        const directive &entry = tokens.directives[i];
+        if (entry.type == directive::kExtension
+            && (unsigned long long)entry.asExtension.name.offset + entry.asExtension.name.length > header.strings)
+            return false;
+    }
+    vector<unsigned> lines(m_memory);
+    copySection(lines, sections[5], header.lines);
+    if (lines[0])
+        return false;
+    m_lineStarts.resize(header.lines);
+    for (size_t i = 0; i < header.lines; i++) {
+        if (i && lines[i] <= lines[i - 1])
+            return false;
+        m_lineStarts[i] = lines[i];
+    }
+
+    tokens.error = header.error ? strings + header.error - 1 : 0;
+    tokens.errorOffset = header.errorOffset;
+    m_tokens = tokens;
+    m_gap = 0;
+    m_gapSize = 0;
+    m_shift = 0;
+    m_directiveTokens.resize(0);
+    copySection(m_ends, sections[4], count);
+    m_data = strings;
+    m_length = header.strings;
+    m_position = 0;
+    m_error = 0;
+    m_cursor = 0;
+    m_backupCursor = 0;
+    m_tokenized = true;
+    m_cached = true;
+    return true;
+}
+
+void lexer::store(tokenArray &tokens, const token &in, size_t offset) {
+    tokenArray::value value;
+    value.asDouble = 0.0;
+    switch (in.m_type) {
+    case kType_keyword:
+        value.asKeyword = in.asKeyword;
+        break;
+    case kType_identifier:
+        value.asIdentifier.length = unsigned(in.asIdentifier.length);
+        value.asIdentifier.text = 0;
+        break;
+    case kType_constant_int:
+        value.asInt = in.asInt;
+        break;
+    case kType_constant_uint:
+        value.asUnsigned = in.asUnsigned;
+        break;
+    case kType_constant_float:
+        value.asFloat = in.asFloat;
+        break;
+    case kType_constant_double:
+        value.asDouble = in.asDouble;
+        break;
+    case kType_operator:
+        value.asOperator = in.asOperator;
+        break;
+    case kType_directive:
+        value.asDirective = unsigned(tokens.directives.size());
+        tokens.directives.push_back(in.asDirective);
+        break;
+    }
+    tokens.types.push_back((unsigned char)in.m_type);
+    tokens.values.push_back(value);
+    tokens.offsets.push_back(unsigned(offset));
+}
+
+void lexer::load(token &out, size_t index) const {
+    const tokenArray::value &value = m_tokens.values[index];
+    out.m_type = m_tokens.types[index];
+    switch (out.m_type) {
+    case kType_keyword:
+        out.asKeyword = value.asKeyword;
+        break;
+    case kType_identifier:
+        out.asIdentifier.offset = m_cached ? value.asIdentifier.text : m_tokens.offsets[index];
+        out.asIdentifier.length = value.asIdentifier.length;
+        break;
+    case kType_constant_int:
+        out.asInt = value.asInt;
+        break;
+    case kType_constant_uint:
+        out.asUnsigned = value.asUnsigned;
+        break;
+    case kType_constant_float:
+        out.asFloat = value.asFloat;
+        break;
+    case kType_constant_double:
+        out.asDouble = value.asDouble;
+        break;
+    case kType_operator:
+        out.asOperator = value.asOperator;
+        break;
+    case kType_directive:
+        out.asDirective = m_tokens.directives[value.asDirective];
+        break;
+    }
+}
+
 const char *lexer::error() const {
     return m_error;
 }
 
 void lexer::backup() {
-    m_backup = m_location;
+    if (m_tokenized)
+        m_backupCursor = m_cursor;
+    else
+        m_backup = m_position;
 }
 
 void lexer::restore() {
-    m_location = m_backup;
+    if (m_tokenized)
+        m_cursor = m_backupCursor;
+    else
+        m_position = m_backup;
+}
+
+size_t lexer::line() const {
+    return where().line;
+}
+
+size_t lexer::column() const {
+    return where().column;
+}
+
+// Where the lexer is as far as diagnostics are concerned, which is just
+// past the last token read.
+location lexer::where() const {
+    if (!m_tokenized)
+        return locate(m_position);
+    settle();
+    if (m_error)
+        return locate(m_tokens.errorOffset);
+    if (m_cursor == 0)
+        return location();
+    const size_t index = m_cursor - 1;
+    if (m_cached)
+        return locate(m_ends[index]);
+    if (m_tokens.types[index] == kType_eof)
+        return locate(m_length);
+    // The token array only knows where tokens start, so lex this one again
+    // to find its end. This only happens when reporting an error.
+    const size_t offset = m_tokens.offsets[index];
+    lexer scan(m_data + offset, m_length - offset);
+    token out;
+    scan.read(out);
+    return locate(offset + scan.position());
+}
+
+location lexer::locate(size_t position) const {
+    // Line starts are only found the first time a location is asked for
+    if (m_lineStarts.empty()) {
+        m_lineStarts.push_back(0);
+        for (size_t at = findNewline(m_data, 0, m_length); at != m_length; at = findNewline(m_data, at + 1, m_length))
+            m_lineStarts.push_back(at + 1);
+    }
+    // Last line starting at or before position
+    size_t lo = 0;
+    size_t hi = m_lineStarts.size();
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (m_lineStarts[mid] <= position)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    location where;
+    where.line = lo + 1;
+    where.column = position - m_lineStarts[lo] + 1;
+    where.position = position;
+    return where;
 }
 
 }
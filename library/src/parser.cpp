@@ -1,25 +1,120 @@
-#include <string.h> // strcmp, memcpy
+#include <new>      // placement new
+#include <string.h> // strcmp, strncmp, memcpy
 
+#include "glsl-parser/builtins.h"
 #include "glsl-parser/parser.h"
 #include "glsl-parser/util.h"
 
 namespace glsl {
 
-parser::parser(const char *source, const char *fileName)
+parser::parser(const char *source, const char *fileName, const allocator *memory)
     : m_ast(0)
-    , m_lexer(source)
+    , m_allocator(memory)
+    , m_builtinTable(&builtinTable::instance())
+    , m_lexer(source, memory)
+    , m_symbols(memory)
+    , m_shadows(memory)
+    , m_scopes(memory)
+    , m_typeNames(memory)
+    , m_functionNames(memory)
+    , m_overloads(memory)
+    , m_builtins(memory)
     , m_fileName(fileName)
+    , m_memory(memory)
+    , m_names(memory, &m_builtinTable->names())
+    , m_strings(memory)
+    , m_operands(memory)
+    , m_shared(memory)
+    , m_valueTypes(memory)
+    , m_sharedCount(0)
+    , m_share(false)
 {
-    m_oom = strnew("Out of memory");
-    m_error = strnew("");
+    prepare();
+}
+
+parser::parser(const char *source, size_t length, const char *fileName, const allocator *memory)
+    : m_ast(0)
+    , m_allocator(memory)
+    , m_builtinTable(&builtinTable::instance())
+    , m_lexer(source, length, memory)
+    , m_symbols(memory)
+    , m_shadows(memory)
+    , m_scopes(memory)
+    , m_typeNames(memory)
+    , m_functionNames(memory)
+    , m_overloads(memory)
+    , m_builtins(memory)
+    , m_fileName(fileName)
+    , m_memory(memory)
+    , m_names(memory, &m_builtinTable->names())
+    , m_strings(memory)
+    , m_operands(memory)
+    , m_shared(memory)
+    , m_valueTypes(memory)
+    , m_sharedCount(0)
+    , m_share(false)
+{
+    prepare();
+}
+
+parser::parser(const builtinTable *builtins)
+    : m_ast(0)
+    , m_allocator(0)
+    , m_builtinTable(builtins)
+    , m_lexer(0)
+    , m_symbols(0)
+    , m_shadows(0)
+    , m_scopes(0)
+    , m_typeNames(0)
+    , m_functionNames(0)
+    , m_overloads(0)
+    , m_builtins(0)
+    , m_fileName(0)
+    , m_memory(0)
+    , m_names(0, builtins ? &builtins->names() : 0)
+    , m_strings(0)
+    , m_operands(0)
+    , m_shared(0)
+    , m_valueTypes(0)
+    , m_sharedCount(0)
+    , m_share(false)
+{
+    prepare();
 }
 
 parser::~parser() {
-    delete m_ast;
+    if (m_ast) {
+        m_ast->~astTU();
+        memdel(m_allocator, m_ast);
+    }
     for (size_t i = 0; i < m_strings.size(); i++)
-        free(m_strings[i]);
-    for (size_t i = 0; i < m_memory.size(); i++)
-        m_memory[i].destroy();
+        memdel(m_allocator, m_strings[i]);
+}
+
+void parser::reset(const char *source, size_t length, const char *fileName) {
+    for (size_t i = 0; i < m_strings.size(); i++)
+        memdel(m_allocator, m_strings[i]);
+    m_strings.resize(0);
+    m_memory.reset();
+    m_lexer.reset(source, length);
+    m_symbols.resize(0);
+    m_shadows.resize(0);
+    m_scopes.resize(0);
+    m_typeNames.resize(0);
+    m_functionNames.resize(0);
+    m_overloads.resize(0);
+    m_builtins.resize(0);
+    m_names.clear();
+    m_operands.resize(0);
+    for (size_t i = 0; i < m_shared.size(); i++)
+        m_shared[i] = 0;
+    m_sharedCount = 0;
+    m_fileName = fileName;
+    prepare();
+}
+
+void parser::shareExpressions(bool enable) {
+    m_share = enable;
 }
 
 #define IS_TYPE(TOKEN, TYPE) \
@@ -88,11 +183,11 @@ bool parser::isConstantValue(astExpression *expression) const {
 #define DCONST(X) ((astDoubleConstant*)(X))
 #define BCONST(X) ((astBoolConstant*)(X))
 
-#define ICONST_NEW(X) GC_NEW(astConstantExpression) astIntConstant(X)
-#define UCONST_NEW(X) GC_NEW(astConstantExpression) astUIntConstant(X)
-#define FCONST_NEW(X) GC_NEW(astConstantExpression) astFloatConstant(X)
-#define DCONST_NEW(X) GC_NEW(astConstantExpression) astDoubleConstant(X)
-#define BCONST_NEW(X) GC_NEW(astConstantExpression) astBoolConstant(X)
+#define ICONST_NEW(X) share(GC_NEW(astConstantExpression) astIntConstant(X))
+#define UCONST_NEW(X) share(GC_NEW(astConstantExpression) astUIntConstant(X))
+#define FCONST_NEW(X) share(GC_NEW(astConstantExpression) astFloatConstant(X))
+#define DCONST_NEW(X) share(GC_NEW(astConstantExpression) astDoubleConstant(X))
+#define BCONST_NEW(X) share(GC_NEW(astConstantExpression) astBoolConstant(X))
 
 #define IVAL(X) (ICONST(X)->value)
 #define UVAL(X) (UCONST(X)->value)
@@ -110,7 +205,7 @@ astConstantExpression *parser::evaluate(astExpression *expression) {
         astExpression *operand = evaluate(((astUnaryExpression*)expression)->operand);
         if (!operand) return 0;
         switch (operand->type) {
-        case astExpression::kIntConstant:    return ICONST_NEW(-IVAL(operand));
+        case astExpression::kIntConstant:    return ICONST_NEW(int(0u - unsigned(IVAL(operand))));
         case astExpression::kFloatConstant:  return FCONST_NEW(-FVAL(operand));
         case astExpression::kDoubleConstant: return DCONST_NEW(-DVAL(operand));
         default:
@@ -136,15 +231,29 @@ astConstantExpression *parser::evaluate(astExpression *expression) {
         astExpression *rhs = evaluate(((astBinaryExpression*)expression)->operand2);
         if (!lhs) return 0;
         if (!rhs) return 0;
+        // Integers wrap around. Dividing by zero and shifting by 32 bits or
+        // more are undefined, so they are errors instead
+        const bool isInteger = lhs->type == astExpression::kIntConstant || lhs->type == astExpression::kUIntConstant;
+        const unsigned amount = lhs->type == astExpression::kIntConstant ? unsigned(IVAL(rhs)) : UVAL(rhs);
+        if (isInteger && !amount && (operation == kOperator_divide || operation == kOperator_modulus)) {
+            fatal("division by zero in constant expression");
+            return 0;
+        }
+        if (isInteger && amount > 31 && (operation == kOperator_shift_left || operation == kOperator_shift_right)) {
+            fatal("shift out of range in constant expression");
+            return 0;
+        }
         switch (lhs->type) {
         case astExpression::kIntConstant:
+            if (IVAL(rhs) == -1 && (operation == kOperator_divide || operation == kOperator_modulus))
+                return ICONST_NEW(operation == kOperator_divide ? int(0u - unsigned(IVAL(lhs))) : 0);
             switch (operation) {
-            case kOperator_multiply:       return ICONST_NEW(IVAL(lhs) * IVAL(rhs));
+            case kOperator_multiply:       return ICONST_NEW(int(unsigned(IVAL(lhs)) * unsigned(IVAL(rhs))));
             case kOperator_divide:         return ICONST_NEW(IVAL(lhs) / IVAL(rhs));
             case kOperator_modulus:        return ICONST_NEW(IVAL(lhs) % IVAL(rhs));
-            case kOperator_plus:           return ICONST_NEW(IVAL(lhs) + IVAL(rhs));
-            case kOperator_minus:          return ICONST_NEW(IVAL(lhs) - IVAL(rhs));
-            case kOperator_shift_left:     return ICONST_NEW(IVAL(lhs) << IVAL(rhs));
+            case kOperator_plus:           return ICONST_NEW(int(unsigned(IVAL(lhs)) + unsigned(IVAL(rhs))));
+            case kOperator_minus:          return ICONST_NEW(int(unsigned(IVAL(lhs)) - unsigned(IVAL(rhs))));
+            case kOperator_shift_left:     return ICONST_NEW(int(unsigned(IVAL(lhs)) << IVAL(rhs)));
             case kOperator_shift_right:    return ICONST_NEW(IVAL(lhs) >> IVAL(rhs));
             case kOperator_less:           return BCONST_NEW(IVAL(lhs) < IVAL(rhs));
             case kOperator_greater:        return BCONST_NEW(IVAL(lhs) > IVAL(rhs));
@@ -249,37 +358,37 @@ astConstantExpression *parser::evaluate(astExpression *expression) {
 void parser::fatal(const char *fmt, ...) {
     // Format banner
     char *banner = 0;
-    int bannerLength = allocfmt(&banner, "%s:%zu:%zu: error: ", m_fileName, m_lexer.line(), m_lexer.column());
+    int bannerLength = allocfmt(m_allocator, &banner, "%s:%zu:%zu: error: ", m_fileName, m_lexer.line(), m_lexer.column());
     if (bannerLength == -1) {
-        m_error = m_oom;
+        m_error = strnew(fmt); // Only when vsnprintf fails, memory does not run out
         return;
     }
 
-    // Format message
+    // Format message, a lexer error ends the tokens so whatever failed after
+    // one did so because of it
     char *message = 0;
-    va_list va;
-    va_start(va, fmt);
-    int messageLength = allocvfmt(&message, fmt, va);
-    if (messageLength == -1) {
+    int messageLength;
+    if (m_lexer.error()) {
+        messageLength = allocfmt(m_allocator, &message, "%s", m_lexer.error());
+    } else {
+        va_list va;
+        va_start(va, fmt);
+        messageLength = allocvfmt(m_allocator, &message, fmt, va);
         va_end(va);
-        m_error = m_oom;
+    }
+    if (messageLength == -1) {
+        memdel(m_allocator, banner);
+        m_error = strnew(fmt);
         return;
     }
-    va_end(va);
 
     // Concatenate the two things
-    char *concat = (char *)malloc(bannerLength + messageLength + 1);
-    if (!concat) {
-        free(banner);
-        free(message);
-        m_error = m_oom;
-        return;
-    }
+    char *concat = (char *)memnew(m_allocator, bannerLength + messageLength + 1);
 
     memcpy(concat, banner, bannerLength);
     memcpy(concat + bannerLength, message, messageLength + 1); // +1 for '\0'
-    free(banner);
-    free(message);
+    memdel(m_allocator, banner);
+    memdel(m_allocator, message);
 
     m_error = concat;
     m_strings.push_back(m_error);
@@ -301,10 +410,22 @@ bool parser::isBuiltin() const {
 #undef TYPENAME
 #define TYPENAME(...)
 
+CHECK_RETURN bool parser::loadTokens(const void *cache, size_t size) {
+    return m_lexer.loadTokens(cache, size);
+}
+
 /// The parser entry point
 CHECK_RETURN astTU *parser::parse(int type) {
-    m_ast = new astTU(type);
-    m_scopes.push_back(scope());
+    if (m_ast) {
+        m_ast->clear(type);
+    } else {
+        void *memory = memnew(m_allocator, sizeof(astTU));
+        m_ast = new(memory) astTU(type, m_allocator);
+    }
+    prepareValueTypes();
+    pushScope();
+    if (!m_lexer.tokenized())
+        m_lexer.tokenize();
     for (;;) {
         m_lexer.read(m_token, true);
 
@@ -330,13 +451,13 @@ CHECK_RETURN astTU *parser::parse(int type) {
             } else if (m_token.asDirective.type == directive::kExtension) {
                 astExtensionDirective *extension = GC_NEW(astExtensionDirective) astExtensionDirective();
                 extension->behavior = m_token.asDirective.asExtension.behavior;
-                extension->name = strnew(m_token.asDirective.asExtension.name);
+                extension->name = intern(m_token.asDirective.asExtension.name);
                 m_ast->extensionDirectives.push_back(extension);
             }
             continue;
         }
 
-        vector<topLevel> items;
+        vector<topLevel> items(m_allocator);
         if (!parseTopLevel(items))
             return 0;
 
@@ -350,18 +471,18 @@ CHECK_RETURN astTU *parser::parse(int type) {
                 global->precision = parse.precision;
                 global->interpolation = parse.interpolation;
                 global->baseType = parse.type;
-                global->name = strnew(parse.name);
+                global->name = parse.name;
                 global->isInvariant = parse.isInvariant;
                 global->isPrecise = parse.isPrecise;
-                global->layoutQualifiers = parse.layoutQualifiers;
+                global->layoutQualifiers.assign(&m_memory, parse.layoutQualifiers.begin(), parse.layoutQualifiers.end());
                 if (parse.initialValue) {
                     if (!(global->initialValue = evaluate(parse.initialValue)))
                         return 0;
                 }
                 global->isArray = parse.isArray;
-                global->arraySizes = parse.arraySizes;
+                global->arraySizes.assign(&m_memory, parse.arraySizes.begin(), parse.arraySizes.end());
                 m_ast->globals.push_back(global);
-                m_scopes.back().push_back(global);
+                declare(global);
             }
         } else if (isOperator(kOperator_paranthesis_begin)) {
             astFunction *function = parseFunction(items.front());
@@ -541,6 +662,16 @@ static struct {
     { "depth_unchanged",            false }
 };
 
+static const size_t kLayoutQualifierCount = sizeof kLayoutQualifiers / sizeof *kLayoutQualifiers;
+
+void parser::prepare() {
+    m_error = strnew("");
+    // Interned first so the id of a layout qualifier name is its index
+    for (size_t i = 0; i < kLayoutQualifierCount; i++)
+        m_names.intern(kLayoutQualifiers[i].qualifier);
+    m_main = m_names.intern("main");
+}
+
 CHECK_RETURN bool parser::parseLayout(topLevel &current) {
     vector<astLayoutQualifier*> &qualifiers = current.layoutQualifiers;
     if (isKeyword(kKeyword_layout)) {
@@ -561,14 +692,9 @@ CHECK_RETURN bool parser::parseLayout(topLevel &current) {
             if (!isType(kType_identifier) && !isKeyword(kKeyword_shared))
                 return false;
 
-            int found = -1;
-            qualifier->name = strnew(isType(kType_identifier) ? m_token.asIdentifier : "shared");
-            for (size_t i = 0; i < sizeof(kLayoutQualifiers)/sizeof(kLayoutQualifiers[0]); i++) {
-                if (strcmp(qualifier->name, kLayoutQualifiers[i].qualifier))
-                    continue;
-                found = int(i);
-                break;
-            }
+            qualifier->name = isType(kType_identifier) ? intern(m_token.asIdentifier) : m_names.intern("shared");
+            const unsigned id = interner::id(qualifier->name);
+            const int found = id < kLayoutQualifierCount ? int(id) : -1;
 
             if (found == -1) {
                 fatal("unknown layout qualifier `%s'", qualifier->name);
@@ -662,17 +788,18 @@ static bool isReservedKeyword(int keyword) {
 }
 
 CHECK_RETURN bool parser::parseTopLevelItem(topLevel &level, topLevel *continuation) {
-    vector<topLevel> items;
+    vector<topLevel> items(m_allocator);
     while (!isBuiltin() && !isType(kType_identifier)) {
         // If this is an empty file don't get caught in this loop indefinitely
         token peek = m_lexer.peek();
         if (IS_TYPE(peek, kType_eof))
             return false;
 
-        topLevel item;
+        topLevel item(m_allocator);
         if (continuation)
             item = *continuation;
 
+        const size_t start = m_lexer.consumed();
         if (!parseStorage(item))       return false;
         if (!parseAuxiliary(item))     return false;
         if (!parseInterpolation(item)) return false;
@@ -693,7 +820,8 @@ CHECK_RETURN bool parser::parseTopLevelItem(topLevel &level, topLevel *continuat
             astInterfaceBlock *unique = parseInterfaceBlock(item.storage);
             if (!unique)
                 return false;
-            m_ast->interfaceBlocks.push_back(unique);
+            if (!defineInterfaceBlock(unique))
+                return false;
             if (isType(kType_semicolon)) {
                 return true;
             } else {
@@ -704,13 +832,18 @@ CHECK_RETURN bool parser::parseTopLevelItem(topLevel &level, topLevel *continuat
             astStruct *unique = parseStruct();
             if (!unique)
                 return false;
-            m_ast->structures.push_back(unique);
+            if (!defineStructure(unique))
+                return false;
             if (isType(kType_semicolon))
             {
                 return true;
             } else {
                 level.type = unique;
             }
+        } else if (m_lexer.consumed() == start) {
+            // Not a qualifier either, it would be looked at forever
+            fatal("expected typename");
+            return false;
         } else {
             items.push_back(item);
         }
@@ -834,7 +967,7 @@ CHECK_RETURN bool parser::parseTopLevelItem(topLevel &level, topLevel *continuat
     }
 
     if (isType(kType_identifier)) {
-        level.name = strnew(m_token.asIdentifier);
+        level.name = intern(m_token.asIdentifier);
         if (!next())// skip identifier
             return false;
     }
@@ -865,7 +998,7 @@ CHECK_RETURN bool parser::parseTopLevelItem(topLevel &level, topLevel *continuat
 
     // If it isn't a function or prototype than the use of void is not legal
     if (!isOperator(kOperator_paranthesis_begin)) {
-        if (level.type->builtin && ((astBuiltin*)level.type)->type == kKeyword_void) {
+        if (level.type->kind == astType::kBuiltin && ((astBuiltin*)level.type)->type == kKeyword_void) {
             fatal("`void' cannot be used in declaration");
             return false;
         }
@@ -881,7 +1014,7 @@ CHECK_RETURN bool parser::parseTopLevelItem(topLevel &level, topLevel *continuat
 }
 
 CHECK_RETURN bool parser::parseTopLevel(vector<topLevel> &items) {
-    topLevel item;
+    topLevel item(m_allocator);
     if (!parseTopLevelItem(item))
         return false;
     if (item.type)
@@ -889,7 +1022,7 @@ CHECK_RETURN bool parser::parseTopLevel(vector<topLevel> &items) {
     while (items.size() && isOperator(kOperator_comma)) {
         if (!next())
             return false; // skip ','
-        topLevel nextItem;
+        topLevel nextItem(m_allocator);
         if (!parseTopLevelItem(nextItem, &items.front()))
             return false;
         if (nextItem.type)
@@ -903,7 +1036,7 @@ CHECK_RETURN T *parser::parseBlock(const char* type) {
     T *unique = GC_NEW(astType) T;
 
     if (isType(kType_identifier)) {
-        unique->name = strnew(m_token.asIdentifier);
+        unique->name = intern(m_token.asIdentifier);
         if (!next()) return 0; // skip identifier
     }
 
@@ -914,7 +1047,7 @@ CHECK_RETURN T *parser::parseBlock(const char* type) {
 
     if (!next()) return 0; // skip '{'
 
-    vector<topLevel> items;
+    vector<topLevel> items(m_allocator);
     while (!isType(kType_scope_end)) {
         if (!parseTopLevel(items))
             return 0;
@@ -926,11 +1059,11 @@ CHECK_RETURN T *parser::parseBlock(const char* type) {
         topLevel &parse = items[i];
         astVariable *field = GC_NEW(astVariable) astVariable(astVariable::kField);
         field->baseType = parse.type;
-        field->name = strnew(parse.name);
+        field->name = parse.name;
         field->isPrecise = parse.isPrecise;
         field->isArray = parse.isArray;
-        field->arraySizes = parse.arraySizes;
-        unique->fields.push_back(field);
+        field->arraySizes.assign(&m_memory, parse.arraySizes.begin(), parse.arraySizes.end());
+        unique->fields.push_back(&m_memory, field);
     }
 
     if (!next()) return 0; // skip '}'
@@ -974,7 +1107,7 @@ CHECK_RETURN astInterfaceBlock *parser::parseInterfaceBlock(int storage) {
                 fatal("'%s` is already declared in this scope", variable->name);
                 return 0;
             }
-            m_scopes.back().push_back(unique->fields[i]);
+            declare(unique->fields[i]);
         }
     }
 
@@ -991,7 +1124,8 @@ CHECK_RETURN astExpression *parser::parseBinary(int lhsPrecedence, astExpression
         if (binaryPrecedence < lhsPrecedence)
             break;
 
-        astBinaryExpression *expression = createExpression();
+        // The node is placed once both operands are so it can be shared
+        const token operation = m_token;
         if (!next())
             return 0;
 
@@ -1001,7 +1135,7 @@ CHECK_RETURN astExpression *parser::parseBinary(int lhsPrecedence, astExpression
         if (!next())
             return 0;
 
-        if (((astExpression*)expression)->type == astExpression::kAssign) {
+        if (IS_OPERATOR(operation, kOperator_assign)) {
             astExpression *find = lhs;
             while (find->type == astExpression::kArraySubscript
                 || find->type == astExpression::kFieldOrSwizzle)
@@ -1014,7 +1148,7 @@ CHECK_RETURN astExpression *parser::parseBinary(int lhsPrecedence, astExpression
                 fatal("not a valid lvalue");
                 return 0;
             }
-            astVariable *variable = ((astVariableIdentifier*)lhs)->variable;
+            astVariable *variable = ((astVariableIdentifier*)find)->variable;
             if (variable->type == astVariable::kGlobal) {
                 astGlobalVariable *global = (astGlobalVariable*)variable;
                 // "It's a compile-time error to write to a variable declared as an input"
@@ -1038,9 +1172,12 @@ CHECK_RETURN astExpression *parser::parseBinary(int lhsPrecedence, astExpression
                 return 0;
         }
 
+        astBinaryExpression *expression = createExpression(operation);
+        if (!expression)
+            return 0;
         expression->operand1 = lhs;
         expression->operand2 = rhs;
-        lhs = expression;
+        lhs = share(expression);
     }
     return lhs;
 }
@@ -1051,22 +1188,28 @@ CHECK_RETURN astExpression *parser::parseUnaryPrefix(endCondition condition) {
         return parseExpression(kEndConditionParanthesis);
     } else if (isOperator(kOperator_logical_not)) {
         if (!next()) return 0; // skip '!'
-        return GC_NEW(astExpression) astUnaryLogicalNotExpression(parseUnary(condition));
+        astExpression *operand = parseUnary(condition);
+        return operand ? share(GC_NEW(astExpression) astUnaryLogicalNotExpression(operand)) : 0;
     } else if (isOperator(kOperator_bit_not)) {
         if (!next()) return 0; // skip '~'
-        return GC_NEW(astExpression) astUnaryBitNotExpression(parseUnary(condition));
+        astExpression *operand = parseUnary(condition);
+        return operand ? share(GC_NEW(astExpression) astUnaryBitNotExpression(operand)) : 0;
     } else if (isOperator(kOperator_plus)) {
         if (!next()) return 0; // skip '+'
-        return GC_NEW(astExpression) astUnaryPlusExpression(parseUnary(condition));
+        astExpression *operand = parseUnary(condition);
+        return operand ? share(GC_NEW(astExpression) astUnaryPlusExpression(operand)) : 0;
     } else if (isOperator(kOperator_minus)) {
         if (!next()) return 0; // skip '-'
-        return GC_NEW(astExpression) astUnaryMinusExpression(parseUnary(condition));
+        astExpression *operand = parseUnary(condition);
+        return operand ? share(GC_NEW(astExpression) astUnaryMinusExpression(operand)) : 0;
     } else if (isOperator(kOperator_increment)) {
         if (!next()) return 0; // skip '++'
-        return GC_NEW(astExpression) astPrefixIncrementExpression(parseUnary(condition));
+        astExpression *operand = parseUnary(condition);
+        return operand ? share(GC_NEW(astExpression) astPrefixIncrementExpression(operand)) : 0;
     } else if (isOperator(kOperator_decrement)) {
         if (!next()) return 0; // skip '--'
-        return GC_NEW(astExpression) astPrefixDecrementExpression(parseUnary(condition));
+        astExpression *operand = parseUnary(condition);
+        return operand ? share(GC_NEW(astExpression) astPrefixDecrementExpression(operand)) : 0;
     } else if (isBuiltin()) {
         return parseConstructorCall();
     } else if (isType(kType_identifier)) {
@@ -1080,8 +1223,9 @@ CHECK_RETURN astExpression *parser::parseUnaryPrefix(endCondition condition) {
         } else {
             astVariable *find = findVariable(m_token.asIdentifier);
             if (find)
-                return GC_NEW(astExpression) astVariableIdentifier(find);
-            fatal("`%s' was not declared in this scope", m_token.asIdentifier);
+                return share(GC_NEW(astExpression) astVariableIdentifier(find));
+            fatal("`%.*s' was not declared in this scope",
+                int(m_token.asIdentifier.length), m_lexer.text(m_token.asIdentifier));
             return 0;
         }
     } else if (isKeyword(kKeyword_true)) {
@@ -1103,25 +1247,21 @@ CHECK_RETURN astExpression *parser::parseUnaryPrefix(endCondition condition) {
     return 0;
 }
 
-astType* parser::getType(astExpression *expression)
-{
-    switch (expression->type)
-    {
-    case astExpression::kVariableIdentifier:
-        return ((astVariableIdentifier*)expression)->variable->baseType;
-    case astExpression::kFieldOrSwizzle:
-        return getType(((astFieldOrSwizzle*)expression)->operand);
-    case astExpression::kArraySubscript:
-        return getType(((astArraySubscript*)expression)->operand);
-    case astExpression::kFunctionCall:
-        for (size_t i = 0; i < m_ast->functions.size(); i++) {
-            if (strcmp(m_ast->functions[i]->name, ((astFunctionCall*)expression)->name))
-                continue;
-            return m_ast->functions[i]->returnType;
-        }
-        break;
-    case astExpression::kConstructorCall:
-        return ((astConstructorCall*)expression)->type;
+astType* parser::getType(astExpression *expression) {
+    return m_ast->valueTypes[expression->valueType].type;
+}
+
+astVariable *parser::findField(astType *type, const char *name) {
+    const astArray<astVariable*> *fields = 0;
+    if (type->kind == astType::kStruct)
+        fields = &((astStruct*)type)->fields;
+    else if (type->kind == astType::kInterfaceBlock)
+        fields = &((astInterfaceBlock*)type)->fields;
+    else
+        return 0;
+    for (size_t i = 0; i < fields->size(); i++) {
+        if ((*fields)[i]->name == name)
+            return (*fields)[i];
     }
     return 0;
 }
@@ -1139,37 +1279,31 @@ CHECK_RETURN astExpression *parser::parseUnary(endCondition end) {
                 fatal("expected field identifier or swizzle after `.'");
                 return 0;
             }
-            astFieldOrSwizzle *expression = GC_NEW(astExpression) astFieldOrSwizzle();
-
-            astType *type = getType(operand);
-            if (type && !type->builtin) {
-                astVariable *field = 0;
-                astStruct *kind = (astStruct*)type;
-                for (size_t i = 0; i < kind->fields.size(); i++) {
-                    if (strcmp(kind->fields[i]->name, m_token.asIdentifier))
-                        continue;
-                    field = kind->fields[i];
-                    break;
-                }
-                if (!field) {
-                    fatal("field `%s' does not exist in structure `%s'", m_token.asIdentifier, kind->name);
-                    return 0;
-                }
+            const char *name = intern(m_token.asIdentifier);
+
+            const astValueType &of = m_ast->valueTypes[operand->valueType];
+            if (of.type && of.type->kind != astType::kBuiltin && !of.arrayDimensions && !findField(of.type, name)) {
+                const bool block = of.type->kind == astType::kInterfaceBlock;
+                const char *typeName = block ? ((astInterfaceBlock*)of.type)->name : ((astStruct*)of.type)->name;
+                fatal("field `%.*s' does not exist in %s `%s'",
+                    int(m_token.asIdentifier.length), m_lexer.text(m_token.asIdentifier),
+                    block ? "interface block" : "structure", typeName ? typeName : "");
+                return 0;
             }
 
+            astFieldOrSwizzle *expression = GC_NEW(astExpression) astFieldOrSwizzle();
             expression->operand = operand;
-            expression->name = strnew(m_token.asIdentifier);
-            operand = expression;
+            expression->name = name;
+            operand = share(expression);
         } else if (IS_OPERATOR(peek, kOperator_increment)) {
             if (!next()) return 0; // skip last
-            operand = GC_NEW(astExpression) astPostIncrementExpression(operand);
+            operand = share(GC_NEW(astExpression) astPostIncrementExpression(operand));
         } else if (IS_OPERATOR(peek, kOperator_decrement)) {
             if (!next()) return 0; // skip last
-            operand = GC_NEW(astExpression) astPostDecrementExpression(operand);
+            operand = share(GC_NEW(astExpression) astPostDecrementExpression(operand));
         } else if (IS_OPERATOR(peek, kOperator_bracket_begin)) {
             if (!next()) return 0; // skip last
             if (!next()) return 0; // skip '['
-            astArraySubscript *expression = GC_NEW(astExpression) astArraySubscript();
             astExpression *find = operand;
             while (find->type == astExpression::kArraySubscript)
                 find = ((astArraySubscript*)find)->operand;
@@ -1177,30 +1311,36 @@ CHECK_RETURN astExpression *parser::parseUnary(endCondition end) {
                 fatal("cannot be subscripted");
                 return 0;
             }
-            expression->operand = operand;
-            if (!(expression->index = parseExpression(kEndConditionBracket)))
+            astExpression *index = parseExpression(kEndConditionBracket);
+            if (!index)
                 return 0;
-            if (isConstant(expression->index)) {
-                if (!(expression->index = evaluate(expression->index)))
+            if (isConstant(index)) {
+                if (!(index = evaluate(index)))
                     return 0;
             }
-            operand = expression;
+            astArraySubscript *expression = GC_NEW(astExpression) astArraySubscript();
+            expression->operand = operand;
+            expression->index = index;
+            operand = share(expression);
         } else if (IS_OPERATOR(peek, kOperator_questionmark)) {
             if (!next()) return 0; // skip last
             if (!next()) return 0; // skip '?'
-            astTernaryExpression *expression = GC_NEW(astExpression) astTernaryExpression();
-            expression->condition = operand;
-            expression->onTrue = parseExpression(kEndConditionColon);
+            astExpression *onTrue = parseExpression(kEndConditionColon);
             if (!isOperator(kOperator_colon)) {
                 fatal("expected `:' for else case in ternary statement");
                 return 0;
             }
             if (!next()) return 0; // skip ':'
-            if (!(expression->onFalse = parseUnary(end))) {
+            astExpression *onFalse = parseUnary(end);
+            if (!onFalse) {
                 fatal("expected expression after `:' in ternary statement");
                 return 0;
             }
-            operand = expression;
+            astTernaryExpression *expression = GC_NEW(astExpression) astTernaryExpression();
+            expression->condition = operand;
+            expression->onTrue = onTrue;
+            expression->onFalse = onFalse;
+            operand = share(expression);
         } else {
             break;
         }
@@ -1235,7 +1375,7 @@ CHECK_RETURN astCompoundStatement *parser::parseCompoundStatement() {
     while (!isType(kType_scope_end)) {
         astStatement *nextStatement = parseStatement();
         if (!nextStatement) return 0;
-        statement->statements.push_back(nextStatement);
+        statement->statements.push_back(&m_memory, nextStatement);
         if (!next()) // skip ';'
             return 0;
     }
@@ -1256,7 +1396,8 @@ CHECK_RETURN astIfStatement *parser::parseIfStatement() {
         return 0;
     if (!next()) // skip ')'
         return 0;
-    statement->thenStatement = parseStatement();
+    if (!(statement->thenStatement = parseStatement()))
+        return 0;
     token peek = m_lexer.peek();
     if (IS_KEYWORD(peek, kKeyword_else)) {
         if (!next()) // skip ';' or '}'
@@ -1290,8 +1431,8 @@ CHECK_RETURN astSwitchStatement *parser::parseSwitchStatement() {
     if (!next()) // skip '{'
         return 0;
 
-    vector<int> seenInts;
-    vector<unsigned int> seenUInts;
+    vector<int> seenInts(m_allocator);
+    vector<unsigned int> seenUInts(m_allocator);
     bool hadDefault = false;
     while (!isType(kType_scope_end)) {
         astStatement *nextStatement = parseStatement();
@@ -1304,6 +1445,8 @@ CHECK_RETURN astSwitchStatement *parser::parseSwitchStatement() {
                     return 0;
                 }
                 astConstantExpression *value = evaluate(caseLabel->condition);
+                if (!value)
+                    return 0;
                 // "It is a compile-time error to have two case label constant-expression of equal value"
                 if (value->type == astExpression::kIntConstant) {
                     const int val = IVAL(value);
@@ -1332,7 +1475,7 @@ CHECK_RETURN astSwitchStatement *parser::parseSwitchStatement() {
                 hadDefault = true;
             }
         }
-        statement->statements.push_back(nextStatement);
+        statement->statements.push_back(&m_memory, nextStatement);
         if (!next())
             return 0;
     }
@@ -1354,7 +1497,8 @@ CHECK_RETURN astCaseLabelStatement *parser::parseCaseLabelStatement() {
     } else {
         if (!next()) // skip 'case'
             return 0;
-        statement->condition = parseExpression(kEndConditionColon);
+        if (!(statement->condition = parseExpression(kEndConditionColon)))
+            return 0;
     }
     return statement;
 }
@@ -1385,7 +1529,8 @@ CHECK_RETURN astForStatement *parser::parseForStatement() {
     }
     if (!next()) // skip ')'
         return 0;
-    statement->body = parseStatement();
+    if (!(statement->body = parseStatement()))
+        return 0;
     return statement;
 }
 
@@ -1480,7 +1625,7 @@ CHECK_RETURN astWhileStatement *parser::parseWhileStatement() {
 }
 
 CHECK_RETURN astDeclarationStatement *parser::parseDeclarationStatement(endCondition condition) {
-    m_lexer.backup();
+    backup();
 
     bool isConst = false;
     if (isKeyword(kKeyword_const)) {
@@ -1497,7 +1642,7 @@ CHECK_RETURN astDeclarationStatement *parser::parseDeclarationStatement(endCondi
     }
 
     if (!type) {
-        m_lexer.restore();
+        restore();
         return 0;
     }
 
@@ -1513,17 +1658,17 @@ CHECK_RETURN astDeclarationStatement *parser::parseDeclarationStatement(endCondi
                 return 0;
         }
         if (!isType(kType_identifier)) {
-            m_lexer.restore();
+            restore();
             return 0;
         }
 
-        const char *name = strnew(m_token.asIdentifier);
+        const span name = m_token.asIdentifier;
         if (!next()) // skip identifier
             return 0;
 
         for (size_t i = 0; i < paranthesisCount; i++) {
             if (!isOperator(kOperator_paranthesis_end)) {
-                m_lexer.restore();
+                restore();
                 return 0;
             }
             if (!next())
@@ -1533,7 +1678,7 @@ CHECK_RETURN astDeclarationStatement *parser::parseDeclarationStatement(endCondi
         if (statement->variables.empty() && !isOperator(kOperator_assign)
             && !isOperator(kOperator_comma) && !isEndCondition(condition))
         {
-            m_lexer.restore();
+            restore();
             return 0;
         }
 
@@ -1548,10 +1693,10 @@ CHECK_RETURN astDeclarationStatement *parser::parseDeclarationStatement(endCondi
         astFunctionVariable *variable = GC_NEW(astVariable) astFunctionVariable();
         variable->isConst = isConst;
         variable->baseType = type;
-        variable->name = strnew(name);
+        variable->name = intern(name);
         variable->initialValue = initialValue;
-        statement->variables.push_back(variable);
-        m_scopes.back().push_back(variable);
+        statement->variables.push_back(&m_memory, variable);
+        declare(variable);
 
         if (isEndCondition(condition)) {
             break;
@@ -1564,7 +1709,7 @@ CHECK_RETURN astDeclarationStatement *parser::parseDeclarationStatement(endCondi
                 astConstantExpression *arraySize = parseArraySize();
                 if (!arraySize)
                     return 0;
-                variable->arraySizes.push_back(arraySize);
+                variable->arraySizes.push_back(&m_memory, arraySize);
                 if (!next()) // skip ']'
                     return 0;
             }
@@ -1578,6 +1723,9 @@ CHECK_RETURN astDeclarationStatement *parser::parseDeclarationStatement(endCondi
 }
 
 CHECK_RETURN astSimpleStatement *parser::parseDeclarationOrExpressionStatement(endCondition condition) {
+    // An identifier which is not a type can only begin an expression
+    if (isType(kType_identifier) && !findType(m_token.asIdentifier))
+        return parseExpressionStatement(condition);
     astSimpleStatement *declaration = parseDeclarationStatement(condition);
     if (declaration) {
         return declaration;
@@ -1619,7 +1767,7 @@ CHECK_RETURN astStatement *parser::parseStatement() {
 CHECK_RETURN astFunction *parser::parseFunction(const topLevel &parse) {
     astFunction *function = GC_NEW(astFunction) astFunction();
     function->returnType = parse.type;
-    function->name = strnew(parse.name);
+    function->name = parse.name;
 
     if (!next()) // skip '('
         return 0;
@@ -1650,18 +1798,18 @@ CHECK_RETURN astFunction *parser::parseFunction(const topLevel &parse) {
                 parameter->memory = kWriteOnly;
             } else if (isType(kType_identifier)) {
                 // TODO: user defined types
-                parameter->name = strnew(m_token.asIdentifier);
+                parameter->name = intern(m_token.asIdentifier);
             } else if (isOperator(kOperator_bracket_begin)) {
                 while (isOperator(kOperator_bracket_begin)) {
                     parameter->isArray = true;
                     astConstantExpression *arraySize = parseArraySize();
                     if (!arraySize)
                         return 0;
-                    parameter->arraySizes.push_back(arraySize);
+                    parameter->arraySizes.push_back(&m_memory, arraySize);
                 }
             } else {
                 parameter->baseType = parseBuiltin();
-                if (parameter->baseType && parameter->baseType->builtin) {
+                if (parameter->baseType && parameter->baseType->kind == astType::kBuiltin) {
                     astBuiltin *builtin = (astBuiltin*)parameter->baseType;
                     if (builtin->type == kKeyword_void && !strnil(parameter->name)) {
                         fatal("`void' parameter cannot be named");
@@ -1677,7 +1825,7 @@ CHECK_RETURN astFunction *parser::parseFunction(const topLevel &parse) {
             fatal("expected type");
             return 0;
         }
-        function->parameters.push_back(parameter);
+        function->parameters.push_back(&m_memory, parameter);
         if (isOperator(kOperator_comma)) {
             if (!next())// skip ','
                 return 0;
@@ -1688,7 +1836,7 @@ CHECK_RETURN astFunction *parser::parseFunction(const topLevel &parse) {
 
     // If there is just one 'void' than silently drop it
     if (function->parameters.size() == 1) {
-        if (function->parameters[0]->baseType->builtin) {
+        if (function->parameters[0]->baseType->kind == astType::kBuiltin) {
             astBuiltin *builtin = (astBuiltin*)function->parameters[0]->baseType;
             if (builtin->type == kKeyword_void)
                 function->parameters.pop_back();
@@ -1697,12 +1845,12 @@ CHECK_RETURN astFunction *parser::parseFunction(const topLevel &parse) {
 
     // "It is a compile-time or link-time error to declare or define a function main with any other parameters or
     //  return type."
-    if (!strcmp(function->name, "main")) {
+    if (function->name == m_main) {
         if (!function->parameters.empty()) {
             fatal("`main' cannot have parameters");
             return 0;
         }
-        if (!function->returnType->builtin || ((astBuiltin*)function->returnType)->type != kKeyword_void) {
+        if (function->returnType->kind != astType::kBuiltin || ((astBuiltin*)function->returnType)->type != kKeyword_void) {
             fatal("`main' must be declared to return void");
             return 0;
         }
@@ -1710,24 +1858,26 @@ CHECK_RETURN astFunction *parser::parseFunction(const topLevel &parse) {
 
     if (isType(kType_scope_begin)) {
         function->isPrototype = false;
+        defineFunction(function); // Before the body so calls in it see it
         if (!next()) // skip '{'
             return 0;
 
-        m_scopes.push_back(scope());
+        pushScope();
         for (size_t i = 0; i < function->parameters.size(); i++)
-            m_scopes.back().push_back(function->parameters[i]);
+            declare(function->parameters[i]);
         while (!isType(kType_scope_end)) {
             astStatement *statement = parseStatement();
             if (!statement)
                 return 0;
-            function->statements.push_back(statement);
+            function->statements.push_back(&m_memory, statement);
             if (!next())// skip ';'
                 return 0;
         }
 
-        m_scopes.pop_back();
+        popScope();
     } else if (isType(kType_semicolon)) {
         function->isPrototype = true;
+        defineFunction(function);
     } else {
         fatal("expected `{' or `;'");
         return 0;
@@ -1746,14 +1896,7 @@ astBuiltin *parser::parseBuiltin() {
 
     switch (m_token.asKeyword) {
     #include "glsl-parser/lexemes.h"
-        for (size_t i = 0; i < m_builtins.size(); i++) {
-            if (m_builtins[i]->type == m_token.asKeyword) {
-                return m_builtins[i];
-            }
-        }
-        m_builtins.push_back(GC_NEW(astType) astBuiltin(m_token.asKeyword));
-        return m_builtins.back();
-        break;
+        return builtinType(m_token.asKeyword);
     default:
         break;
     }
@@ -1763,8 +1906,8 @@ astBuiltin *parser::parseBuiltin() {
 #undef TYPENAME
 
 CHECK_RETURN astConstructorCall *parser::parseConstructorCall() {
-    astConstructorCall *expression = GC_NEW(astExpression) astConstructorCall();
-    if (!(expression->type = parseBuiltin()))
+    astType *type = parseBuiltin();
+    if (!type)
         return 0;
     if (!next())
         return 0;
@@ -1774,22 +1917,18 @@ CHECK_RETURN astConstructorCall *parser::parseConstructorCall() {
     }
     if (!next()) // skip '('
         return 0;
-    while (!isOperator(kOperator_paranthesis_end)) {
-        astExpression *parameter = parseExpression(kEndConditionComma | kEndConditionParanthesis);
-        if (!parameter)
-            return 0;
-        expression->parameters.push_back(parameter);
-        if (isOperator(kOperator_comma)) {
-            if (!next()) // skip ','
-                return 0;
-        }
-    }
-    return expression;
+    const size_t base = m_operands.size();
+    if (!parseCallParameters())
+        return 0;
+    astConstructorCall *expression = GC_NEW(astExpression) astConstructorCall();
+    expression->type = type;
+    expression->parameters.assign(&m_memory, m_operands.begin() + base, m_operands.end());
+    m_operands.resize(base);
+    return (astConstructorCall*)share(expression);
 }
 
 CHECK_RETURN astFunctionCall *parser::parseFunctionCall() {
-    astFunctionCall *expression = GC_NEW(astExpression) astFunctionCall();
-    expression->name = strnew(m_token.asIdentifier);
+    const char *name = intern(m_token.asIdentifier);
     if (!next()) // skip identifier
         return 0;
     if (!isOperator(kOperator_paranthesis_begin)) {
@@ -1797,17 +1936,30 @@ CHECK_RETURN astFunctionCall *parser::parseFunctionCall() {
         return 0;
     }
     if (!next()) return 0; // skip '('
+    const size_t base = m_operands.size();
+    if (!parseCallParameters())
+        return 0;
+    astFunctionCall *expression = GC_NEW(astExpression) astFunctionCall();
+    expression->name = name;
+    expression->parameters.assign(&m_memory, m_operands.begin() + base, m_operands.end());
+    expression->function = findFunction(name, m_operands.begin() + base, m_operands.size() - base);
+    m_operands.resize(base);
+    return (astFunctionCall*)share(expression);
+}
+
+// The call is placed after its parameters so it can be shared
+CHECK_RETURN bool parser::parseCallParameters() {
     while (!isOperator(kOperator_paranthesis_end)) {
         astExpression *parameter = parseExpression(kEndConditionComma | kEndConditionParanthesis);
         if (!parameter)
-            return 0;
-        expression->parameters.push_back(parameter);
+            return false;
+        m_operands.push_back(parameter);
         if (isOperator(kOperator_comma)) {
             if (!next()) // skip ','
-                return 0;
+                return false;
         }
     }
-    return expression;
+    return true;
 }
 
 CHECK_RETURN bool parser::next() {
@@ -1823,13 +1975,13 @@ CHECK_RETURN bool parser::next() {
     return true;
 }
 
-astBinaryExpression *parser::createExpression() {
-    if (!isType(kType_operator)) {
+astBinaryExpression *parser::createExpression(const token &operation) {
+    if (!IS_TYPE(operation, kType_operator)) {
         fatal("internal compiler error: attempted to create binary expression in wrong context");
         return 0;
     }
 
-    switch (m_token.asOperator) {
+    switch (operation.asOperator) {
     case kOperator_multiply:
     case kOperator_divide:
     case kOperator_modulus:
@@ -1848,7 +2000,7 @@ astBinaryExpression *parser::createExpression() {
     case kOperator_logical_and:
     case kOperator_logical_xor:
     case kOperator_logical_or:
-        return GC_NEW(astExpression) astOperationExpression(m_token.asOperator);
+        return GC_NEW(astExpression) astOperationExpression(operation.asOperator);
     case kOperator_assign:
     case kOperator_add_assign:
     case kOperator_sub_assign:
@@ -1860,7 +2012,7 @@ astBinaryExpression *parser::createExpression() {
     case kOperator_bit_and_assign:
     case kOperator_bit_xor_assign:
     case kOperator_bit_or_assign:
-        return GC_NEW(astExpression) astAssignmentExpression(m_token.asOperator);
+        return GC_NEW(astExpression) astAssignmentExpression(operation.asOperator);
     case kOperator_comma:
         return GC_NEW(astExpression) astSequenceExpression();
     default:
@@ -1868,28 +2020,821 @@ astBinaryExpression *parser::createExpression() {
     }
 }
 
-astType *parser::findType(const char *name) {
-    for (size_t i = 0; i < m_ast->structures.size(); i++) {
-        if (strcmp(m_ast->structures[i]->name, name))
+// Children are shared before their parent so a node is the same as another
+// when what it holds is and its children are the same pointers
+static size_t hashMix(size_t hash, size_t value) {
+    return (hash ^ value) * size_t(0x100000001B3ull);
+}
+
+static size_t hashPointer(size_t hash, const void *pointer) {
+    return hashMix(hash, size_t(pointer) >> 3);
+}
+
+static size_t hashExpression(const astExpression *expression) {
+    size_t hash = hashMix(size_t(0xCBF29CE484222325ull), size_t(expression->type));
+    switch (expression->type) {
+    case astExpression::kIntConstant:
+        return hashMix(hash, size_t(((const astIntConstant*)expression)->value));
+    case astExpression::kUIntConstant:
+        return hashMix(hash, size_t(((const astUIntConstant*)expression)->value));
+    case astExpression::kFloatConstant: {
+        unsigned bits;
+        memcpy(&bits, &((const astFloatConstant*)expression)->value, sizeof bits);
+        return hashMix(hash, size_t(bits));
+    }
+    case astExpression::kDoubleConstant: {
+        unsigned bits[2];
+        memcpy(bits, &((const astDoubleConstant*)expression)->value, sizeof bits);
+        return hashMix(hashMix(hash, size_t(bits[0])), size_t(bits[1]));
+    }
+    case astExpression::kBoolConstant:
+        return hashMix(hash, size_t(((const astBoolConstant*)expression)->value));
+    case astExpression::kVariableIdentifier:
+        return hashPointer(hash, ((const astVariableIdentifier*)expression)->variable);
+    case astExpression::kFieldOrSwizzle:
+        hash = hashPointer(hash, ((const astFieldOrSwizzle*)expression)->operand);
+        return hashPointer(hash, ((const astFieldOrSwizzle*)expression)->name);
+    case astExpression::kArraySubscript:
+        hash = hashPointer(hash, ((const astArraySubscript*)expression)->operand);
+        return hashPointer(hash, ((const astArraySubscript*)expression)->index);
+    case astExpression::kFunctionCall: {
+        const astFunctionCall *call = (const astFunctionCall*)expression;
+        hash = hashPointer(hash, call->name);
+        hash = hashPointer(hash, call->function);
+        for (size_t i = 0; i < call->parameters.size(); i++)
+            hash = hashPointer(hash, call->parameters[i]);
+        return hash;
+    }
+    case astExpression::kConstructorCall: {
+        const astConstructorCall *call = (const astConstructorCall*)expression;
+        hash = hashPointer(hash, call->type);
+        for (size_t i = 0; i < call->parameters.size(); i++)
+            hash = hashPointer(hash, call->parameters[i]);
+        return hash;
+    }
+    case astExpression::kPostIncrement:
+    case astExpression::kPostDecrement:
+    case astExpression::kUnaryMinus:
+    case astExpression::kUnaryPlus:
+    case astExpression::kBitNot:
+    case astExpression::kLogicalNot:
+    case astExpression::kPrefixIncrement:
+    case astExpression::kPrefixDecrement:
+        return hashPointer(hash, ((const astUnaryExpression*)expression)->operand);
+    case astExpression::kAssign:
+        hash = hashMix(hash, size_t(((const astAssignmentExpression*)expression)->assignment));
+        break;
+    case astExpression::kOperation:
+        hash = hashMix(hash, size_t(((const astOperationExpression*)expression)->operation));
+        break;
+    case astExpression::kSequence:
+        break;
+    case astExpression::kTernary:
+        hash = hashPointer(hash, ((const astTernaryExpression*)expression)->condition);
+        hash = hashPointer(hash, ((const astTernaryExpression*)expression)->onTrue);
+        return hashPointer(hash, ((const astTernaryExpression*)expression)->onFalse);
+    }
+    hash = hashPointer(hash, ((const astBinaryExpression*)expression)->operand1);
+    return hashPointer(hash, ((const astBinaryExpression*)expression)->operand2);
+}
+
+// The low bits of the hash only depend on the low bits of what went in
+static size_t hashSlot(const astExpression *expression, size_t mask) {
+    const size_t hash = hashExpression(expression);
+    return (hash ^ (hash >> 29)) & mask;
+}
+
+template <typename T>
+static bool sameParameters(const T *a, const T *b) {
+    if (a->parameters.size() != b->parameters.size())
+        return false;
+    for (size_t i = 0; i < a->parameters.size(); i++)
+        if (a->parameters[i] != b->parameters[i])
+            return false;
+    return true;
+}
+
+static bool sameExpression(const astExpression *a, const astExpression *b) {
+    if (a->type != b->type)
+        return false;
+    switch (a->type) {
+    case astExpression::kIntConstant:
+        return ((const astIntConstant*)a)->value == ((const astIntConstant*)b)->value;
+    case astExpression::kUIntConstant:
+        return ((const astUIntConstant*)a)->value == ((const astUIntConstant*)b)->value;
+    case astExpression::kFloatConstant: // By bits, -0.0 is not 0.0
+        return !memcmp(&((const astFloatConstant*)a)->value, &((const astFloatConstant*)b)->value, sizeof(float));
+    case astExpression::kDoubleConstant:
+        return !memcmp(&((const astDoubleConstant*)a)->value, &((const astDoubleConstant*)b)->value, sizeof(double));
+    case astExpression::kBoolConstant:
+        return ((const astBoolConstant*)a)->value == ((const astBoolConstant*)b)->value;
+    case astExpression::kVariableIdentifier:
+        return ((const astVariableIdentifier*)a)->variable == ((const astVariableIdentifier*)b)->variable;
+    case astExpression::kFieldOrSwizzle:
+        return ((const astFieldOrSwizzle*)a)->operand == ((const astFieldOrSwizzle*)b)->operand
+            && ((const astFieldOrSwizzle*)a)->name == ((const astFieldOrSwizzle*)b)->name;
+    case astExpression::kArraySubscript:
+        return ((const astArraySubscript*)a)->operand == ((const astArraySubscript*)b)->operand
+            && ((const astArraySubscript*)a)->index == ((const astArraySubscript*)b)->index;
+    case astExpression::kFunctionCall:
+        return ((const astFunctionCall*)a)->name == ((const astFunctionCall*)b)->name
+            && ((const astFunctionCall*)a)->function == ((const astFunctionCall*)b)->function
+            && sameParameters((const astFunctionCall*)a, (const astFunctionCall*)b);
+    case astExpression::kConstructorCall:
+        return ((const astConstructorCall*)a)->type == ((const astConstructorCall*)b)->type
+            && sameParameters((const astConstructorCall*)a, (const astConstructorCall*)b);
+    case astExpression::kPostIncrement:
+    case astExpression::kPostDecrement:
+    case astExpression::kUnaryMinus:
+    case astExpression::kUnaryPlus:
+    case astExpression::kBitNot:
+    case astExpression::kLogicalNot:
+    case astExpression::kPrefixIncrement:
+    case astExpression::kPrefixDecrement:
+        return ((const astUnaryExpression*)a)->operand == ((const astUnaryExpression*)b)->operand;
+    case astExpression::kAssign:
+        if (((const astAssignmentExpression*)a)->assignment != ((const astAssignmentExpression*)b)->assignment)
+            return false;
+        break;
+    case astExpression::kOperation:
+        if (((const astOperationExpression*)a)->operation != ((const astOperationExpression*)b)->operation)
+            return false;
+        break;
+    case astExpression::kSequence:
+        break;
+    case astExpression::kTernary:
+        return ((const astTernaryExpression*)a)->condition == ((const astTernaryExpression*)b)->condition
+            && ((const astTernaryExpression*)a)->onTrue == ((const astTernaryExpression*)b)->onTrue
+            && ((const astTernaryExpression*)a)->onFalse == ((const astTernaryExpression*)b)->onFalse;
+    }
+    return ((const astBinaryExpression*)a)->operand1 == ((const astBinaryExpression*)b)->operand1
+        && ((const astBinaryExpression*)a)->operand2 == ((const astBinaryExpression*)b)->operand2;
+}
+
+// Those are made anew each time they appear, so each happens where it is
+static bool hasSideEffects(const astExpression *expression) {
+    switch (expression->type) {
+    case astExpression::kAssign:
+    case astExpression::kPostIncrement:
+    case astExpression::kPostDecrement:
+    case astExpression::kPrefixIncrement:
+    case astExpression::kPrefixDecrement:
+        return true;
+    case astExpression::kFunctionCall: {
+        const astFunction *function = ((const astFunctionCall*)expression)->function;
+        return !function || !function->isPure;
+    }
+    }
+    return false;
+}
+
+// Returns the node already made which is the same as expression, giving the
+// memory of expression back when it was the last thing placed. Every
+// expression made comes through here, and is typed when it is kept.
+astExpression *parser::share(astExpression *expression) {
+    if (!expression)
+        return 0;
+    if (!m_share || hasSideEffects(expression)) {
+        expression->valueType = resolveValueType(expression);
+        return expression;
+    }
+
+    if (2 * (m_sharedCount + 1) > m_shared.size()) {
+        vector<astExpression*> grown(m_allocator);
+        grown.resize(m_shared.size() ? 2 * m_shared.size() : 1024);
+        const size_t mask = grown.size() - 1;
+        for (size_t i = 0; i < m_shared.size(); i++) {
+            if (!m_shared[i])
+                continue;
+            size_t slot = hashSlot(m_shared[i], mask);
+            while (grown[slot])
+                slot = (slot + 1) & mask;
+            grown[slot] = m_shared[i];
+        }
+        m_shared.swap(grown);
+    }
+
+    const size_t mask = m_shared.size() - 1;
+    size_t slot = hashSlot(expression, mask);
+    for (; m_shared[slot]; slot = (slot + 1) & mask) {
+        astExpression *found = m_shared[slot];
+        if (!sameExpression(found, expression))
             continue;
-        return (astType*)m_ast->structures[i];
+        // The parameters of a call are placed after it
+        if (expression->type == astExpression::kFunctionCall)
+            ((astFunctionCall*)expression)->parameters.release(&m_memory);
+        else if (expression->type == astExpression::kConstructorCall)
+            ((astConstructorCall*)expression)->parameters.release(&m_memory);
+        m_memory.release(expression, expression->nodeSize());
+        return found;
+    }
+    expression->valueType = resolveValueType(expression);
+    m_shared[slot] = expression;
+    m_sharedCount++;
+    return expression;
+}
+
+// The builtin types of numbers by their scalar and shape. Scalars are in the
+// order of astValueType::kInt and on, which is also that of promotion.
+static const int kScalars[] = {
+    kKeyword_int, kKeyword_uint, kKeyword_float, kKeyword_double, kKeyword_bool
+};
+
+static const int kVectors[][4] = {
+    { kKeyword_int, kKeyword_ivec2, kKeyword_ivec3, kKeyword_ivec4 },
+    { kKeyword_uint, kKeyword_uvec2, kKeyword_uvec3, kKeyword_uvec4 },
+    { kKeyword_float, kKeyword_vec2, kKeyword_vec3, kKeyword_vec4 },
+    { kKeyword_double, kKeyword_dvec2, kKeyword_dvec3, kKeyword_dvec4 },
+    { kKeyword_bool, kKeyword_bvec2, kKeyword_bvec3, kKeyword_bvec4 }
+};
+
+// By columns then rows, from 2
+static const int kMatrices[][3][3] = {
+    { { kKeyword_mat2x2, kKeyword_mat2x3, kKeyword_mat2x4 },
+      { kKeyword_mat3x2, kKeyword_mat3x3, kKeyword_mat3x4 },
+      { kKeyword_mat4x2, kKeyword_mat4x3, kKeyword_mat4x4 } },
+    { { kKeyword_dmat2x2, kKeyword_dmat2x3, kKeyword_dmat2x4 },
+      { kKeyword_dmat3x2, kKeyword_dmat3x3, kKeyword_dmat3x4 },
+      { kKeyword_dmat4x2, kKeyword_dmat4x3, kKeyword_dmat4x4 } }
+};
+
+static int scalarIndex(int scalar) {
+    for (size_t i = 0; i < sizeof kScalars / sizeof *kScalars; i++) {
+        if (kScalars[i] == scalar)
+            return int(i);
+    }
+    return -1;
+}
+
+// Square matrices have two names, value types are made with the short one
+static int shortName(int keyword) {
+    switch (keyword) {
+    case kKeyword_mat2x2: return kKeyword_mat2;
+    case kKeyword_mat3x3: return kKeyword_mat3;
+    case kKeyword_mat4x4: return kKeyword_mat4;
+    case kKeyword_dmat2x2: return kKeyword_dmat2;
+    case kKeyword_dmat3x3: return kKeyword_dmat3;
+    case kKeyword_dmat4x4: return kKeyword_dmat4;
+    }
+    return keyword;
+}
+
+// Only done when a value type is first made, they are looked up after that
+static void shapeOf(astValueType &value, int keyword) {
+    value.scalar = -1;
+    value.columns = 0;
+    value.rows = 0;
+    switch (keyword) {
+    case kKeyword_mat2: keyword = kKeyword_mat2x2; break;
+    case kKeyword_mat3: keyword = kKeyword_mat3x3; break;
+    case kKeyword_mat4: keyword = kKeyword_mat4x4; break;
+    case kKeyword_dmat2: keyword = kKeyword_dmat2x2; break;
+    case kKeyword_dmat3: keyword = kKeyword_dmat3x3; break;
+    case kKeyword_dmat4: keyword = kKeyword_dmat4x4; break;
+    }
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 4; j++) {
+            if (kVectors[i][j] != keyword)
+                continue;
+            value.scalar = kScalars[i];
+            value.columns = 1;
+            value.rows = (unsigned char)(j + 1);
+            return;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 3; j++) {
+            for (int k = 0; k < 3; k++) {
+                if (kMatrices[i][j][k] != keyword)
+                    continue;
+                value.scalar = kScalars[astValueType::kFloat - 1 + i];
+                value.columns = (unsigned char)(j + 2);
+                value.rows = (unsigned char)(k + 2);
+                return;
+            }
+        }
+    }
+}
+
+static size_t hashValueType(const astType *type, astConstantExpression *const *arraySizes, size_t dimensions) {
+    return hashMix(hashPointer(hashPointer(0, type), arraySizes), dimensions);
+}
+
+// Every translation unit starts with the value types of the constants, so
+// constants shared with the builtins, or left by evaluate(), have the same
+// in any of them
+void parser::prepareValueTypes() {
+    for (size_t i = 0; i < m_valueTypes.size(); i++)
+        m_valueTypes[i] = 0;
+    astValueType unknown = { 0, 0, 0, -1, 0, 0 };
+    m_ast->valueTypes.push_back(unknown);
+    for (size_t i = 0; i < sizeof kScalars / sizeof *kScalars; i++)
+        numericValueType(kScalars[i], 1, 1);
+}
+
+// The one index of each type, array sizes being told apart by the
+// declaration they are of
+unsigned parser::findValueType(astType *type, astConstantExpression *const *arraySizes, size_t dimensions) {
+    if (!type)
+        return astValueType::kUnknown;
+    if (!dimensions)
+        arraySizes = 0;
+    if (type->kind == astType::kBuiltin && shortName(((astBuiltin*)type)->type) != ((astBuiltin*)type)->type)
+        type = builtinType(shortName(((astBuiltin*)type)->type));
+
+    vector<astValueType> &types = m_ast->valueTypes;
+    if (2 * (types.size() + 1) > m_valueTypes.size()) {
+        vector<unsigned> grown(m_allocator);
+        grown.resize(m_valueTypes.size() ? 2 * m_valueTypes.size() : 64);
+        const size_t mask = grown.size() - 1;
+        for (size_t i = 1; i < types.size(); i++) {
+            size_t slot = hashValueType(types[i].type, types[i].arraySizes, types[i].arrayDimensions) & mask;
+            while (grown[slot])
+                slot = (slot + 1) & mask;
+            grown[slot] = unsigned(i);
+        }
+        m_valueTypes.swap(grown);
+    }
+
+    const size_t mask = m_valueTypes.size() - 1;
+    size_t slot = hashValueType(type, arraySizes, dimensions) & mask;
+    for (; m_valueTypes[slot]; slot = (slot + 1) & mask) {
+        const astValueType &found = types[m_valueTypes[slot]];
+        if (found.type == type && found.arraySizes == arraySizes && found.arrayDimensions == dimensions)
+            return m_valueTypes[slot];
+    }
+
+    astValueType value = { type, arraySizes, unsigned(dimensions), -1, 0, 0 };
+    if (type->kind == astType::kBuiltin)
+        shapeOf(value, ((astBuiltin*)type)->type);
+    types.push_back(value);
+    m_valueTypes[slot] = unsigned(types.size() - 1);
+    return m_valueTypes[slot];
+}
+
+// Columns of 1 for a vector, and rows of 1 too for a scalar
+unsigned parser::numericValueType(int scalar, int columns, int rows) {
+    const int index = scalarIndex(scalar);
+    int keyword = -1;
+    if (index < 0 || rows < 1 || rows > 4 || columns < 1 || columns > 4)
+        return astValueType::kUnknown;
+    if (columns == 1)
+        keyword = kVectors[index][rows - 1];
+    else if (rows > 1 && (scalar == kKeyword_float || scalar == kKeyword_double))
+        keyword = kMatrices[scalar == kKeyword_double][columns - 2][rows - 2];
+    else
+        return astValueType::kUnknown;
+    return findValueType(builtinType(keyword), 0, 0);
+}
+
+// What the operands are promoted to, the one which is not a scalar giving
+// the shape, except where a matrix is multiplied. The operands are copies as
+// the value types may grow.
+unsigned parser::operationValueType(int operation, astValueType lhs, astValueType rhs) {
+    switch (operation) {
+    case kOperator_less:
+    case kOperator_greater:
+    case kOperator_less_equal:
+    case kOperator_greater_equal:
+    case kOperator_equal:
+    case kOperator_not_equal:
+    case kOperator_logical_and:
+    case kOperator_logical_xor:
+    case kOperator_logical_or:
+        return astValueType::kBool;
+    case kOperator_shift_left:
+    case kOperator_shift_right:
+        return findValueType(lhs.type, lhs.arraySizes, lhs.arrayDimensions);
+    }
+    if (lhs.arrayDimensions || rhs.arrayDimensions || lhs.scalar < 0 || rhs.scalar < 0)
+        return astValueType::kUnknown;
+
+    const int lhsIndex = scalarIndex(lhs.scalar);
+    const int rhsIndex = scalarIndex(rhs.scalar);
+    const int scalar = kScalars[lhsIndex > rhsIndex ? lhsIndex : rhsIndex];
+    const bool lhsScalar = lhs.columns == 1 && lhs.rows == 1;
+    const bool rhsScalar = rhs.columns == 1 && rhs.rows == 1;
+    if (operation == kOperator_multiply && !lhsScalar && !rhsScalar) {
+        if (lhs.columns > 1 && rhs.columns > 1)
+            return numericValueType(scalar, rhs.columns, lhs.rows);
+        if (lhs.columns > 1)
+            return numericValueType(scalar, 1, lhs.rows);
+        if (rhs.columns > 1)
+            return numericValueType(scalar, 1, rhs.columns);
+    }
+    const astValueType &shape = lhsScalar ? rhs : lhs;
+    return numericValueType(scalar, shape.columns, shape.rows);
+}
+
+// Of the value types of the operands, which are resolved when they are made
+unsigned parser::resolveValueType(astExpression *expression) {
+    const vector<astValueType> &types = m_ast->valueTypes;
+    switch (expression->type) {
+    case astExpression::kIntConstant:
+    case astExpression::kUIntConstant:
+    case astExpression::kFloatConstant:
+    case astExpression::kDoubleConstant:
+    case astExpression::kBoolConstant:
+        return unsigned(expression->type - astExpression::kIntConstant + astValueType::kInt);
+    case astExpression::kVariableIdentifier: {
+        astVariable *variable = ((astVariableIdentifier*)expression)->variable;
+        return findValueType(variable->baseType, variable->arraySizes.begin(),
+            variable->isArray ? variable->arraySizes.size() : 0);
+    }
+    case astExpression::kFieldOrSwizzle: {
+        astFieldOrSwizzle *field = (astFieldOrSwizzle*)expression;
+        const astValueType &of = types[field->operand->valueType];
+        if (!of.type || of.arrayDimensions)
+            return astValueType::kUnknown;
+        if (of.type->kind != astType::kBuiltin) {
+            astVariable *variable = findField(of.type, field->name);
+            if (!variable)
+                return astValueType::kUnknown;
+            return findValueType(variable->baseType, variable->arraySizes.begin(),
+                variable->isArray ? variable->arraySizes.size() : 0);
+        }
+        if (of.columns != 1)
+            return astValueType::kUnknown;
+        return numericValueType(of.scalar, 1, int(interner::length(field->name)));
+    }
+    case astExpression::kArraySubscript: {
+        const astValueType &of = types[((astArraySubscript*)expression)->operand->valueType];
+        if (of.arrayDimensions)
+            return findValueType(of.type, of.arraySizes + 1, of.arrayDimensions - 1);
+        if (of.columns > 1)
+            return numericValueType(of.scalar, 1, of.rows);
+        if (of.rows > 1)
+            return numericValueType(of.scalar, 1, 1);
+        return astValueType::kUnknown;
+    }
+    case astExpression::kFunctionCall: {
+        astFunction *function = ((astFunctionCall*)expression)->function;
+        return function ? findValueType(function->returnType, 0, 0) : unsigned(astValueType::kUnknown);
+    }
+    case astExpression::kConstructorCall:
+        return findValueType(((astConstructorCall*)expression)->type, 0, 0);
+    case astExpression::kLogicalNot:
+        return astValueType::kBool;
+    case astExpression::kPostIncrement:
+    case astExpression::kPostDecrement:
+    case astExpression::kUnaryMinus:
+    case astExpression::kUnaryPlus:
+    case astExpression::kBitNot:
+    case astExpression::kPrefixIncrement:
+    case astExpression::kPrefixDecrement:
+        return ((astUnaryExpression*)expression)->operand->valueType;
+    case astExpression::kSequence:
+        return ((astBinaryExpression*)expression)->operand2->valueType;
+    case astExpression::kAssign:
+        return ((astBinaryExpression*)expression)->operand1->valueType;
+    case astExpression::kOperation: {
+        astOperationExpression *operation = (astOperationExpression*)expression;
+        return operationValueType(operation->operation,
+            types[operation->operand1->valueType], types[operation->operand2->valueType]);
+    }
+    case astExpression::kTernary: {
+        astTernaryExpression *ternary = (astTernaryExpression*)expression;
+        if (ternary->onTrue && ternary->onTrue->valueType)
+            return ternary->onTrue->valueType;
+        return ternary->onFalse->valueType;
+    }
+    }
+    return astValueType::kUnknown;
+}
+
+// Speculative parsing, restore() returns to the token current at backup()
+void parser::backup() {
+    m_backup = m_token;
+    m_lexer.backup();
+}
+
+void parser::restore() {
+    m_token = m_backup;
+    m_lexer.restore();
+}
+
+// Type names are bound by the id of the atom as variables are. The first
+// structure of a name is the one found.
+parser::typeName &parser::typeNameOf(const char *name) {
+    const unsigned id = interner::id(name);
+    if (id >= m_typeNames.size())
+        m_typeNames.resize(id + 1);
+    return m_typeNames[id];
+}
+
+CHECK_RETURN bool parser::defineStructure(astStruct *structure) {
+    m_ast->structures.push_back(structure);
+    if (!structure->name)
+        return true;
+    if (m_builtinTable && m_builtinTable->namedType(interner::id(structure->name))) {
+        fatal("`%s' is already the name of a builtin type", structure->name);
+        return false;
+    }
+    typeName &entry = typeNameOf(structure->name);
+    // "It is a compile-time error to use a block name at global scope for
+    //  anything other than as a block name."
+    if (entry.interfaceBlock) {
+        fatal("`%s' is already the name of an interface block", structure->name);
+        return false;
+    }
+    if (!entry.structure)
+        entry.structure = structure;
+    return true;
+}
+
+CHECK_RETURN bool parser::defineInterfaceBlock(astInterfaceBlock *block) {
+    m_ast->interfaceBlocks.push_back(block);
+    if (!block->name)
+        return true;
+    if (m_builtinTable && m_builtinTable->namedType(interner::id(block->name))) {
+        fatal("`%s' is already the name of a builtin type", block->name);
+        return false;
+    }
+    typeName &entry = typeNameOf(block->name);
+    if (entry.structure) {
+        fatal("`%s' is already the name of a structure", block->name);
+        return false;
+    }
+    if (!entry.interfaceBlock)
+        entry.interfaceBlock = block;
+    return true;
+}
+
+astBuiltin *parser::findBuiltin(int keyword) const {
+    if (m_builtinTable) {
+        if (astBuiltin *builtin = m_builtinTable->type(keyword))
+            return builtin;
+    }
+    for (size_t i = 0; i < m_builtins.size(); i++) {
+        if (m_builtins[i]->type == keyword)
+            return m_builtins[i];
     }
     return 0;
 }
 
-astVariable *parser::findVariable(const char *identifier) {
-    for (size_t scopeIndex = m_scopes.size(); scopeIndex > 0; scopeIndex--) {
-        scope &s = m_scopes[scopeIndex - 1];
-        for (size_t variableIndex = 0; variableIndex < s.size(); variableIndex++) {
-            if (!strcmp(s[variableIndex]->name, identifier))
-                return s[variableIndex];
+// Made in the arena, which aborts rather than return 0 when memory runs out
+astBuiltin *parser::builtinType(int keyword) {
+    if (astBuiltin *builtin = findBuiltin(keyword))
+        return builtin;
+    m_builtins.push_back(GC_NEW(astType) astBuiltin(keyword));
+    return m_builtins.back();
+}
+
+// The value of an array size which is a constant or a global naming one,
+// false for anything else, which is not evaluated here
+static bool constantArraySize(const astExpression *size, long long &value) {
+    if (!size)
+        return false;
+    switch (size->type) {
+    case astExpression::kIntConstant:
+        value = ((const astIntConstant*)size)->value;
+        return true;
+    case astExpression::kUIntConstant:
+        value = ((const astUIntConstant*)size)->value;
+        return true;
+    case astExpression::kVariableIdentifier: {
+        // Their initial values are evaluated as they are declared
+        const astVariable *variable = ((const astVariableIdentifier*)size)->variable;
+        if (variable->type != astVariable::kGlobal)
+            return false;
+        return constantArraySize(((const astGlobalVariable*)variable)->initialValue, value);
+    }
+    }
+    return false;
+}
+
+// Sizes which are not constants, or which are left out, are taken to be the
+// same as any other
+static bool sameArraySizes(astConstantExpression *const *a, size_t aDimensions,
+                           astConstantExpression *const *b, size_t bDimensions)
+{
+    if (aDimensions != bDimensions)
+        return false;
+    for (size_t i = 0; i < aDimensions; i++) {
+        long long aSize, bSize;
+        if (a[i] != b[i] && constantArraySize(a[i], aSize) && constantArraySize(b[i], bSize) && aSize != bSize)
+            return false;
+    }
+    return true;
+}
+
+// Either name of a square matrix is the same type
+static bool sameType(const astType *a, const astType *b) {
+    if (a == b)
+        return true;
+    return a && b && a->kind == astType::kBuiltin && b->kind == astType::kBuiltin
+        && shortName(((const astBuiltin*)a)->type) == shortName(((const astBuiltin*)b)->type);
+}
+
+static bool sameSignature(const astFunction *a, const astFunction *b) {
+    if (a->parameters.size() != b->parameters.size())
+        return false;
+    for (size_t i = 0; i < a->parameters.size(); i++) {
+        const astVariable *aParameter = a->parameters[i];
+        const astVariable *bParameter = b->parameters[i];
+        if (!sameType(aParameter->baseType, bParameter->baseType)
+            || !sameArraySizes(aParameter->arraySizes.begin(), aParameter->isArray ? aParameter->arraySizes.size() : 0,
+                               bParameter->arraySizes.begin(), bParameter->isArray ? bParameter->arraySizes.size() : 0))
+            return false;
+    }
+    return true;
+}
+
+// Overloads are chained by the id of the atom of their name. A definition
+// takes the place of its prototype for the calls which follow it.
+void parser::defineFunction(astFunction *function) {
+    const unsigned id = interner::id(function->name);
+    if (id >= m_functionNames.size())
+        m_functionNames.resize(id + 1);
+    for (unsigned at = m_functionNames[id]; at; at = m_overloads[at - 1].next) {
+        overload &declared = m_overloads[at - 1];
+        if (!sameSignature(declared.function, function))
+            continue;
+        if (declared.function->isPrototype && !function->isPrototype)
+            declared.function = function;
+        return;
+    }
+    overload entry = { function, m_functionNames[id] };
+    m_overloads.push_back(entry);
+    m_functionNames[id] = unsigned(m_overloads.size());
+}
+
+// Builtins are of the version of the #version directive, 110 without one
+static bool isVisible(const builtinTable::declaration *builtin, const astTU *tu) {
+    const astVersionDirective *directive = tu->versionDirective;
+    return directive
+        ? builtin->in(tu->type, directive->version, directive->type)
+        : builtin->in(tu->type, 110, kCore);
+}
+
+void parser::match(overloadMatch &match, astFunction *function, astExpression *const *arguments, size_t count) {
+    if (function->parameters.size() != count)
+        return;
+    match.counted = function;
+    match.counting++;
+    for (size_t i = 0; i < count; i++) {
+        const astValueType &argument = m_ast->valueTypes[arguments[i]->valueType];
+        const astVariable *parameter = function->parameters[i];
+        if (!argument.type)
+            continue;
+        if (!sameType(argument.type, parameter->baseType)
+            || !sameArraySizes(argument.arraySizes, argument.arrayDimensions,
+                               parameter->arraySizes.begin(), parameter->isArray ? parameter->arraySizes.size() : 0))
+            return;
+    }
+    match.fits = function;
+    match.fitting++;
+}
+
+// The overload whose parameters are of the types of the arguments, where
+// those are known. Implicit conversions are not tried, so when no overload
+// fits it is the only one taking that many, if there is just one. Those of
+// the shader and the builtins are all overloads of the one name.
+astFunction *parser::findFunction(const char *name, astExpression *const *arguments, size_t count) {
+    const unsigned id = interner::id(name);
+    overloadMatch found = { 0, 0, 0, 0 };
+    if (id < m_functionNames.size()) {
+        for (unsigned at = m_functionNames[id]; at; at = m_overloads[at - 1].next)
+            match(found, m_overloads[at - 1].function, arguments, count);
+    }
+    if (m_builtinTable) {
+        for (const builtinTable::declaration *it = m_builtinTable->find(id); it; it = it->next) {
+            if (it->function && isVisible(it, m_ast))
+                match(found, it->function, arguments, count);
+        }
+    }
+    if (found.fitting)
+        return found.fitting == 1 ? found.fits : 0;
+    return found.counting == 1 ? found.counted : 0;
+}
+
+astType *parser::findType(const span &identifier) {
+    const char *name = m_names.find(m_lexer.text(identifier), identifier.length);
+    if (!name)
+        return 0;
+    const unsigned id = interner::id(name);
+    return id < m_typeNames.size() ? m_typeNames[id].structure : 0;
+}
+
+// The builtins are hidden by anything the shader declares of their name
+astVariable *parser::findVariable(const span &identifier) {
+    const char *name = m_names.find(m_lexer.text(identifier), identifier.length);
+    if (!name)
+        return 0;
+    if (astVariable *variable = findVariable(name))
+        return variable;
+    if (m_builtinTable) {
+        for (const builtinTable::declaration *it = m_builtinTable->find(interner::id(name)); it; it = it->next) {
+            if (it->variable && isVisible(it, m_ast))
+                return it->variable;
         }
     }
     return 0;
 }
 
+astVariable *parser::findVariable(const char *name) {
+    if (!name)
+        return 0;
+    const unsigned id = interner::id(name);
+    return id < m_symbols.size() ? m_symbols[id].variable : 0;
+}
+
+// Names are bound to their innermost declaration by the id of the atom,
+// with the declarations they hide kept to put back when leaving the scope
+void parser::pushScope() {
+    m_scopes.push_back(m_shadows.size());
+}
+
+void parser::popScope() {
+    const size_t start = m_scopes.back();
+    m_scopes.pop_back();
+    while (m_shadows.size() > start) {
+        const shadow &undo = m_shadows.back();
+        m_symbols[undo.id] = undo.hidden;
+        m_shadows.pop_back();
+    }
+}
+
+void parser::declare(astVariable *variable) {
+    if (!variable->name)
+        return;
+    const unsigned id = interner::id(variable->name);
+    if (id >= m_symbols.size())
+        m_symbols.resize(id + 1);
+    symbol &current = m_symbols[id];
+    // The first declaration of a name in a scope is the one found
+    if (current.variable && current.scope == m_scopes.size())
+        return;
+    shadow undo = { id, current };
+    m_shadows.push_back(undo);
+    current.variable = variable;
+    current.scope = m_scopes.size();
+}
+
 const char *parser::error() const {
     return m_error;
 }
 
+template <typename T>
+static size_t vectorBytes(const vector<T> &v) {
+    return v.capacity() * sizeof(T);
+}
+
+template <typename T>
+static size_t vectorSlack(const vector<T> &v) {
+    return (v.capacity() - v.size()) * sizeof(T);
+}
+
+astStats parser::stats() const {
+    astStats stats;
+    if (m_ast)
+        stats.add(m_ast);
+    for (size_t i = 0; i < m_builtins.size(); i++) {
+        stats.types.count++;
+        stats.types.bytes += astArena::placed(sizeof(astBuiltin));
+        stats.nodeBytes += astArena::placed(sizeof(astBuiltin));
+    }
+
+    stats.arenaBytes = m_memory.bytes();
+    stats.arenaPeak = m_memory.peak();
+    stats.arenaReserved = m_memory.reserved();
+    stats.nameBytes = m_names.bytes();
+    stats.nameReserved = m_names.reserved();
+    for (size_t i = 0; i < m_strings.size(); i++)
+        stats.errorBytes += strlen(m_strings[i]) + 1;
+
+    const tokenArray &tokens = m_lexer.m_tokens;
+    stats.tokens = tokens.size();
+    stats.lexerBytes = vectorBytes(tokens.types)
+                     + vectorBytes(tokens.values)
+                     + vectorBytes(tokens.offsets)
+                     + vectorBytes(tokens.directives)
+                     + vectorBytes(m_lexer.m_lineStarts)
+                     + vectorBytes(m_lexer.m_ends);
+    stats.vectorSlack = vectorSlack(tokens.types)
+                      + vectorSlack(tokens.values)
+                      + vectorSlack(tokens.offsets)
+                      + vectorSlack(tokens.directives)
+                      + vectorSlack(m_lexer.m_lineStarts)
+                      + vectorSlack(m_lexer.m_ends)
+                      + vectorSlack(m_symbols)
+                      + vectorSlack(m_shadows)
+                      + vectorSlack(m_scopes)
+                      + vectorSlack(m_typeNames)
+                      + vectorSlack(m_functionNames)
+                      + vectorSlack(m_overloads)
+                      + vectorSlack(m_builtins)
+                      + vectorSlack(m_strings)
+                      + vectorSlack(m_valueTypes);
+    if (m_ast) {
+        stats.vectorSlack += vectorSlack(m_ast->extensionDirectives)
+                           + vectorSlack(m_ast->functions)
+                           + vectorSlack(m_ast->globals)
+                           + vectorSlack(m_ast->structures)
+                           + vectorSlack(m_ast->interfaceBlocks)
+                           + vectorSlack(m_ast->valueTypes);
+    }
+    return stats;
+}
+
 }
@@ -1,11 +1,148 @@
 #include <stdarg.h> // va_list, va_copy, va_start, va_end
-#include <stdlib.h> // malloc
 #include <stdio.h>  // vsnprintf
+#include <string.h> // memcmp, memcpy
+
+#include "glsl-parser/util.h"
 
 namespace glsl {
 
+static const size_t kInternerChunk = 4096;
+
+interner::interner(const allocator *memory, const interner *parent)
+    : m_memory(memory)
+    , m_parent(parent)
+    , m_chunks(0)
+    , m_spare(0)
+    , m_cursor(0)
+    , m_end(0)
+    , m_slots(memory)
+    , m_count(0)
+    , m_bytes(0)
+{
+    m_slots.resize(64);
+}
+
+interner::~interner() {
+    clear();
+    while (m_spare) {
+        chunk *next = m_spare->next;
+        memdel(m_memory, m_spare);
+        m_spare = next;
+    }
+}
+
+static inline unsigned internHash(const char *text, size_t length) {
+    unsigned hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    return hash;
+}
+
+// Where text is, or the free slot it would go in
+size_t interner::slot(const char *text, size_t length, unsigned hash) const {
+    const size_t mask = m_slots.size() - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        const char *atom = m_slots[index];
+        if (!atom || (interner::length(atom) == length && !memcmp(atom, text, length)))
+            return index;
+    }
+}
+
+void interner::grow() {
+    vector<const char *> slots = m_slots;
+    m_slots.resize(0);
+    m_slots.resize(slots.size() * 2);
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (!slots[i])
+            continue;
+        const size_t size = length(slots[i]);
+        m_slots[slot(slots[i], size, internHash(slots[i], size))] = slots[i];
+    }
+}
+
+const char *interner::find(const char *text, size_t length) const {
+    const unsigned hash = internHash(text, length);
+    for (const interner *it = this; it; it = it->m_parent) {
+        if (const char *atom = it->m_slots[it->slot(text, length, hash)])
+            return atom;
+    }
+    return 0;
+}
+
+const char *interner::intern(const char *text, size_t length) {
+    const unsigned hash = internHash(text, length);
+    for (const interner *it = m_parent; it; it = it->m_parent) {
+        if (const char *atom = it->m_slots[it->slot(text, length, hash)])
+            return atom;
+    }
+    size_t index = slot(text, length, hash);
+    if (m_slots[index])
+        return m_slots[index];
+
+    // Keep the id and length of the next atom aligned
+    const size_t header = 2 * sizeof(unsigned);
+    const size_t size = (header + length + 1 + sizeof(unsigned) - 1) & ~(sizeof(unsigned) - 1);
+    if (size_t(m_end - m_cursor) < size) {
+        const size_t offset = sizeof(chunk);
+        chunk *next = m_spare;
+        if (next && next->capacity - offset >= size) {
+            m_spare = next->next;
+        } else {
+            const size_t capacity = size + offset > kInternerChunk ? size + offset : kInternerChunk;
+            next = (chunk *)memnew(m_memory, capacity);
+            next->capacity = capacity;
+        }
+        next->next = m_chunks;
+        m_chunks = next;
+        m_cursor = (char *)next + offset;
+        m_end = (char *)next + next->capacity;
+    }
+    unsigned *record = (unsigned *)m_cursor;
+    record[0] = unsigned(interner::size());
+    record[1] = unsigned(length);
+    char *atom = m_cursor + header;
+    memcpy(atom, text, length);
+    atom[length] = '\0';
+    m_cursor += size;
+    m_bytes += size;
+
+    m_slots[index] = atom;
+    // Under half full keeps probing short
+    if (++m_count * 2 > m_slots.size())
+        grow();
+    return atom;
+}
+
+void interner::clear() {
+    while (m_chunks) {
+        chunk *next = m_chunks->next;
+        m_chunks->next = m_spare;
+        m_spare = m_chunks;
+        m_chunks = next;
+    }
+    m_cursor = 0;
+    m_end = 0;
+    for (size_t i = 0; i < m_slots.size(); i++)
+        m_slots[i] = 0;
+    m_count = 0;
+    m_bytes = 0;
+}
+
+size_t interner::reserved() const {
+    size_t bytes = m_slots.capacity() * sizeof(const char *);
+    for (const chunk *it = m_chunks; it; it = it->next)
+        bytes += it->capacity;
+    for (const chunk *it = m_spare; it; it = it->next)
+        bytes += it->capacity;
+    return bytes;
+}
+
 // An implementation of vasprintf
 int allocvfmt(char **str, const char *fmt, va_list vp) {
+    return allocvfmt(0, str, fmt, vp);
+}
+
+int allocvfmt(const allocator *memory, char **str, const char *fmt, va_list vp) {
     int size = 0;
     va_list va;
     va_copy(va, vp);
@@ -14,9 +151,7 @@ int allocvfmt(char **str, const char *fmt, va_list vp) {
 
     if (size < 0)
         return -1;
-    *str = (char *)malloc(size + 1);
-    if (!*str)
-        return -1;
+    *str = (char *)memnew(memory, size + 1);
     return vsprintf(*str, fmt, vp);
 }
 
@@ -29,4 +164,12 @@ int allocfmt(char **str, const char *fmt, ...) {
     return size;
 }
 
+int allocfmt(const allocator *memory, char **str, const char *fmt, ...) {
+    va_list va;
+    va_start(va, fmt);
+    int size = allocvfmt(memory, str, fmt, va);
+    va_end(va);
+    return size;
+}
+
 }
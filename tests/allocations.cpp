@@ -0,0 +1,97 @@
+#include <string.h> // memcpy, memset
+
+#include "glsl-parser/compact.h"
+#include "glsl-parser/converter.h"
+#include "glsl-parser/parser.h"
+#include "test.h"
+
+using namespace glsl;
+
+// Memory handed out with a tag in front, so a block given back to the wrong
+// place is noticed: free() of one of these is off by the tag and deallocate
+// of anything else finds no tag
+struct counts {
+    size_t live;
+    size_t total;
+    size_t foreign;
+};
+
+static const unsigned long long kTag = 0x676c736c616c6c63ull;
+static const size_t kHeader = 16;
+
+static void *countedAllocate(void *user, size_t size) {
+    counts *count = (counts *)user;
+    unsigned char *data = (unsigned char *)malloc(kHeader + size);
+    if (!data)
+        return 0;
+    memcpy(data, &kTag, sizeof kTag);
+    count->live++;
+    count->total++;
+    return data + kHeader;
+}
+
+static void countedDeallocate(void *user, void *data) {
+    counts *count = (counts *)user;
+    unsigned char *block = (unsigned char *)data - kHeader;
+    unsigned long long tag = 0;
+    memcpy(&tag, block, sizeof tag);
+    if (tag != kTag) {
+        count->foreign++;
+        return;
+    }
+    memset(block, 0, sizeof tag);
+    count->live--;
+    free(block);
+}
+
+int main(int argc, char **argv) {
+    counts count = { 0, 0, 0 };
+    const allocator memory = { countedAllocate, countedDeallocate, &count };
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *source = readFile(argv[i], &length);
+        if (!source)
+            continue;
+        {
+            // Everything which takes the allocator, used as a user would
+            lexer lex(source, length, &memory);
+            lex.tokenize();
+            vector<unsigned char> cache(&memory);
+            CHECK(lex.saveTokens(cache));
+
+            parser parse(source, length, argv[i], &memory);
+            parse.shareExpressions(true);
+            astTU *translationUnit = parse.parse(astTU::kFragment);
+            converter convert(&memory);
+            if (translationUnit) {
+                convert.convertTU(translationUnit);
+                compactTU compact(&memory);
+                compact.build(translationUnit);
+                vector<unsigned char> image(&memory);
+                CHECK(compact.save(image));
+                compactTU loaded(&memory);
+                CHECK(loaded.load(image.begin(), image.size()));
+                converter convertLoaded(&memory);
+                convertLoaded.convertTU(&loaded);
+            }
+
+            parser fromCache(0, argv[i], &memory);
+            CHECK(fromCache.loadTokens(cache.begin(), cache.size()));
+            if (fromCache.parse(astTU::kFragment)) {
+                // Parsing again reuses the memory of the last parse
+                fromCache.reset(source, length, argv[i]);
+                astTU *again = fromCache.parse(astTU::kFragment);
+                if (again)
+                    convert.convertTU(again);
+            }
+        }
+        CHECK(count.live == 0);
+        if (count.live)
+            fprintf(stderr, "    `%s' left %zu allocations\n", argv[i], count.live);
+        count.live = 0;
+        free(source);
+    }
+    CHECK(count.total != 0);
+    CHECK(count.foreign == 0);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+#include <string.h> // strlen
+
+#include "glsl-parser/builtins.h"
+#include "test.h"
+
+using namespace glsl;
+
+static const builtinTable::declaration *find(const builtinTable &builtins, const char *name) {
+    const char *atom = builtins.names().find(name, strlen(name));
+    return atom ? builtins.find(interner::id(atom)) : 0;
+}
+
+// Whether any declaration of the name is in the shaders given
+static bool in(const builtinTable &builtins, const char *name, int shaderType, int version, int profile) {
+    for (const builtinTable::declaration *entry = find(builtins, name); entry; entry = entry->next)
+        if (entry->in(shaderType, version, profile))
+            return true;
+    return false;
+}
+
+int main() {
+    const builtinTable &builtins = builtinTable::instance();
+    CHECK(!builtins.error());
+    if (builtins.error())
+        fprintf(stderr, "    %s\n", builtins.error());
+
+    // Every declaration of the specifications, each found by its name
+    size_t variables = 0;
+    size_t functions = 0;
+    for (unsigned id = 0; id < builtins.names().size(); id++) {
+        for (const builtinTable::declaration *entry = builtins.find(id); entry; entry = entry->next) {
+            CHECK(!entry->variable != !entry->function);
+            if (entry->variable)
+                variables++;
+            else
+                functions++;
+        }
+    }
+    CHECK(variables == 131);
+    CHECK(functions == 946);
+
+    CHECK(in(builtins, "gl_FragCoord", astTU::kFragment, 110, kCore));
+    CHECK(!in(builtins, "gl_FragCoord", astTU::kVertex, 450, kCore));
+    CHECK(in(builtins, "gl_Position", astTU::kVertex, 110, kCore));
+    CHECK(in(builtins, "gl_WorkGroupSize", astTU::kCompute, 430, kCore));
+    CHECK(!in(builtins, "gl_WorkGroupSize", astTU::kCompute, 420, kCore));
+    CHECK(in(builtins, "texture", astTU::kFragment, 130, kCore));
+    CHECK(!in(builtins, "texture", astTU::kFragment, 120, kCore));
+    CHECK(in(builtins, "texture2D", astTU::kFragment, 120, kCore));
+    CHECK(!in(builtins, "texture2D", astTU::kFragment, 330, kCore));
+    CHECK(in(builtins, "texture2D", astTU::kFragment, 330, kCompatibility));
+    CHECK(in(builtins, "texture2D", astTU::kFragment, 100, kES));
+    CHECK(in(builtins, "imageStore", astTU::kFragment, 420, kCore));
+    CHECK(in(builtins, "max", astTU::kVertex, 110, kCore));
+    CHECK(!find(builtins, "main"));
+
+    // Every builtin type has its one node, other keywords none
+    CHECK(builtins.type(kKeyword_vec4) && builtins.type(kKeyword_vec4)->type == kKeyword_vec4);
+    CHECK(builtins.type(kKeyword_sampler2D) && builtins.type(kKeyword_sampler2D)->type == kKeyword_sampler2D);
+    CHECK(!builtins.type(kKeyword_if));
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+#include <string.h> // strcmp
+
+#include "glsl-parser/compact.h"
+#include "glsl-parser/converter.h"
+#include "glsl-parser/parser.h"
+#include "test.h"
+
+using namespace glsl;
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *source = readFile(argv[i], &length);
+        if (!source)
+            continue;
+
+        // A compact AST prints the same as the AST it was built from
+        parser parse(source, length, argv[i]);
+        astTU *translationUnit = parse.parse(astTU::kFragment);
+        if (translationUnit) {
+            compactTU compact;
+            compact.build(translationUnit);
+            converter convertAST;
+            converter convertCompact;
+            const char *expect = convertAST.convertTU(translationUnit);
+            const char *got = convertCompact.convertTU(&compact);
+            CHECK(!strcmp(expect, got));
+            if (strcmp(expect, got))
+                fprintf(stderr, "    `%s' printed from its compact AST differs\n", argv[i]);
+        }
+
+        free(source);
+    }
+    return failures ? 1 : 0;
+}
@@ -8,4 +8,12 @@ void test() {
     double test_double_lf_lower = 1.5lf;
     double test_double_lf_upper = 1.5LF;
     float test_float_f_zero = 1.0f;
+    float test_float_exponent = 1e5;
+    float test_float_exponent_negative = 1.5e-3;
+    float test_float_exponent_positive = 0.5e+2;
+    float test_float_exponent_upper_f = 2E+2f;
+    float test_float_leading_dot = .25;
+    float test_float_trailing_dot = 5.;
+    double test_double_exponent_lf = 1e5lf;
+    double test_double_digits = 0.1000000000000000055511151231257827;
 }
@@ -0,0 +1,60 @@
+#include <string.h> // strcmp
+
+#include "glsl-parser/compact.h"
+#include "glsl-parser/converter.h"
+#include "glsl-parser/parser.h"
+#include "test.h"
+
+using namespace glsl;
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *source = readFile(argv[i], &length);
+        if (!source)
+            continue;
+        parser parse(source, length, argv[i]);
+        astTU *translationUnit = parse.parse(astTU::kFragment);
+        if (!translationUnit) {
+            free(source);
+            continue;
+        }
+
+        // A loaded image prints the same as what was saved
+        compactTU compact;
+        compact.build(translationUnit);
+        vector<unsigned char> image;
+        CHECK(compact.save(image));
+        compactTU loaded;
+        CHECK(loaded.load(image.begin(), image.size()));
+        converter convertCompact;
+        converter convertLoaded;
+        const char *expect = convertCompact.convertTU(&compact);
+        CHECK(!strcmp(expect, convertLoaded.convertTU(&loaded)));
+
+        // An image cut short is always noticed and what was loaded before
+        // stays as it was
+        for (size_t size = 0; size < image.size(); size++)
+            CHECK(!loaded.load(image.begin(), size));
+        converter convertKept;
+        CHECK(!strcmp(expect, convertKept.convertTU(&loaded)));
+
+        // Damage which is not noticed must still be safe to print
+        vector<unsigned char> damaged;
+        for (int j = 0; j < 1000; j++) {
+            damaged = image;
+            for (int k = 0; k < 1 + j % 4; k++) {
+                unsigned char &at = damaged[size_t(testRandom() % damaged.size())];
+                at = j % 2 ? (unsigned char)(at ^ (1u << (testRandom() % 8))) : (unsigned char)testRandom();
+            }
+            compactTU mapped;
+            if (mapped.load(damaged.begin(), damaged.size())) {
+                converter convertDamaged;
+                convertDamaged.convertTU(&mapped);
+            }
+        }
+
+        free(source);
+    }
+    return failures ? 1 : 0;
+}
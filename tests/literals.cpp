@@ -0,0 +1,114 @@
+#include <stdlib.h> // strtof, strtod
+#include <string.h> // memcmp, strlen
+
+#include "glsl-parser/lexer.h"
+#include "test.h"
+
+using namespace glsl;
+
+// Lexes text as the only token, which must be of the type given
+static const tokenArray::value *lex(lexer &source, const char *text, int type) {
+    source.reset(text, strlen(text));
+    source.tokenize();
+    const tokenArray &tokens = source.tokens();
+    CHECK(!tokens.error && tokens.size() == 2 && tokens.types[0] == type);
+    if (tokens.error || tokens.size() != 2 || tokens.types[0] != type) {
+        fprintf(stderr, "    lexing `%s'\n", text);
+        return 0;
+    }
+    return &tokens.values[0];
+}
+
+// Rounded the same as strtof and strtod, to the bit
+static void checkDecimal(lexer &source, char *text, size_t length) {
+    const float expectFloat = strtof(text, 0);
+    const double expectDouble = strtod(text, 0);
+    text[length] = 'f';
+    text[length + 1] = '\0';
+    if (const tokenArray::value *value = lex(source, text, kType_constant_float)) {
+        CHECK(!memcmp(&value->asFloat, &expectFloat, sizeof expectFloat));
+        if (memcmp(&value->asFloat, &expectFloat, sizeof expectFloat))
+            fprintf(stderr, "    `%s' is %.9g, not %.9g\n", text, value->asFloat, expectFloat);
+    }
+    text[length] = 'l';
+    text[length + 1] = 'f';
+    text[length + 2] = '\0';
+    if (const tokenArray::value *value = lex(source, text, kType_constant_double)) {
+        CHECK(!memcmp(&value->asDouble, &expectDouble, sizeof expectDouble));
+        if (memcmp(&value->asDouble, &expectDouble, sizeof expectDouble))
+            fprintf(stderr, "    `%s' is %.17g, not %.17g\n", text, value->asDouble, expectDouble);
+    }
+    text[length] = '\0';
+}
+
+int main() {
+    lexer source("", size_t(0));
+    char text[1024];
+
+    // Those hardest to round: halfway cases, the ends of the ranges and
+    // more digits than fit in 64 bits
+    static const char *const kHard[] = {
+        "1e5", "1.5e-3", "0.5e+2", ".25", "5.", "0.1", "16777217", "9007199254740993",
+        "1.0e-45", "1.4e-45", "7.006492321624085e-46", "3.4028235e38", "3.4028235677973366e38",
+        "340282356779733661637539395458142568448", "2.2250738585072011e-308",
+        "4.9406564584124654e-324", "2.4703282292062328e-324", "1.7976931348623157e308",
+        "1.7976931348623159e308", "1e400", "1e-400", "0.000000000000000000000000000000000001",
+        "123456789012345678901234567890.123456789012345678901234567890e-10", "08.5", "09e1"
+    };
+    for (size_t i = 0; i < sizeof kHard / sizeof *kHard; i++) {
+        const size_t length = strlen(kHard[i]);
+        memcpy(text, kHard[i], length + 1);
+        checkDecimal(source, text, length);
+    }
+
+    // Random ones, long and short, with and without an exponent
+    for (int i = 0; i < 100000; i++) {
+        size_t length = 0;
+        const int whole = int(testRandom() % (i % 10 ? 20 : 400));
+        const int fraction = int(testRandom() % (i % 10 ? 20 : 400));
+        for (int j = 0; j < whole; j++)
+            text[length++] = char('0' + testRandom() % 10);
+        if (!whole || fraction || testRandom() % 2) {
+            text[length++] = '.';
+            for (int j = 0; j < fraction; j++)
+                text[length++] = char('0' + testRandom() % 10);
+            if (!whole && !fraction)
+                text[length++] = '0';
+        }
+        if (testRandom() % 4)
+            length += snprintf(text + length, 16, "e%d", int(testRandom() % 700) - 350);
+        text[length] = '\0';
+        checkDecimal(source, text, length);
+    }
+
+    // Integers in every base, past 32 bits or with digits not of the base is an error
+    struct integer {
+        const char *text;
+        int type;
+        unsigned value;
+    };
+    static const integer kIntegers[] = {
+        { "0", kType_constant_int, 0 },
+        { "42", kType_constant_int, 42 },
+        { "42u", kType_constant_uint, 42 },
+        { "0x1F", kType_constant_int, 31 },
+        { "0XffU", kType_constant_uint, 255 },
+        { "0777", kType_constant_int, 511 },
+        { "2147483647", kType_constant_int, 2147483647u },
+        { "4294967295u", kType_constant_uint, 4294967295u },
+        { "0xFFFFFFFFu", kType_constant_uint, 4294967295u }
+    };
+    for (size_t i = 0; i < sizeof kIntegers / sizeof *kIntegers; i++) {
+        const integer &expect = kIntegers[i];
+        if (const tokenArray::value *value = lex(source, expect.text, expect.type))
+            CHECK(value->asUnsigned == expect.value);
+    }
+    static const char *const kInvalid[] = { "2147483648", "4294967296u", "0x100000000", "0778", "1x" };
+    for (size_t i = 0; i < sizeof kInvalid / sizeof *kInvalid; i++) {
+        source.reset(kInvalid[i], strlen(kInvalid[i]));
+        source.tokenize();
+        CHECK(source.tokens().error);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#include "glsl-parser/parser.h"
+#include "test.h"
+
+using namespace glsl;
+
+// A definition takes the place of its prototype, so a call never goes to
+// the prototype of a function defined with as many parameters
+static bool defined(const astTU *translationUnit, const astFunction *prototype) {
+    for (size_t i = 0; i < translationUnit->functions.size(); i++) {
+        const astFunction *function = translationUnit->functions[i];
+        if (!function->isPrototype && function->name == prototype->name
+            && function->parameters.size() == prototype->parameters.size())
+            return true;
+    }
+    return false;
+}
+
+// The test shaders only initialize a variable straight from a call when it
+// is of the type returned, so the overload picked shows in the variable. The
+// builtin functions share the nodes of the builtin types, so that type is
+// the very node of the variable's.
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *source = readFile(argv[i], &length);
+        if (!source)
+            continue;
+        parser parse(source, length, argv[i]);
+        astTU *translationUnit = parse.parse(astTU::kFragment);
+        for (size_t j = 0; translationUnit && j < translationUnit->functions.size(); j++) {
+            astFunction *function = translationUnit->functions[j];
+            for (size_t k = 0; k < function->statements.size(); k++) {
+                if (function->statements[k]->type != astStatement::kDeclaration)
+                    continue;
+                astDeclarationStatement *declaration = (astDeclarationStatement*)function->statements[k];
+                for (size_t l = 0; l < declaration->variables.size(); l++) {
+                    astFunctionVariable *variable = declaration->variables[l];
+                    astExpression *value = variable->initialValue;
+                    if (!value || value->type != astExpression::kFunctionCall)
+                        continue;
+                    astFunctionCall *call = (astFunctionCall*)value;
+                    const bool picked = call->function && call->function->returnType == variable->baseType
+                        && !(call->function->isPrototype && defined(translationUnit, call->function));
+                    CHECK(picked);
+                    if (!picked)
+                        fprintf(stderr, "    `%s' in `%s' is initialized by the wrong overload of `%s'\n",
+                            variable->name, argv[i], call->name);
+                }
+            }
+        }
+        free(source);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+#version 330
+uniform sampler2D colors;
+uniform usampler2D counts;
+struct S { float v; };
+
+float f(float x) { return x; }
+int f(int x) { return x; }
+uint f(uint x) { return x; }
+vec2 f(vec2 x, float y) { return x * y; }
+S f(float x, float y) { S s; return s; }
+
+const int N = 3;
+float g(float a[2]) { return a[0]; }
+int g(float a[3]) { return 1; }
+uint h(float a[N]);
+uint h(float a[3]) { return 1u; }
+
+mat2 q(mat2x2 m) { return m; }
+mat3 q(mat3 m) { return m; }
+float r(mat2 m);
+float r(mat2x2 m) { return m[0][0]; }
+
+float x2[2];
+float x3[N];
+
+void main() {
+    float a = f(1.0);
+    int b = f(2);
+    uint c = f(3u);
+    vec2 d = f(vec2(1.0), a);
+    S e = f(a, a);
+    float i = g(x2);
+    int j = g(x3);
+    uint k = h(x3);
+    vec4 l = texture(colors, vec2(0.0));
+    uvec4 m = texture(counts, vec2(0.0));
+    float n = max(1.0, a);
+    ivec3 o = max(ivec3(1), ivec3(2));
+    float p = length(vec3(1.0));
+    mat2 q2 = q(mat2(1.0));
+    mat3 q3 = q(mat3x3(1.0));
+    float r2 = r(mat2(1.0));
+}
@@ -0,0 +1,99 @@
+#include <string.h> // memcmp, strlen
+
+#include "glsl-parser/lexer.h"
+#include "test.h"
+
+using namespace glsl;
+
+// Relexing after an edit must leave the tokens a full tokenize() of the
+// edited source makes
+static bool sameTokens(const tokenArray &got, const tokenArray &expect) {
+    if (got.size() != expect.size() || got.directives.size() != expect.directives.size())
+        return false;
+    if (got.error != expect.error || (got.error && got.errorOffset != expect.errorOffset))
+        return false;
+    for (size_t i = 0; i < got.size(); i++) {
+        if (got.types[i] != expect.types[i] || got.offsets[i] != expect.offsets[i])
+            return false;
+        if (memcmp(&got.values[i], &expect.values[i], sizeof got.values[i]))
+            return false;
+    }
+    for (size_t i = 0; i < got.directives.size(); i++) {
+        const directive &a = got.directives[i];
+        const directive &b = expect.directives[i];
+        if (a.type != b.type)
+            return false;
+        if (a.type == directive::kVersion) {
+            if (a.asVersion.version != b.asVersion.version || a.asVersion.type != b.asVersion.type)
+                return false;
+        } else if (a.asExtension.name.offset != b.asExtension.name.offset
+                || a.asExtension.name.length != b.asExtension.name.length
+                || a.asExtension.behavior != b.asExtension.behavior) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// What gets typed: pieces of tokens, ones which join or split those around
+// them, and ones which open or close comments
+static const char *const kInserts[] = {
+    "", " ", "\n", "a", "x1", "_", "0", "9", "0x", "1.", ".5", "e", "e-", "f", "lf", "u",
+    "+", "-", "=", "<", "<<", ">>=", "&&", "|", "^", ".", ",", ";", "(", ")", "{", "}",
+    "/", "*", "/*", "*/", "//", "#", "#version 450 core\n", "#extension GL_foo : enable\n",
+    "\\\n", "4294967296", "0778", "$", "float ", "vec3 v = vec3(1.0);\n"
+};
+
+int main(int argc, char **argv) {
+    lexer edited("", size_t(0));
+    lexer fresh("", size_t(0));
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *data = readFile(argv[i], &length);
+        if (!data)
+            continue;
+        vector<char> source;
+        source.insert(source.begin(), data, data + length);
+        free(data);
+
+        edited.reset(source.begin(), source.size());
+        edited.tokenize();
+        for (int j = 0; j < 4000; j++) {
+            // Mostly small edits, with a source made of pieces of itself
+            // now and then
+            const size_t offset = source.size() ? size_t(testRandom() % (source.size() + 1)) : 0;
+            const size_t removable = source.size() - offset;
+            size_t removed = removable ? size_t(testRandom() % (removable < 8 ? removable + 1 : 8)) : 0;
+            vector<char> insert;
+            if (j % 50 == 49 && removable) {
+                const size_t from = size_t(testRandom() % source.size());
+                const size_t count = size_t(testRandom() % (source.size() - from + 1));
+                insert.insert(insert.begin(), source.begin() + from, source.begin() + from + (count < 64 ? count : 64));
+                removed = size_t(testRandom() % (removable + 1));
+            } else {
+                const char *text = kInserts[testRandom() % (sizeof kInserts / sizeof *kInserts)];
+                insert.insert(insert.begin(), text, text + strlen(text));
+            }
+            source.erase(source.begin() + offset, source.begin() + offset + removed);
+            source.insert(source.begin() + offset, insert.begin(), insert.end());
+
+            edited.relex(source.begin(), source.size(), offset, removed, insert.size());
+            // Edits pile up between reads, each moving the gap left by the
+            // last one
+            if (testRandom() % 4)
+                continue;
+            fresh.reset(source.begin(), source.size());
+            fresh.tokenize();
+            const bool same = sameTokens(edited.tokens(), fresh.tokens());
+            CHECK(same);
+            if (!same) {
+                fprintf(stderr, "    `%s' after edit %d at %zu, %zu removed and %zu inserted\n",
+                    argv[i], j, offset, removed, insert.size());
+                // Start over from what it should have been
+                edited.reset(source.begin(), source.size());
+                edited.tokenize();
+            }
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+#include <string.h> // strcmp, strlen
+
+#include "glsl-parser/converter.h"
+#include "glsl-parser/parser.h"
+#include "test.h"
+
+using namespace glsl;
+
+// Every statement of main but the first two is written twice in a row
+static const char kSource[] =
+    "#version 430\n"
+    "uniform sampler2D t;\n"
+    "uniform uimage2D img;\n"
+    "float g(float x) { return x; }\n"
+    "void main() {\n"
+    "    int i = 0;\n"
+    "    float a = 1.0;\n"
+    "    i++; i++;\n"
+    "    i = 1; i = 1;\n"
+    "    g(a); g(a);\n"
+    "    sin(a); sin(a);\n"
+    "    texture(t, vec2(a)); texture(t, vec2(a));\n"
+    "    imageAtomicAdd(img, ivec2(0), 1u); imageAtomicAdd(img, ivec2(0), 1u);\n"
+    "    a + 1.0; a + 1.0;\n"
+    "    (a + 1.0) * a; (a + 1.0) * a;\n"
+    "}\n";
+
+// Whether each of those pairs is one node: not when it has side effects,
+// which user functions are taken to have
+static const bool kPairShared[] = { false, false, false, true, true, false, true, true };
+
+static astExpression *statementExpression(astFunction *function, size_t index) {
+    return ((astExpressionStatement*)function->statements[index])->expression;
+}
+
+int main(int argc, char **argv) {
+    parser parse(kSource, strlen(kSource), "sharing");
+    parse.shareExpressions(true);
+    astTU *translationUnit = parse.parse(astTU::kFragment);
+    CHECK(translationUnit);
+    if (translationUnit) {
+        astFunction *function = translationUnit->functions[1];
+        const size_t count = sizeof kPairShared / sizeof *kPairShared;
+        CHECK(function->statements.size() == 2 + count * 2);
+        for (size_t i = 0; i < count && 3 + i * 2 < function->statements.size(); i++) {
+            const bool shared = statementExpression(function, 2 + i * 2) == statementExpression(function, 3 + i * 2);
+            CHECK(shared == kPairShared[i]);
+            if (shared != kPairShared[i])
+                fprintf(stderr, "    pair %zu is %s\n", i, shared ? "shared" : "apart");
+        }
+    } else {
+        fprintf(stderr, "    %s\n", parse.error());
+    }
+
+    // Sharing changes nothing about what a shader is
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *source = readFile(argv[i], &length);
+        if (!source)
+            continue;
+
+        parser apart(source, length, argv[i]);
+        parser shared(source, length, argv[i]);
+        shared.shareExpressions(true);
+        astTU *expect = apart.parse(astTU::kFragment);
+        astTU *got = shared.parse(astTU::kFragment);
+        CHECK(!expect == !got);
+        if (expect && got) {
+            converter convertApart;
+            converter convertShared;
+            const char *expectText = convertApart.convertTU(expect);
+            const char *gotText = convertShared.convertTU(got);
+            CHECK(!strcmp(expectText, gotText));
+            if (strcmp(expectText, gotText))
+                fprintf(stderr, "    `%s' prints differently with sharing\n", argv[i]);
+            CHECK(shared.memory().bytes() <= apart.memory().bytes());
+        } else if (!expect && !got) {
+            CHECK(!strcmp(apart.error(), shared.error()));
+        }
+
+        free(source);
+    }
+    return failures ? 1 : 0;
+}
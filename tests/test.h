@@ -0,0 +1,50 @@
+#ifndef TEST_HDR
+#define TEST_HDR
+#include <stdio.h>  // fprintf, fopen
+#include <stdlib.h> // malloc, free
+
+// A test is a program which fails when any of its checks do, each printed
+static int failures = 0;
+
+#define CHECK(X) \
+    do { \
+        if (!(X)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #X); \
+            failures++; \
+        } \
+    } while (0)
+
+// Deterministic, so a failure happens again on the next run
+static unsigned long long testRandomState = 88172645463325252ull;
+static inline unsigned long long testRandom() {
+    testRandomState ^= testRandomState << 13;
+    testRandomState ^= testRandomState >> 7;
+    testRandomState ^= testRandomState << 17;
+    return testRandomState;
+}
+
+// The contents of a file, NUL terminated, to free() after. 0 when it cannot
+// be read, which is a failed check.
+static inline char *readFile(const char *fileName, size_t *length) {
+    FILE *file = fopen(fileName, "rb");
+    char *data = 0;
+    long size = -1;
+    if (file && !fseek(file, 0, SEEK_END) && (size = ftell(file)) >= 0 && !fseek(file, 0, SEEK_SET)) {
+        data = (char *)malloc(size_t(size) + 1);
+        if (data && fread(data, 1, size_t(size), file) == size_t(size)) {
+            data[size] = '\0';
+            *length = size_t(size);
+        } else {
+            free(data);
+            data = 0;
+        }
+    }
+    if (file)
+        fclose(file);
+    if (!data)
+        fprintf(stderr, "failed to read `%s'\n", fileName);
+    CHECK(data);
+    return data;
+}
+
+#endif
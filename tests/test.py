@@ -3,22 +3,23 @@
 from glob import glob
 import os
 import subprocess
+import sys
 from itertools import zip_longest
 
+# Usage: test.py [path to glsl-parser]
 def main():
     test_dir_name = 'tests'
-    repo_dir = os.path.dirname(os.path.realpath(__file__))
+    repo_dir = os.path.dirname(os.path.dirname(os.path.realpath(__file__)))
     test_dir = os.path.join(repo_dir, test_dir_name)
-    parser = os.path.join(repo_dir, 'glsl-parser')
+    parser = sys.argv[1] if len(sys.argv) > 1 else os.path.join(repo_dir, 'glsl-parser')
+    failed = 0
 
     for name in sorted(glob(os.path.join(test_dir, '*.glsl'))):
         base = os.path.splitext(name)[0]
 
-        if not os.path.isfile(base + '.glsl'):
-            print('failed to find source file for `%s\'' % name)
-            continue
         if not os.path.isfile(base + '.test') and not os.path.islink(base + '.test'):
             print('failed to find test file for `%s\'' % name)
+            failed += 1
             continue
 
         with open(base + '.test') as test:
@@ -39,10 +40,15 @@ def main():
                 got = line2 if line2 else '<nothing>'
                 if expect != got:
                     errors.append("expected `%s' got `%s'" % (expect, got))
+            process.wait()
             print('%s: %s' % (name, 'failed' if len(errors) else 'passed'))
             for error in errors:
                 print('    %s' % error)
+            if errors:
+                failed += 1
+
+    return 1 if failed else 0
 
 
 if __name__ == "__main__":
-    main()
+    sys.exit(main())
@@ -0,0 +1,62 @@
+#include <string.h> // strcmp
+
+#include "glsl-parser/converter.h"
+#include "glsl-parser/parser.h"
+#include "test.h"
+
+using namespace glsl;
+
+// What the parse of a shader prints, or its error, in memory kept by the
+// converter or parser
+static const char *print(parser &parse, converter &convert) {
+    astTU *translationUnit = parse.parse(astTU::kFragment);
+    return translationUnit ? convert.convertTU(translationUnit) : parse.error();
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *source = readFile(argv[i], &length);
+        if (!source)
+            continue;
+
+        lexer lex(source, length);
+        lex.tokenize();
+        vector<unsigned char> cache;
+        CHECK(lex.saveTokens(cache));
+
+        // Parsing the cache is the same as parsing the source, down to the
+        // line and column of an error
+        parser fromSource(source, length, argv[i]);
+        converter convertSource;
+        const char *expect = print(fromSource, convertSource);
+        parser fromCache(0, argv[i]);
+        converter convertCache;
+        CHECK(fromCache.loadTokens(cache.begin(), cache.size()));
+        const char *got = print(fromCache, convertCache);
+        CHECK(expect && got && !strcmp(expect, got));
+        if (!expect || !got || strcmp(expect, got))
+            fprintf(stderr, "    `%s' parsed from its token cache differs\n", argv[i]);
+
+        // A cache cut short is always noticed
+        for (size_t size = 0; size < cache.size(); size++) {
+            lexer truncated("", size_t(0));
+            CHECK(!truncated.loadTokens(cache.begin(), size));
+        }
+
+        // Damage the loader does not notice must still be safe to parse
+        vector<unsigned char> damaged;
+        for (int j = 0; j < 200; j++) {
+            damaged = cache;
+            for (int k = 0; k < 1 + j % 4; k++)
+                damaged[size_t(testRandom() % damaged.size())] ^= (unsigned char)(1u << (testRandom() % 8));
+            parser fromDamaged(0, argv[i]);
+            converter convertDamaged;
+            if (fromDamaged.loadTokens(damaged.begin(), damaged.size()))
+                print(fromDamaged, convertDamaged);
+        }
+
+        free(source);
+    }
+    return failures ? 1 : 0;
+}
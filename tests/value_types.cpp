@@ -0,0 +1,39 @@
+#include "glsl-parser/parser.h"
+#include "test.h"
+
+using namespace glsl;
+
+// The test shaders only assign a value of the type assigned to, so the type
+// resolved for the value shows in the one of the variable. Types are kept
+// once per translation unit, so equal ones have the same index.
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        size_t length = 0;
+        char *source = readFile(argv[i], &length);
+        if (!source)
+            continue;
+        parser parse(source, length, argv[i]);
+        astTU *translationUnit = parse.parse(astTU::kFragment);
+        for (size_t j = 0; translationUnit && j < translationUnit->functions.size(); j++) {
+            astFunction *function = translationUnit->functions[j];
+            for (size_t k = 0; k < function->statements.size(); k++) {
+                if (function->statements[k]->type != astStatement::kExpression)
+                    continue;
+                astExpression *expression = ((astExpressionStatement*)function->statements[k])->expression;
+                if (expression->type != astExpression::kAssign)
+                    continue;
+                astAssignmentExpression *assignment = (astAssignmentExpression*)expression;
+                if (assignment->assignment != kOperator_assign)
+                    continue;
+                const unsigned expect = assignment->operand1->valueType;
+                const unsigned got = assignment->operand2->valueType;
+                CHECK(expect != astValueType::kUnknown && got == expect && assignment->valueType == expect);
+                if (expect == astValueType::kUnknown || got != expect || assignment->valueType != expect)
+                    fprintf(stderr, "    statement %zu of `%s' in `%s' assigns a value of another type\n",
+                        k, function->name, argv[i]);
+            }
+        }
+        free(source);
+    }
+    return failures ? 1 : 0;
+}
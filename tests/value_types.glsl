@@ -0,0 +1,49 @@
+#version 430
+struct S { vec3 p; float w[2]; };
+uniform Block { mat4 m; S s; } blk;
+S arr[3];
+uniform sampler2D tex;
+in vec2 uv;
+out vec4 color;
+float g(float x) { return x; }
+void main() {
+    vec3 v;
+    vec2 w;
+    float f;
+    int i;
+    uint u;
+    bool b;
+    mat2 m2;
+    mat3 m3;
+    mat4 m4;
+    mat3x2 m32;
+    mat2x3 m23;
+    S s;
+    v = vec3(1.0);
+    color = blk.m * vec4(v, 1.0);
+    v = arr[1].p.zyx + 1.0;
+    w = v.xy;
+    w = v.zz;
+    f = v.z;
+    color = v.xyzx;
+    f = blk.s.p.y;
+    s = arr[2];
+    f = g(arr[2].p.x * 2.0);
+    m2 = m32 * m23;
+    m3 = m23 * m32;
+    m4 = m4 * m4;
+    v = m23 * vec2(1.0);
+    w = vec3(1.0) * m23;
+    w = m2 * w;
+    v = v * m3;
+    w = (i < 3) ? v.xy : uv;
+    v = texture(tex, uv * 2.0).rgb;
+    f = max(v.x + 1.0, 2.0);
+    i = i << 2;
+    u = uvec2(1u).y + 1u;
+    b = !true;
+    b = dot(v, v) > 0.0 && i == 2;
+    f = float(i);
+    v = -v;
+    m3 = mat3(m4);
+}